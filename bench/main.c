@@ -0,0 +1,879 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Loopback benchmark. Needs TX wired to RX (jumper, or the host simulation).
+ *
+ * stream:   a writer thread sends sequence-numbered, CRC-32 protected 64 byte
+ *           blocks while the main thread receives and checks them. Reports
+ *           TX rate (write side), RX rate (first to last byte received) and
+ *           full-duplex rate (both directions over the whole run).
+ *           With XON/XOFF the blocks are hex and letters only, so no data
+ *           byte is taken for a flow control character.
+ * pingpong: write a message, wait until it is back, per size.
+ * fifo:     FT232H synchronous 245 FIFO capture through
+ *           libusbserial_ftdi_stream_start(), the far side sends a byte
+ *           counter so gaps show up as discontinuities.
+ * mpsse:    batched SPI transactions through MPSSE with the loopback
+ *           wired in, per size. Needs an FT232H (or the host simulation).
+ *
+ * Every result is one JSON object per line. With -e the exit status is 1
+ * if a stream or mpsse run lost or corrupted data.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libusbserial.h>
+
+#ifdef LIBUSBSERIAL_HOST
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <usbsim.h>
+#else
+#include <psp2/kernel/clib.h>
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+#endif
+
+#define BLOCK_SIZE 64
+#define BLOCK_PAYLOAD (BLOCK_SIZE - 8)
+/* text blocks: 8 hex digits sequence, letters, 8 hex digits CRC-32 */
+#define TEXT_PAYLOAD (BLOCK_SIZE - 16)
+#define MAX_ITERATIONS 1000
+#define MAX_MESSAGE 4096
+#define READ_TIMEOUT 500000
+#define MAX_TIMEOUTS 3
+#define FIFO_DEFAULT_BYTES (8 * 1024 * 1024)
+#define SPI_BATCH 64
+#define SPI_CLOCK 30000000
+
+static const int default_bauds[] = {115200, 921600, 3000000, 0};
+static const int default_sizes[] = {1, 16, 64, 256, 1024, 4096, 0};
+
+static FILE *out;
+static int text_blocks;
+static int failures;
+
+/*
+ *  Platform
+ */
+
+#ifdef LIBUSBSERIAL_HOST
+int module_start(SceSize args, void *argp);
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void delay_us(unsigned int us)
+{
+    usleep(us);
+}
+
+typedef pthread_t benchThread;
+
+static void *_thread_entry(void *arg);
+
+static int thread_start(benchThread *th, void *arg)
+{
+    return pthread_create(th, NULL, _thread_entry, arg) == 0 ? 0 : -1;
+}
+
+static void thread_join(benchThread *th)
+{
+    pthread_join(*th, NULL);
+}
+#else
+static int64_t now_us(void)
+{
+    return sceKernelGetProcessTimeWide();
+}
+
+static void delay_us(unsigned int us)
+{
+    sceKernelDelayThread(us);
+}
+
+typedef SceUID benchThread;
+
+static int _thread_entry(SceSize args, void *argp);
+
+static int thread_start(benchThread *th, void *arg)
+{
+    *th = sceKernelCreateThread("bench_writer", _thread_entry, 0x10000100, 0x10000, 0, 0, NULL);
+    if (*th < 0)
+        return -1;
+    return sceKernelStartThread(*th, sizeof(arg), &arg) < 0 ? -1 : 0;
+}
+
+static void thread_join(benchThread *th)
+{
+    sceKernelWaitThreadEnd(*th, NULL, NULL);
+    sceKernelDeleteThread(*th);
+}
+#endif
+
+static void emit(const char *fmt, ...)
+{
+    char line[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+
+    fprintf(out, "%s\n", line);
+    fflush(out);
+#ifndef LIBUSBSERIAL_HOST
+    sceClibPrintf("%s\n", line);
+#endif
+}
+
+/*
+ *  Data
+ */
+
+static uint32_t crc_table[256];
+
+static void crc32_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32(const unsigned char *p, int len)
+{
+    uint32_t c = 0xFFFFFFFF;
+    while (len--)
+        c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+/* byte at a time references for the driver's CRC engine */
+static uint16_t crc16r_table[256];
+static uint16_t crc16_table[256];
+
+static void crc16_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t r = i;
+        uint32_t n = i << 8;
+        for (int k = 0; k < 8; k++)
+        {
+            r = (r & 1) ? 0xA001 ^ (r >> 1) : r >> 1;
+            n = (n & 0x8000) ? 0x1021 ^ (n << 1) : n << 1;
+        }
+        crc16r_table[i] = r;
+        crc16_table[i]  = n;
+    }
+}
+
+static uint32_t crc_ref(enum crc_type type, const unsigned char *p, int len)
+{
+    uint32_t c;
+
+    switch (type)
+    {
+    case CRC16_MODBUS:
+        c = 0xFFFF;
+        while (len--)
+            c = crc16r_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+        return c;
+    case CRC16_CCITT:
+    case CRC16_XMODEM:
+        c = type == CRC16_CCITT ? 0xFFFF : 0;
+        while (len--)
+            c = crc16_table[(c >> 8) ^ *p++] ^ ((c << 8) & 0xFFFF);
+        return c;
+    default:
+        return crc32(p, len);
+    }
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_hex(unsigned char *p, uint32_t v)
+{
+    for (int i = 7; i >= 0; i--, v >>= 4)
+        p[i] = "0123456789ABCDEF"[v & 0xF];
+}
+
+static int get_hex(const unsigned char *p, uint32_t *v)
+{
+    *v = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        int d = p[i] >= '0' && p[i] <= '9' ? p[i] - '0' : p[i] >= 'A' && p[i] <= 'F' ? p[i] - 'A' + 10 : -1;
+        if (d < 0)
+            return -1;
+        *v = *v << 4 | d;
+    }
+    return 0;
+}
+
+static void make_block(unsigned char *b, uint32_t seq)
+{
+    uint32_t x = seq * 2654435761u + 1;
+
+    if (text_blocks)
+    {
+        put_hex(b, seq);
+        for (int i = 0; i < TEXT_PAYLOAD; i++)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            b[8 + i] = 'a' + x % 26;
+        }
+        put_hex(b + 8 + TEXT_PAYLOAD, crc32(b, 8 + TEXT_PAYLOAD));
+        return;
+    }
+
+    put32(b, seq);
+    for (int i = 0; i < BLOCK_PAYLOAD; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b[4 + i] = x;
+    }
+    put32(b + 4 + BLOCK_PAYLOAD, crc32(b, 4 + BLOCK_PAYLOAD));
+}
+
+/* 0 and the sequence number if the block is intact */
+static int check_block(const unsigned char *b, uint32_t *seq)
+{
+    if (text_blocks)
+    {
+        uint32_t crc;
+        if (get_hex(b + 8 + TEXT_PAYLOAD, &crc) < 0 || crc != crc32(b, 8 + TEXT_PAYLOAD))
+            return -1;
+        return get_hex(b, seq);
+    }
+
+    if (crc32(b, 4 + BLOCK_PAYLOAD) != get32(b + 4 + BLOCK_PAYLOAD))
+        return -1;
+    *seq = get32(b);
+    return 0;
+}
+
+/* Whatever is there, or wait for the first byte */
+static int bench_read(unsigned char *buf, int size, SceUInt timeout)
+{
+    return libusbserial_read_data_timed(buf, size, 1, timeout, 0);
+}
+
+/*
+ *  Stream
+ */
+
+typedef struct
+{
+    uint32_t blocks;
+    int chunk;
+    int64_t start;
+    int64_t end;
+    int error;
+} streamJob;
+
+static void stream_writer(streamJob *job)
+{
+    static unsigned char buf[MAX_MESSAGE];
+    int per_chunk = job->chunk / BLOCK_SIZE;
+    uint32_t seq  = 0;
+
+    job->start = now_us();
+    while (seq < job->blocks)
+    {
+        int n = 0;
+        while (n < per_chunk && seq < job->blocks)
+            make_block(buf + BLOCK_SIZE * n++, seq++);
+
+        if (libusbserial_write_data(buf, n * BLOCK_SIZE) != n * BLOCK_SIZE)
+        {
+            job->error = 1;
+            break;
+        }
+    }
+    job->end = now_us();
+}
+
+#ifdef LIBUSBSERIAL_HOST
+static void *_thread_entry(void *arg)
+{
+    stream_writer(arg);
+    return NULL;
+}
+#else
+static int _thread_entry(SceSize args, void *argp)
+{
+    stream_writer(*(streamJob **)argp);
+    return sceKernelExitThread(0);
+}
+#endif
+
+static void run_stream(int baud, int latency, uint32_t bytes)
+{
+    static unsigned char rx[8192];
+    static unsigned char acc[8192 + BLOCK_SIZE];
+    streamJob job;
+    benchThread th;
+    struct libusbserial_stats stats;
+    struct libusbserial_line_status ls;
+    int fill            = 0;
+    int in_sync         = 1;
+    uint32_t expect     = 0;
+    uint32_t good       = 0;
+    uint32_t seq_errors = 0;
+    uint32_t crc_errors = 0;
+    uint64_t received   = 0;
+    int64_t first = 0, last = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.blocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    job.chunk  = MAX_MESSAGE;
+
+    libusbserial_tcioflush();
+    libusbserial_reset_stats();
+    libusbserial_get_line_status(&ls);
+    uint32_t overruns = ls.overrun;
+
+    if (thread_start(&th, &job) < 0)
+    {
+        emit("{\"test\":\"stream\",\"baud\":%d,\"error\":\"thread\"}", baud);
+        return;
+    }
+
+    for (;;)
+    {
+        int n = bench_read(rx, sizeof(rx), READ_TIMEOUT);
+        if (n <= 0)
+            break;
+
+        if (!first)
+            first = now_us();
+        last = now_us();
+        received += n;
+
+        // rx is at most as big as acc minus one partial block
+        memcpy(acc + fill, rx, n);
+        fill += n;
+
+        int pos = 0;
+        while (fill - pos >= BLOCK_SIZE)
+        {
+            unsigned char *b = acc + pos;
+            uint32_t seq;
+            if (check_block(b, &seq) < 0)
+            {
+                // count a bad stretch once, then hunt for the next good block
+                if (in_sync)
+                    crc_errors++;
+                in_sync = 0;
+                pos++;
+                continue;
+            }
+            in_sync = 1;
+            if (seq != expect)
+                seq_errors++;
+            expect = seq + 1;
+            good++;
+            pos += BLOCK_SIZE;
+        }
+        memmove(acc, acc + pos, fill - pos);
+        fill -= pos;
+
+        if (good == job.blocks)
+            break;
+    }
+
+    thread_join(&th);
+
+    libusbserial_get_stats(&stats);
+    libusbserial_get_line_status(&ls);
+
+    uint64_t sent   = (uint64_t)job.blocks * BLOCK_SIZE;
+    int64_t tx_time = job.end - job.start;
+    int64_t rx_time = last - first;
+    int64_t total   = (last > job.end ? last : job.end) - job.start;
+
+    emit("{\"test\":\"stream\",\"baud\":%d,\"latency_timer\":%d,\"bytes\":%llu,\"received\":%llu,"
+         "\"tx_MBps\":%.4f,\"rx_MBps\":%.4f,\"duplex_MBps\":%.4f,\"line_MBps\":%.4f,"
+         "\"blocks\":%u,\"good\":%u,\"seq_errors\":%u,\"crc_errors\":%u,\"lost_blocks\":%u,"
+         "\"write_error\":%d,\"rx_transfers\":%u,\"ring_drops\":%u,\"overruns\":%u}",
+         baud, latency, (unsigned long long)sent, (unsigned long long)received,
+         tx_time > 0 ? sent / (double)tx_time : 0.0, rx_time > 0 ? received / (double)rx_time : 0.0,
+         total > 0 ? (sent + received) / (double)total : 0.0, baud / 10.0 / 1e6, job.blocks, good, seq_errors,
+         crc_errors, job.blocks - good, job.error, stats.rx_transfers, stats.ring_drops, ls.overrun - overruns);
+
+    if (seq_errors || crc_errors || good != job.blocks || job.error || stats.ring_drops || ls.overrun != overruns)
+        failures++;
+}
+
+/*
+ *  Ping-pong
+ */
+
+/*
+ *  CRC engine: libusbserial_crc() against the byte at a time reference
+ */
+
+static void run_crc(void)
+{
+    static const char *names[] = {"", "crc16_modbus", "crc16_ccitt", "crc16_xmodem", "crc32"};
+    static const int crc_sizes[] = {16, 64, 1024, 65536, 0};
+    static unsigned char buf[65536 + 256];
+    uint32_t x = 1;
+
+    for (unsigned int i = 0; i < sizeof(buf); i++)
+    {
+        x      = x * 1103515245 + 12345;
+        buf[i] = x >> 16;
+    }
+
+    for (int type = CRC16_MODBUS; type <= CRC32_IEEE; type++)
+    {
+        for (int s = 0; crc_sizes[s]; s++)
+        {
+            int size  = crc_sizes[s];
+            int iters = 8 * 1024 * 1024 / size;
+            uint32_t ref = 0, got = 0;
+            int64_t t0, t_ref, t_drv;
+
+            t0 = now_us();
+            for (int i = 0; i < iters; i++)
+                ref ^= crc_ref(type, buf + (i & 0xFF), size);
+            t_ref = now_us() - t0;
+
+            t0 = now_us();
+            for (int i = 0; i < iters; i++)
+            {
+                uint32_t c;
+                libusbserial_crc(type, buf + (i & 0xFF), size, &c);
+                got ^= c;
+            }
+            t_drv = now_us() - t0;
+
+            emit("{\"test\":\"crc\",\"type\":\"%s\",\"size\":%d,\"ref_mbps\":%.1f,\"mbps\":%.1f,\"match\":%s}",
+                 names[type], size, t_ref ? (double)iters * size / t_ref : 0.0,
+                 t_drv ? (double)iters * size / t_drv : 0.0, ref == got ? "true" : "false");
+        }
+    }
+}
+
+/*
+ *  Sync FIFO
+ */
+
+static void run_fifo(uint32_t bytes)
+{
+    static unsigned char rx[65536];
+    struct libusbserial_stats stats;
+    uint64_t received = 0;
+    uint32_t gaps     = 0;
+    int have_last     = 0;
+    unsigned char last = 0;
+    int64_t first = 0, end = 0;
+
+    if (libusbserial_ftdi_stream_start(0, 0) < 0)
+    {
+        emit("{\"test\":\"fifo\",\"error\":\"unsupported\"}");
+        return;
+    }
+    libusbserial_reset_stats();
+
+    while (received < bytes)
+    {
+        int n = bench_read(rx, sizeof(rx), READ_TIMEOUT);
+        if (n <= 0)
+            break;
+
+        if (!first)
+            first = now_us();
+        end = now_us();
+
+        for (int i = 0; i < n; i++)
+        {
+            if (have_last && rx[i] != (unsigned char)(last + 1))
+                gaps++;
+            last      = rx[i];
+            have_last = 1;
+        }
+        received += n;
+    }
+
+    libusbserial_get_stats(&stats);
+    int stopped = libusbserial_ftdi_stream_stop();
+
+    emit("{\"test\":\"fifo\",\"bytes\":%u,\"received\":%llu,\"MBps\":%.4f,\"gaps\":%u,"
+         "\"rx_transfers\":%u,\"ring_drops\":%u,\"ring_high_water\":%u,\"stop_error\":%d}",
+         bytes, (unsigned long long)received, end > first ? received / (double)(end - first) : 0.0, gaps,
+         stats.rx_transfers, stats.ring_drops, stats.ring_high_water, stopped < 0);
+}
+
+/*
+ *  MPSSE SPI
+ */
+
+static void run_mpsse(int size, int iterations)
+{
+    static unsigned char tx[SPI_BATCH][MAX_MESSAGE];
+    static unsigned char rx[SPI_BATCH][MAX_MESSAGE];
+    struct libusbserial_spi_transfer xfers[SPI_BATCH];
+    int errors    = 0;
+    int failed    = 0;
+    int64_t t0, t;
+
+    for (int k = 0; k < SPI_BATCH; k++)
+    {
+        for (int i = 0; i < size; i++)
+            tx[k][i] = (k * 31 + i * 7) ^ (i >> 8);
+        xfers[k].tx  = tx[k];
+        xfers[k].rx  = rx[k];
+        xfers[k].len = size;
+    }
+
+    t0 = now_us();
+    for (int i = 0; i < iterations; i++)
+    {
+        memset(rx, 0, sizeof(rx[0]) * SPI_BATCH);
+        if (libusbserial_ftdi_mpsse_spi_batch(xfers, SPI_BATCH, READ_TIMEOUT) < 0)
+        {
+            failed++;
+            continue;
+        }
+        for (int k = 0; k < SPI_BATCH; k++)
+            if (memcmp(tx[k], rx[k], size) != 0)
+                errors++;
+    }
+    t = now_us() - t0;
+
+    emit("{\"test\":\"mpsse\",\"size\":%d,\"batch\":%d,\"batches\":%d,\"transactions_per_s\":%.1f,"
+         "\"MBps\":%.4f,\"failed\":%d,\"errors\":%d}",
+         size, SPI_BATCH, iterations, t > 0 ? (double)iterations * SPI_BATCH * 1000000 / t : 0.0,
+         t > 0 ? (double)iterations * SPI_BATCH * size / t : 0.0, failed, errors);
+
+    if (failed || errors)
+        failures++;
+}
+
+static void run_mpsse_sizes(const int *sizes, int iterations)
+{
+    if (libusbserial_ftdi_mpsse_spi_init(SPI_CLOCK) < 0)
+    {
+        emit("{\"test\":\"mpsse\",\"error\":\"unsupported\"}");
+        return;
+    }
+
+    for (int s = 0; sizes[s]; s++)
+        run_mpsse(sizes[s] > MAX_MESSAGE ? MAX_MESSAGE : sizes[s], iterations ? iterations : 20);
+
+    // back to the UART for the baud rate runs
+    libusbserial_ftdi_set_bitmode(0, BITMODE_RESET);
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_pingpong(int baud, int latency, int size, int iterations)
+{
+    static unsigned char tx[MAX_MESSAGE];
+    static unsigned char rx[MAX_MESSAGE];
+    static int64_t rtt[MAX_ITERATIONS];
+    int errors   = 0;
+    int timeouts = 0;
+    int done     = 0;
+    int64_t sum  = 0;
+
+    libusbserial_tcioflush();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int k = 0; k < size; k++)
+        {
+            tx[k] = (i * 31 + k * 7) ^ (k >> 8);
+            if (text_blocks)
+                tx[k] = 'a' + tx[k] % 26;
+        }
+
+        int64_t t0 = now_us();
+        if (libusbserial_write_data(tx, size) != size)
+        {
+            errors++;
+            continue;
+        }
+
+        int got = 0;
+        while (got < size)
+        {
+            int n = bench_read(rx + got, size - got, READ_TIMEOUT);
+            if (n <= 0)
+                break;
+            got += n;
+        }
+        int64_t t1 = now_us();
+
+        if (got < size)
+        {
+            // resync: anything late belongs to this message
+            if (++timeouts == MAX_TIMEOUTS && !done)
+                break;
+            delay_us(READ_TIMEOUT / 10);
+            libusbserial_tciflush();
+            continue;
+        }
+        if (memcmp(tx, rx, size) != 0)
+            errors++;
+
+        rtt[done++] = t1 - t0;
+        sum += t1 - t0;
+    }
+
+    if (!done)
+    {
+        emit("{\"test\":\"pingpong\",\"baud\":%d,\"latency_timer\":%d,\"size\":%d,\"iterations\":%d,"
+             "\"completed\":0,\"errors\":%d,\"timeouts\":%d}",
+             baud, latency, size, iterations, errors, timeouts);
+        return;
+    }
+
+    qsort(rtt, done, sizeof(rtt[0]), cmp_int64);
+    emit("{\"test\":\"pingpong\",\"baud\":%d,\"latency_timer\":%d,\"size\":%d,\"iterations\":%d,"
+         "\"completed\":%d,\"min_us\":%lld,\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld,"
+         "\"mean_us\":%lld,\"wire_us\":%lld,\"errors\":%d,\"timeouts\":%d}",
+         baud, latency, size, iterations, done, (long long)rtt[0], (long long)rtt[done / 2],
+         (long long)rtt[done * 9 / 10], (long long)rtt[done * 99 / 100], (long long)rtt[done - 1],
+         (long long)(sum / done), (long long)size * 10 * 1000000 / baud, errors, timeouts);
+}
+
+/*
+ *  Main
+ */
+
+static int parse_list(const char *s, int *list, int max)
+{
+    int n = 0;
+    while (*s && n < max - 1)
+    {
+        list[n++] = strtol(s, (char **)&s, 10);
+        if (*s == ',')
+            s++;
+    }
+    list[n] = 0;
+    return n;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: usbserial_bench [-c ft232r|ft232h|ch340] [-b baud,...] [-s size,...]\n"
+                    "                       [-l latency_timer] [-f none|rtscts|xonxoff] [-n stream_bytes]\n"
+                    "                       [-i iterations] [-t stream|pingpong|crc|fifo|mpsse|all] [-o file] [-e]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int bauds[16];
+    int sizes[16];
+    int latency       = 0;
+    int flow          = FLOW_NONE;
+    uint32_t stream_n = 0;
+    int iterations    = 0;
+    int tests         = 31;
+    int strict        = 0;
+    const char *path  = NULL;
+
+    memcpy(bauds, default_bauds, sizeof(default_bauds));
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+    crc32_init();
+    crc16_init();
+
+#ifdef LIBUSBSERIAL_HOST
+    usbsimConfig sim;
+    const char *chip = "ft232r";
+    int opt;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.loopback = 1;
+
+    while ((opt = getopt(argc, argv, "c:b:s:l:f:n:i:t:o:eh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': chip = optarg; break;
+            case 'b': parse_list(optarg, bauds, 16); break;
+            case 's': parse_list(optarg, sizes, 16); break;
+            case 'l': latency = atoi(optarg); break;
+            case 'f':
+                flow = strcmp(optarg, "rtscts") == 0    ? FLOW_RTS_CTS
+                       : strcmp(optarg, "xonxoff") == 0 ? FLOW_XON_XOFF
+                                                        : FLOW_NONE;
+                break;
+            case 'n': stream_n = strtoul(optarg, NULL, 0); break;
+            case 'i': iterations = atoi(optarg); break;
+            case 't':
+                tests = strcmp(optarg, "stream") == 0     ? 1
+                        : strcmp(optarg, "pingpong") == 0 ? 2
+                        : strcmp(optarg, "crc") == 0      ? 4
+                        : strcmp(optarg, "fifo") == 0     ? 8
+                        : strcmp(optarg, "mpsse") == 0    ? 16
+                                                          : 31;
+                break;
+            case 'o': path = optarg; break;
+            case 'e': strict = 1; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (strcmp(chip, "ft232h") == 0)
+        sim.type = USBSIM_FT232H;
+    else if (strcmp(chip, "ch340") == 0)
+        sim.type = USBSIM_CH340;
+    else
+        sim.type = USBSIM_FT232R;
+
+    module_start(0, NULL);
+#else
+    (void)argc;
+    (void)argv;
+    (void)usage;
+    (void)parse_list;
+    path = "ux0:data/libusbserial_bench.jsonl";
+#endif
+
+    out = path ? fopen(path, "w") : stdout;
+    if (!out)
+        out = stdout;
+
+    if (libusbserial_start() < 0)
+    {
+        emit("{\"error\":\"start\"}");
+        return 1;
+    }
+
+#ifdef LIBUSBSERIAL_HOST
+    usbsim_plug(&sim);
+    usbsim_wait_attached(1000000);
+#endif
+
+    while (!libusbserial_device_connected())
+        delay_us(1000);
+
+    libusbserial_set_line_property(BITS_8, STOP_BIT_1, PARITY_NONE, BREAK_OFF);
+    // with RTS/CTS the peer (or the jumper) only lets us send while RTS is up
+    libusbserial_setdtr_rts(1, 1);
+    if (libusbserial_setflowctrl(flow) < 0)
+        flow = FLOW_NONE;
+    text_blocks = flow == FLOW_XON_XOFF;
+    if (latency > 0 && libusbserial_ftdi_set_latency_timer(latency) < 0)
+        latency = 0;
+
+#ifdef LIBUSBSERIAL_HOST
+    emit("{\"test\":\"config\",\"host_sim\":\"%s\",\"flow\":%d,\"latency_timer\":%d}", chip, flow, latency);
+#else
+    emit("{\"test\":\"config\",\"flow\":%d,\"latency_timer\":%d}", flow, latency);
+#endif
+
+    if (tests & 4)
+        run_crc();
+
+    if (tests & 8)
+        run_fifo(stream_n ? stream_n : FIFO_DEFAULT_BYTES);
+
+    if (tests & 16)
+        run_mpsse_sizes(sizes, iterations);
+
+    for (int b = 0; bauds[b] && (tests & 3); b++)
+    {
+        int baud = bauds[b];
+        if (libusbserial_set_baudrate(baud) < 0)
+        {
+            emit("{\"test\":\"baud\",\"baud\":%d,\"error\":\"unsupported\"}", baud);
+            continue;
+        }
+
+        // about two seconds of line time per stream run
+        if (tests & 1)
+        {
+            uint32_t n = stream_n;
+            if (!n)
+            {
+                n = baud / 10 * 2;
+                if (n < 16384)
+                    n = 16384;
+                if (n > 8 * 1024 * 1024)
+                    n = 8 * 1024 * 1024;
+            }
+            run_stream(baud, latency, n);
+        }
+
+        if (tests & 2)
+        {
+            for (int s = 0; sizes[s]; s++)
+            {
+                int size = sizes[s] > MAX_MESSAGE ? MAX_MESSAGE : sizes[s];
+                int iter = iterations;
+                if (!iter)
+                {
+                    // at most about two seconds of line time per size
+                    iter = (int)(2LL * baud / 10 / (2 * size + 1));
+                    if (iter > 100)
+                        iter = 100;
+                    if (iter < 5)
+                        iter = 5;
+                }
+                if (iter > MAX_ITERATIONS)
+                    iter = MAX_ITERATIONS;
+                run_pingpong(baud, latency, size, iter);
+            }
+        }
+    }
+
+#ifdef LIBUSBSERIAL_HOST
+    usbsim_unplug();
+#endif
+    libusbserial_stop();
+
+    if (out != stdout)
+        fclose(out);
+    return strict && failures ? 1 : 0;
+}
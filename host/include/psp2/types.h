@@ -0,0 +1,21 @@
+#ifndef _HOST_PSP2_TYPES_H_
+#define _HOST_PSP2_TYPES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int8_t SceInt8;
+typedef uint8_t SceUInt8;
+typedef int16_t SceInt16;
+typedef uint16_t SceUInt16;
+typedef int32_t SceInt32;
+typedef uint32_t SceUInt32;
+typedef int64_t SceInt64;
+typedef uint64_t SceUInt64;
+typedef int SceInt;
+typedef unsigned int SceUInt;
+typedef unsigned int SceSize;
+typedef int SceUID;
+typedef int SceBool;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HOST_PSP2KERN_KERNEL_CPU_H_
+#define _HOST_PSP2KERN_KERNEL_CPU_H_
+
+#include <psp2kern/types.h>
+
+#define ENTER_SYSCALL(state) do { (state) = 0; } while (0)
+#define EXIT_SYSCALL(state) do { (void)(state); } while (0)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _HOST_PSP2KERN_KERNEL_DEBUG_H_
+#define _HOST_PSP2KERN_KERNEL_DEBUG_H_
+
+int ksceDebugPrintf(const char *fmt, ...);
+
+#endif
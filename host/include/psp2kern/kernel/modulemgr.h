@@ -0,0 +1,10 @@
+#ifndef _HOST_PSP2KERN_KERNEL_MODULEMGR_H_
+#define _HOST_PSP2KERN_KERNEL_MODULEMGR_H_
+
+#include <psp2kern/types.h>
+
+#define SCE_KERNEL_START_SUCCESS 0
+#define SCE_KERNEL_START_FAILED 2
+#define SCE_KERNEL_STOP_SUCCESS 0
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _HOST_PSP2KERN_KERNEL_SUSPEND_H_
+#define _HOST_PSP2KERN_KERNEL_SUSPEND_H_
+
+typedef int (*SceSysEventHandler)(int resume, int eventid, void *args, void *opt);
+
+int ksceKernelRegisterSysEventHandler(const char *name, SceSysEventHandler handler, void *args);
+
+#endif
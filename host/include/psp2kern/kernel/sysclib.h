@@ -0,0 +1,6 @@
+#ifndef _HOST_PSP2KERN_KERNEL_SYSCLIB_H_
+#define _HOST_PSP2KERN_KERNEL_SYSCLIB_H_
+
+#include <string.h>
+
+#endif
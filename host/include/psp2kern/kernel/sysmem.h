@@ -0,0 +1,13 @@
+#ifndef _HOST_PSP2KERN_KERNEL_SYSMEM_H_
+#define _HOST_PSP2KERN_KERNEL_SYSMEM_H_
+
+#include <psp2kern/types.h>
+
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt);
+int ksceKernelFreeMemBlock(SceUID uid);
+int ksceKernelGetMemBlockBase(SceUID uid, void **base);
+SceUID ksceKernelUserMap(const char *name, int permission, const void *user_buf, SceSize size, void **kernel_page,
+                         SceSize *kernel_size, SceUInt32 *kernel_offset);
+int ksceKernelMemBlockRelease(SceUID uid);
+
+#endif
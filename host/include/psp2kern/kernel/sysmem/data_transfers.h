@@ -0,0 +1,9 @@
+#ifndef _HOST_PSP2KERN_KERNEL_SYSMEM_DATA_TRANSFERS_H_
+#define _HOST_PSP2KERN_KERNEL_SYSMEM_DATA_TRANSFERS_H_
+
+#include <psp2kern/types.h>
+
+int ksceKernelMemcpyUserToKernel(void *dst, const void *src, SceSize len);
+int ksceKernelMemcpyKernelToUser(void *dst, const void *src, SceSize len);
+
+#endif
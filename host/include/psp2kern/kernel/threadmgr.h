@@ -0,0 +1,27 @@
+#ifndef _HOST_PSP2KERN_KERNEL_THREADMGR_H_
+#define _HOST_PSP2KERN_KERNEL_THREADMGR_H_
+
+#include <psp2kern/types.h>
+#include <psp2kern/kernel/threadmgr/event_flags.h>
+
+typedef int (*SceKernelThreadEntry)(SceSize args, void *argp);
+
+#define SCE_KERNEL_CPU_MASK_USER_0 0x00010000
+#define SCE_KERNEL_CPU_MASK_USER_1 0x00020000
+#define SCE_KERNEL_CPU_MASK_USER_2 0x00040000
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int initPriority, SceSize stackSize,
+                              SceUInt attr, int cpuAffinityMask, const void *option);
+int ksceKernelStartThread(SceUID thid, SceSize arglen, void *argp);
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout);
+int ksceKernelDeleteThread(SceUID thid);
+int ksceKernelDelayThread(SceUInt delay);
+SceInt64 ksceKernelGetSystemTimeWide(void);
+SceUInt32 ksceKernelGetSystemTimeLow(void);
+
+SceUID ksceKernelCreateMutex(const char *name, SceUInt attr, int initCount, void *option);
+int ksceKernelDeleteMutex(SceUID mutexid);
+int ksceKernelLockMutex(SceUID mutexid, int lockCount, unsigned int *timeout);
+int ksceKernelUnlockMutex(SceUID mutexid, int unlockCount);
+
+#endif
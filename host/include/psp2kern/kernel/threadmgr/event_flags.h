@@ -0,0 +1,19 @@
+#ifndef _HOST_PSP2KERN_KERNEL_THREADMGR_EVENT_FLAGS_H_
+#define _HOST_PSP2KERN_KERNEL_THREADMGR_EVENT_FLAGS_H_
+
+#include <psp2kern/types.h>
+
+#define SCE_EVENT_WAITAND 0x00000000
+#define SCE_EVENT_WAITOR 0x00000001
+#define SCE_EVENT_WAITCLEAR 0x00000002
+#define SCE_EVENT_WAITCLEAR_PAT 0x00000004
+#define SCE_EVENT_WAITMULTIPLE 0x00001000
+
+SceUID ksceKernelCreateEventFlag(const char *name, int attr, int bits, void *opt);
+int ksceKernelDeleteEventFlag(SceUID evfid);
+int ksceKernelSetEventFlag(SceUID evfid, unsigned int bits);
+int ksceKernelClearEventFlag(SceUID evfid, unsigned int bits);
+int ksceKernelWaitEventFlag(SceUID evfid, unsigned int bits, unsigned int wait, unsigned int *outBits,
+                            SceUInt *timeout);
+
+#endif
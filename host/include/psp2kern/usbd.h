@@ -0,0 +1,102 @@
+#ifndef _HOST_PSP2KERN_USBD_H_
+#define _HOST_PSP2KERN_USBD_H_
+
+#include <psp2kern/types.h>
+
+#define SCE_USBD_DESCRIPTOR_DEVICE 0x01
+#define SCE_USBD_DESCRIPTOR_CONFIGURATION 0x02
+#define SCE_USBD_DESCRIPTOR_INTERFACE 0x04
+#define SCE_USBD_DESCRIPTOR_ENDPOINT 0x05
+
+#define SCE_USBD_ENDPOINT_DIRECTION_BITS 0x80
+#define SCE_USBD_ENDPOINT_DIRECTION_OUT 0x00
+#define SCE_USBD_ENDPOINT_DIRECTION_IN 0x80
+
+#define SCE_USBD_REQTYPE_DIR_TO_DEVICE 0x00
+#define SCE_USBD_REQTYPE_DIR_TO_HOST 0x80
+#define SCE_USBD_REQTYPE_TYPE_STANDARD 0x00
+#define SCE_USBD_REQTYPE_TYPE_CLASS 0x20
+#define SCE_USBD_REQTYPE_TYPE_VENDOR 0x40
+#define SCE_USBD_REQTYPE_RECIP_DEVICE 0x00
+#define SCE_USBD_REQTYPE_RECIP_INTERFACE 0x01
+#define SCE_USBD_REQTYPE_RECIP_ENDPOINT 0x02
+
+#define SCE_USBD_PROBE_SUCCEEDED 0
+#define SCE_USBD_PROBE_FAILED -1
+#define SCE_USBD_ATTACH_SUCCEEDED 0
+#define SCE_USBD_ATTACH_FAILED -1
+
+typedef struct SceUsbdDeviceDescriptor
+{
+  unsigned char bLength;
+  unsigned char bDescriptorType;
+  unsigned short bcdUSB;
+  unsigned char bDeviceClass;
+  unsigned char bDeviceSubClass;
+  unsigned char bDeviceProtocol;
+  unsigned char bMaxPacketSize0;
+  unsigned short idVendor;
+  unsigned short idProduct;
+  unsigned short bcdDevice;
+  unsigned char iManufacturer;
+  unsigned char iProduct;
+  unsigned char iSerialNumber;
+  unsigned char bNumConfigurations;
+} SceUsbdDeviceDescriptor;
+
+typedef struct SceUsbdConfigurationDescriptor
+{
+  unsigned char bLength;
+  unsigned char bDescriptorType;
+  unsigned short wTotalLength;
+  unsigned char bNumInterfaces;
+  unsigned char bConfigurationValue;
+  unsigned char iConfiguration;
+  unsigned char bmAttributes;
+  unsigned char MaxPower;
+} SceUsbdConfigurationDescriptor;
+
+typedef struct SceUsbdEndpointDescriptor
+{
+  unsigned char bLength;
+  unsigned char bDescriptorType;
+  unsigned char bEndpointAddress;
+  unsigned char bmAttributes;
+  unsigned short wMaxPacketSize;
+  unsigned char bInterval;
+} SceUsbdEndpointDescriptor;
+
+typedef struct SceUsbdDeviceRequest
+{
+  unsigned char bmRequestType;
+  unsigned char bRequest;
+  unsigned short wValue;
+  unsigned short wIndex;
+  unsigned short wLength;
+} SceUsbdDeviceRequest;
+
+typedef struct SceUsbdDriver
+{
+  const char *name;
+  int (*probe)(int device_id);
+  int (*attach)(int device_id);
+  int (*detach)(int device_id);
+  struct SceUsbdDriver *next;
+} SceUsbdDriver;
+
+typedef void (*ksceUsbdDoneCallback)(int32_t result, int32_t count, void *arg);
+
+int ksceUsbdRegisterDriver(const SceUsbdDriver *driver);
+int ksceUsbdUnregisterDriver(const SceUsbdDriver *driver);
+void *ksceUsbdScanStaticDescriptor(SceUID device_id, void *start, SceUInt8 type);
+SceUID ksceUsbdOpenPipe(int device_id, SceUsbdEndpointDescriptor *endpoint);
+int ksceUsbdClosePipe(SceUID pipe_id);
+int ksceUsbdSetConfiguration(SceUID pipe_id, SceInt8 config_num, ksceUsbdDoneCallback cb, void *user_data);
+int ksceUsbdControlTransfer(SceUID pipe_id, const SceUsbdDeviceRequest *req, unsigned char *buffer,
+                            ksceUsbdDoneCallback cb, void *user_data);
+int ksceUsbdBulkTransfer(SceUID pipe_id, unsigned char *buffer, unsigned int length, ksceUsbdDoneCallback cb,
+                         void *user_data);
+int ksceUsbdInterruptTransfer(SceUID pipe_id, unsigned char *buffer, unsigned int length, ksceUsbdDoneCallback cb,
+                              void *user_data);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _HOST_PSP2KERN_USBSERV_H_
+#define _HOST_PSP2KERN_USBSERV_H_
+
+int ksceUsbServMacSelect(int mac, int mode);
+
+#endif
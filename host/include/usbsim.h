@@ -0,0 +1,105 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __USBSIM_H__
+#define __USBSIM_H__
+
+#include <psp2kern/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host-side simulation of one USB-serial adapter behind the usbd shim.
+ *
+ * The virtual device decodes the driver's vendor requests (baud divisor, line
+ * settings, modem control, flow control, latency timer, bitmode) and moves
+ * bytes over its UART at the programmed character time. The far end of the
+ * line is either a loopback plug (TX->RX, RTS->CTS, DTR->DSR/DCD) or a peer
+ * scripted with usbsim_inject() and observed with usbsim_capture().
+ *
+ * Transfer results are host-simulation codes, not the values real usbd uses.
+ */
+
+#define USBSIM_ERROR_NO_DEVICE 0x80240001
+#define USBSIM_ERROR_INVALID_PIPE 0x80240002
+#define USBSIM_ERROR_BUSY 0x80240003
+#define USBSIM_RESULT_STALL 0x80240004
+#define USBSIM_RESULT_CANCELED 0x80240005
+
+typedef enum
+{
+  USBSIM_FT232R = 0, // full speed, 64 byte packets
+  USBSIM_FT232H,     // high speed, 512 byte packets, MPSSE, sync FIFO
+  USBSIM_CH340,      // full speed, 32 byte packets, status interrupt endpoint
+} usbsimDeviceType;
+
+typedef struct usbsimConfig
+{
+  usbsimDeviceType type;
+  int loopback;             // TX wired to RX, RTS to CTS, DTR to DSR/DCD
+  unsigned int rx_fifo;     // chip receive buffer in bytes, 0 for the chip default
+  unsigned int tx_fifo;     // chip transmit buffer in bytes, 0 for the chip default
+  unsigned int peer_baud;   // rate the peer transmits at, 0 follows the device
+  unsigned int frame_us;    // bus scheduling granularity, 0 for 1000 (FS) / 125 (HS)
+  unsigned int fifo_rate;   // sync FIFO source rate in bytes/s, 0 for 40 MB/s
+} usbsimConfig;
+
+typedef struct usbsimStatus
+{
+  unsigned int baudrate;    // rate decoded from the last divisor write
+  unsigned int char_bits;   // start + data + parity + stop bits, in half bits
+  unsigned int latency_ms;  // FTDI latency timer
+  unsigned int bitmode;     // FTDI bitmode (mode << 8 | mask)
+  unsigned int flowctrl;    // FLOW_* of the last flow control write
+  unsigned int dtr;
+  unsigned int rts;
+  unsigned int break_on;
+  unsigned int rx_level;    // bytes in the chip receive buffer
+  unsigned int tx_level;    // bytes in the chip transmit buffer
+  unsigned int overruns;    // bytes lost to a full receive buffer
+  unsigned int control_requests;
+} usbsimStatus;
+
+// Plug a device and run the registered driver's probe/attach. Returns the
+// attach result, or 0 when no driver is registered yet.
+int usbsim_plug(const usbsimConfig *cfg);
+// Run detach and fail every queued transfer.
+void usbsim_unplug(void);
+// Wait until a driver is attached to the plugged device.
+int usbsim_wait_attached(unsigned int timeout_us);
+
+// Queue bytes for the peer to send after an idle gap of delay_us. Returns
+// len, or <0 when nothing is plugged.
+int usbsim_inject(const void *data, unsigned int len, unsigned int delay_us);
+// Bytes still queued on the peer side.
+unsigned int usbsim_inject_pending(void);
+// Take up to len bytes the device has put on its TX line.
+int usbsim_capture(void *data, unsigned int len);
+// Drive the peer's modem lines (MODEM_* bits), ignored in loopback.
+void usbsim_set_modem_status(int msr);
+void usbsim_set_peer_baud(unsigned int baud);
+
+void usbsim_get_status(usbsimStatus *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __USBSIM_H__
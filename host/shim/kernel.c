@@ -0,0 +1,594 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Host emulation of the SceSysmem/SceThreadmgr/SceDebug kernel services the
+ * driver uses. Kernel objects live in a single table indexed by UID; event
+ * flags and mutexes are built on pthread mutex/condvar pairs.
+ */
+
+#define _GNU_SOURCE
+
+#include <psp2kern/kernel/debug.h>
+#include <psp2kern/kernel/suspend.h>
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/usbserv.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_ERROR_ILLEGAL_UID 0x80020001
+#define HOST_ERROR_NO_MEMORY 0x80020002
+#define HOST_ERROR_WAIT_TIMEOUT 0x80028005
+#define HOST_ERROR_WAIT_DELETE 0x80028007
+
+#define HOST_MAX_OBJECTS 256
+#define HOST_UID_BASE 0x10001
+
+enum hostObjectType
+{
+  OBJ_FREE = 0,
+  OBJ_THREAD,
+  OBJ_EVENTFLAG,
+  OBJ_MUTEX,
+  OBJ_MEMBLOCK,
+};
+
+typedef struct hostThread
+{
+  pthread_t handle;
+  SceKernelThreadEntry entry;
+  SceSize arglen;
+  void *argp;
+  int started;
+  int status;
+} hostThread;
+
+typedef struct hostEvfWaiter
+{
+  struct hostEvfWaiter *next;
+  unsigned int bits;
+  unsigned int wait;
+  unsigned int out_bits;
+  int released;
+} hostEvfWaiter;
+
+typedef struct hostEventFlag
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned int bits;
+  int deleted;
+  int waiters;
+  hostEvfWaiter *queue;
+} hostEventFlag;
+
+typedef struct hostMemBlock
+{
+  void *base;
+  SceSize size;
+} hostMemBlock;
+
+typedef struct hostObject
+{
+  enum hostObjectType type;
+  union
+  {
+    hostThread thread;
+    hostEventFlag evf;
+    pthread_mutex_t mutex;
+    hostMemBlock mem;
+  } u;
+} hostObject;
+
+static hostObject objects[HOST_MAX_OBJECTS];
+static pthread_mutex_t objects_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static SceUID _obj_alloc(enum hostObjectType type)
+{
+  SceUID uid = HOST_ERROR_NO_MEMORY;
+  pthread_mutex_lock(&objects_lock);
+  for (int i = 0; i < HOST_MAX_OBJECTS; i++)
+  {
+    if (objects[i].type == OBJ_FREE)
+    {
+      memset(&objects[i], 0, sizeof(objects[i]));
+      objects[i].type = type;
+      uid             = HOST_UID_BASE + i;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&objects_lock);
+  return uid;
+}
+
+static hostObject *_obj_get(SceUID uid, enum hostObjectType type)
+{
+  int i = uid - HOST_UID_BASE;
+  if (i < 0 || i >= HOST_MAX_OBJECTS || objects[i].type != type)
+    return NULL;
+  return &objects[i];
+}
+
+static void _obj_free(hostObject *obj)
+{
+  pthread_mutex_lock(&objects_lock);
+  obj->type = OBJ_FREE;
+  pthread_mutex_unlock(&objects_lock);
+}
+
+/* Absolute CLOCK_MONOTONIC deadline timeout_us from now */
+static void _deadline(struct timespec *ts, SceUInt timeout_us)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += timeout_us / 1000000;
+  ts->tv_nsec += (long)(timeout_us % 1000000) * 1000;
+  if (ts->tv_nsec >= 1000000000)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+static void _cond_init(pthread_cond_t *cond)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/* Time */
+
+SceInt64 ksceKernelGetSystemTimeWide(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (SceInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SceUInt32 ksceKernelGetSystemTimeLow(void)
+{
+  return (SceUInt32)ksceKernelGetSystemTimeWide();
+}
+
+/* Threads */
+
+static void *_thread_main(void *arg)
+{
+  hostThread *th = arg;
+  th->status     = th->entry(th->arglen, th->argp);
+  return NULL;
+}
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int initPriority, SceSize stackSize,
+                              SceUInt attr, int cpuAffinityMask, const void *option)
+{
+  SceUID uid = _obj_alloc(OBJ_THREAD);
+  if (uid < 0)
+    return uid;
+  _obj_get(uid, OBJ_THREAD)->u.thread.entry = entry;
+  return uid;
+}
+
+int ksceKernelStartThread(SceUID thid, SceSize arglen, void *argp)
+{
+  hostObject *obj = _obj_get(thid, OBJ_THREAD);
+  if (!obj || obj->u.thread.started)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  // the kernel copies the argument block onto the new thread's stack
+  hostThread *th = &obj->u.thread;
+  th->arglen     = arglen;
+  th->argp       = NULL;
+  if (argp && arglen)
+  {
+    th->argp = malloc(arglen);
+    memcpy(th->argp, argp, arglen);
+  }
+
+  if (pthread_create(&th->handle, NULL, _thread_main, th) != 0)
+  {
+    free(th->argp);
+    return HOST_ERROR_NO_MEMORY;
+  }
+  th->started = 1;
+  return 0;
+}
+
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout)
+{
+  hostObject *obj = _obj_get(thid, OBJ_THREAD);
+  if (!obj || !obj->u.thread.started)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  if (timeout)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += *timeout / 1000000;
+    ts.tv_nsec += (long)(*timeout % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    if (pthread_timedjoin_np(obj->u.thread.handle, NULL, &ts) == ETIMEDOUT)
+      return HOST_ERROR_WAIT_TIMEOUT;
+  }
+  else
+    pthread_join(obj->u.thread.handle, NULL);
+
+  obj->u.thread.started = 0;
+  if (stat)
+    *stat = obj->u.thread.status;
+  return obj->u.thread.status;
+}
+
+int ksceKernelDeleteThread(SceUID thid)
+{
+  hostObject *obj = _obj_get(thid, OBJ_THREAD);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  if (obj->u.thread.started)
+    pthread_detach(obj->u.thread.handle);
+  free(obj->u.thread.argp);
+  _obj_free(obj);
+  return 0;
+}
+
+int ksceKernelDelayThread(SceUInt delay)
+{
+  struct timespec ts = {delay / 1000000, (long)(delay % 1000000) * 1000};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+  return 0;
+}
+
+/* Event flags */
+
+SceUID ksceKernelCreateEventFlag(const char *name, int attr, int bits, void *opt)
+{
+  SceUID uid = _obj_alloc(OBJ_EVENTFLAG);
+  if (uid < 0)
+    return uid;
+  hostEventFlag *evf = &_obj_get(uid, OBJ_EVENTFLAG)->u.evf;
+  pthread_mutex_init(&evf->lock, NULL);
+  _cond_init(&evf->cond);
+  evf->bits = bits;
+  return uid;
+}
+
+int ksceKernelDeleteEventFlag(SceUID evfid)
+{
+  hostObject *obj = _obj_get(evfid, OBJ_EVENTFLAG);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  hostEventFlag *evf = &obj->u.evf;
+  pthread_mutex_lock(&evf->lock);
+  evf->deleted = 1;
+  pthread_cond_broadcast(&evf->cond);
+  while (evf->waiters)
+  {
+    pthread_mutex_unlock(&evf->lock);
+    ksceKernelDelayThread(100);
+    pthread_mutex_lock(&evf->lock);
+  }
+  pthread_mutex_unlock(&evf->lock);
+
+  pthread_cond_destroy(&evf->cond);
+  pthread_mutex_destroy(&evf->lock);
+  _obj_free(obj);
+  return 0;
+}
+
+static int _evf_matched(unsigned int cur, unsigned int bits, unsigned int wait)
+{
+  if (wait & SCE_EVENT_WAITOR)
+    return (cur & bits) != 0;
+  return (cur & bits) == bits;
+}
+
+/* Consume a match the way the waiter asked for */
+static void _evf_take(hostEventFlag *evf, hostEvfWaiter *w)
+{
+  w->out_bits = evf->bits;
+  w->released = 1;
+  if (w->wait & SCE_EVENT_WAITCLEAR)
+    evf->bits = 0;
+  else if (w->wait & SCE_EVENT_WAITCLEAR_PAT)
+    evf->bits &= ~w->bits;
+}
+
+int ksceKernelSetEventFlag(SceUID evfid, unsigned int bits)
+{
+  hostObject *obj = _obj_get(evfid, OBJ_EVENTFLAG);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  // waiters are released here, not when they get to run, so a set
+  // immediately followed by a clear still wakes everyone who matched
+  hostEventFlag *evf = &obj->u.evf;
+  pthread_mutex_lock(&evf->lock);
+  evf->bits |= bits;
+  for (hostEvfWaiter **pw = &evf->queue; *pw;)
+  {
+    hostEvfWaiter *w = *pw;
+    if (_evf_matched(evf->bits, w->bits, w->wait))
+    {
+      _evf_take(evf, w);
+      *pw = w->next;
+    }
+    else
+      pw = &w->next;
+  }
+  pthread_cond_broadcast(&evf->cond);
+  pthread_mutex_unlock(&evf->lock);
+  return 0;
+}
+
+int ksceKernelClearEventFlag(SceUID evfid, unsigned int bits)
+{
+  hostObject *obj = _obj_get(evfid, OBJ_EVENTFLAG);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  // like the real kernel, bits is the mask of flags to keep
+  pthread_mutex_lock(&obj->u.evf.lock);
+  obj->u.evf.bits &= bits;
+  pthread_mutex_unlock(&obj->u.evf.lock);
+  return 0;
+}
+
+int ksceKernelWaitEventFlag(SceUID evfid, unsigned int bits, unsigned int wait, unsigned int *outBits,
+                            SceUInt *timeout)
+{
+  hostObject *obj = _obj_get(evfid, OBJ_EVENTFLAG);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  hostEventFlag *evf = &obj->u.evf;
+  hostEvfWaiter w    = {NULL, bits, wait, 0, 0};
+  struct timespec deadline;
+  SceInt64 start = ksceKernelGetSystemTimeWide();
+  int ret        = 0;
+
+  if (timeout)
+    _deadline(&deadline, *timeout);
+
+  pthread_mutex_lock(&evf->lock);
+  if (_evf_matched(evf->bits, bits, wait))
+    _evf_take(evf, &w);
+  else
+  {
+    hostEvfWaiter **pw = &evf->queue;
+    while (*pw)
+      pw = &(*pw)->next;
+    *pw = &w;
+
+    evf->waiters++;
+    while (!w.released && !evf->deleted)
+    {
+      if (!timeout)
+        pthread_cond_wait(&evf->cond, &evf->lock);
+      else if (pthread_cond_timedwait(&evf->cond, &evf->lock, &deadline) == ETIMEDOUT)
+        break;
+    }
+    evf->waiters--;
+
+    if (!w.released)
+    {
+      for (pw = &evf->queue; *pw; pw = &(*pw)->next)
+      {
+        if (*pw == &w)
+        {
+          *pw = w.next;
+          break;
+        }
+      }
+      ret        = evf->deleted ? HOST_ERROR_WAIT_DELETE : HOST_ERROR_WAIT_TIMEOUT;
+      w.out_bits = evf->bits;
+    }
+  }
+  pthread_mutex_unlock(&evf->lock);
+
+  if (outBits)
+    *outBits = w.out_bits;
+
+  if (timeout)
+  {
+    SceInt64 elapsed = ksceKernelGetSystemTimeWide() - start;
+    *timeout         = elapsed >= *timeout ? 0 : *timeout - (SceUInt)elapsed;
+  }
+  return ret;
+}
+
+/* Mutexes */
+
+SceUID ksceKernelCreateMutex(const char *name, SceUInt attr, int initCount, void *option)
+{
+  SceUID uid = _obj_alloc(OBJ_MUTEX);
+  if (uid < 0)
+    return uid;
+
+  pthread_mutexattr_t mattr;
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&_obj_get(uid, OBJ_MUTEX)->u.mutex, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+
+  for (int i = 0; i < initCount; i++)
+    pthread_mutex_lock(&_obj_get(uid, OBJ_MUTEX)->u.mutex);
+  return uid;
+}
+
+int ksceKernelDeleteMutex(SceUID mutexid)
+{
+  hostObject *obj = _obj_get(mutexid, OBJ_MUTEX);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  pthread_mutex_destroy(&obj->u.mutex);
+  _obj_free(obj);
+  return 0;
+}
+
+int ksceKernelLockMutex(SceUID mutexid, int lockCount, unsigned int *timeout)
+{
+  hostObject *obj = _obj_get(mutexid, OBJ_MUTEX);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+
+  for (int i = 0; i < lockCount; i++)
+  {
+    if (timeout)
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += *timeout / 1000000;
+      ts.tv_nsec += (long)(*timeout % 1000000) * 1000;
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      if (pthread_mutex_timedlock(&obj->u.mutex, &ts) == ETIMEDOUT)
+      {
+        while (i--)
+          pthread_mutex_unlock(&obj->u.mutex);
+        return HOST_ERROR_WAIT_TIMEOUT;
+      }
+    }
+    else
+      pthread_mutex_lock(&obj->u.mutex);
+  }
+  return 0;
+}
+
+int ksceKernelUnlockMutex(SceUID mutexid, int unlockCount)
+{
+  hostObject *obj = _obj_get(mutexid, OBJ_MUTEX);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  for (int i = 0; i < unlockCount; i++)
+    pthread_mutex_unlock(&obj->u.mutex);
+  return 0;
+}
+
+/* Memory */
+
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt)
+{
+  SceUID uid = _obj_alloc(OBJ_MEMBLOCK);
+  if (uid < 0)
+    return uid;
+
+  hostMemBlock *mem = &_obj_get(uid, OBJ_MEMBLOCK)->u.mem;
+  // memblocks are page aligned, which the ring buffer relies on
+  if (posix_memalign(&mem->base, 4096, size) != 0)
+  {
+    _obj_free(_obj_get(uid, OBJ_MEMBLOCK));
+    return HOST_ERROR_NO_MEMORY;
+  }
+  mem->size = size;
+  return uid;
+}
+
+int ksceKernelFreeMemBlock(SceUID uid)
+{
+  hostObject *obj = _obj_get(uid, OBJ_MEMBLOCK);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  free(obj->u.mem.base);
+  _obj_free(obj);
+  return 0;
+}
+
+int ksceKernelGetMemBlockBase(SceUID uid, void **base)
+{
+  hostObject *obj = _obj_get(uid, OBJ_MEMBLOCK);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  *base = obj->u.mem.base;
+  return 0;
+}
+
+SceUID ksceKernelUserMap(const char *name, int permission, const void *user_buf, SceSize size, void **kernel_page,
+                         SceSize *kernel_size, SceUInt32 *kernel_offset)
+{
+  // user and kernel share one address space on the host
+  SceUID uid = _obj_alloc(OBJ_MEMBLOCK);
+  if (uid < 0)
+    return uid;
+  *kernel_page = (void *)user_buf;
+  if (kernel_size)
+    *kernel_size = size;
+  if (kernel_offset)
+    *kernel_offset = 0;
+  return uid;
+}
+
+int ksceKernelMemBlockRelease(SceUID uid)
+{
+  hostObject *obj = _obj_get(uid, OBJ_MEMBLOCK);
+  if (!obj)
+    return HOST_ERROR_ILLEGAL_UID;
+  // mappings don't own their memory
+  _obj_free(obj);
+  return 0;
+}
+
+int ksceKernelMemcpyUserToKernel(void *dst, const void *src, SceSize len)
+{
+  memcpy(dst, src, len);
+  return 0;
+}
+
+int ksceKernelMemcpyKernelToUser(void *dst, const void *src, SceSize len)
+{
+  memcpy(dst, src, len);
+  return 0;
+}
+
+/* Misc */
+
+int ksceDebugPrintf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int r = vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  return r;
+}
+
+int ksceKernelRegisterSysEventHandler(const char *name, SceSysEventHandler handler, void *args)
+{
+  return 0;
+}
+
+int ksceUsbServMacSelect(int mac, int mode)
+{
+  return 0;
+}
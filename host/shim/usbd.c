@@ -0,0 +1,501 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Host emulation of SceUsbdForDriver on top of the simulated device.
+ *
+ * Like the real host controller, transfers are queued per pipe and only the
+ * head of each queue is serviced. An engine thread advances the device clock
+ * and moves data; finished transfers go to a FIFO that a single callback
+ * thread drains, so driver callbacks are serialised and never run with the
+ * engine lock held.
+ */
+
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/usbd.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../sim/simdevice.h"
+
+#define SIM_DEVICE_ID 1
+#define SIM_MAX_PIPES 8
+#define SIM_PIPE_UID_BASE 0x20001
+#define SIM_ENGINE_TICK_US 50
+
+typedef struct simTransfer
+{
+  struct simTransfer *next;
+  unsigned char *buffer;
+  unsigned int length;
+  unsigned int actual;
+  SceUsbdDeviceRequest req;
+  int64_t due;
+  int result;
+  ksceUsbdDoneCallback cb;
+  void *arg;
+} simTransfer;
+
+typedef struct simPipe
+{
+  int used;
+  unsigned char address;
+  unsigned char attributes; // 0 control, 2 bulk, 3 interrupt
+  unsigned int interval_us;
+  simTransfer *head;
+  simTransfer *tail;
+} simPipe;
+
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t engine_cond;
+static pthread_cond_t done_cond;
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+static pthread_t engine_thread;
+static pthread_t callback_thread;
+static int engine_kicked;
+
+static simPipe pipes[SIM_MAX_PIPES];
+static simTransfer *done_head;
+static simTransfer *done_tail;
+
+static const SceUsbdDriver *driver;
+static int attached;
+static int enumerating;
+static pthread_cond_t attach_cond;
+
+void usbsim_lock(void)
+{
+  pthread_mutex_lock(&engine_lock);
+}
+
+void usbsim_unlock(void)
+{
+  pthread_mutex_unlock(&engine_lock);
+}
+
+void usbsim_kick(void)
+{
+  engine_kicked = 1;
+  pthread_cond_signal(&engine_cond);
+}
+
+static int64_t _now(void)
+{
+  return ksceKernelGetSystemTimeWide();
+}
+
+static void _complete(simPipe *pipe, int result)
+{
+  simTransfer *t = pipe->head;
+  pipe->head     = t->next;
+  if (!pipe->head)
+    pipe->tail = NULL;
+
+  t->result = result;
+  t->next   = NULL;
+  if (done_tail)
+    done_tail->next = t;
+  else
+    done_head = t;
+  done_tail = t;
+  pthread_cond_signal(&done_cond);
+}
+
+static void _cancel_pipe(simPipe *pipe)
+{
+  while (pipe->head)
+    _complete(pipe, USBSIM_RESULT_CANCELED);
+}
+
+static void _service_pipe(simPipe *pipe, int64_t now)
+{
+  simTransfer *t;
+
+  while ((t = pipe->head) && now >= t->due)
+  {
+    if (pipe->attributes == 0)
+    {
+      int r = simdev_control(&t->req, t->buffer);
+      t->actual = r > 0 ? r : 0;
+      _complete(pipe, r < 0 ? USBSIM_RESULT_STALL : 0);
+    }
+    else if (pipe->attributes == 3)
+    {
+      int r = simdev_intr(t->buffer, t->length);
+      if (r <= 0)
+      {
+        t->due = now + pipe->interval_us;
+        break;
+      }
+      t->actual = r;
+      _complete(pipe, 0);
+    }
+    else if (pipe->address & SCE_USBD_ENDPOINT_DIRECTION_IN)
+    {
+      if (!simdev_in(t->buffer, t->length, &t->actual, now))
+        break;
+      _complete(pipe, 0);
+    }
+    else
+    {
+      t->actual += simdev_out(t->buffer + t->actual, t->length - t->actual, now);
+      if (t->actual < t->length)
+        break;
+      _complete(pipe, 0);
+    }
+  }
+}
+
+static void *_engine_main(void *arg)
+{
+  pthread_mutex_lock(&engine_lock);
+  for (;;)
+  {
+    int64_t now = _now();
+    if (simdev_present())
+    {
+      simdev_tick(now);
+      for (int i = 0; i < SIM_MAX_PIPES; i++)
+        if (pipes[i].used)
+          _service_pipe(&pipes[i], now);
+    }
+
+    if (!engine_kicked)
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_nsec += SIM_ENGINE_TICK_US * 1000;
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&engine_cond, &engine_lock, &ts);
+    }
+    engine_kicked = 0;
+  }
+  return NULL;
+}
+
+static void *_callback_main(void *arg)
+{
+  pthread_mutex_lock(&engine_lock);
+  for (;;)
+  {
+    while (!done_head)
+      pthread_cond_wait(&done_cond, &engine_lock);
+
+    simTransfer *t = done_head;
+    done_head      = t->next;
+    if (!done_head)
+      done_tail = NULL;
+
+    pthread_mutex_unlock(&engine_lock);
+    if (t->cb)
+      t->cb(t->result, t->actual, t->arg);
+    free(t);
+    pthread_mutex_lock(&engine_lock);
+  }
+  return NULL;
+}
+
+static void _engine_init(void)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&engine_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&done_cond, NULL);
+  pthread_cond_init(&attach_cond, NULL);
+
+  pthread_create(&engine_thread, NULL, _engine_main, NULL);
+  pthread_create(&callback_thread, NULL, _callback_main, NULL);
+}
+
+static simPipe *_pipe_get(SceUID pipe_id)
+{
+  int i = pipe_id - SIM_PIPE_UID_BASE;
+  if (i < 0 || i >= SIM_MAX_PIPES || !pipes[i].used)
+    return NULL;
+  return &pipes[i];
+}
+
+/* Enumeration */
+
+static int _enumerate(void)
+{
+  const SceUsbdDriver *drv;
+  int r = 0;
+
+  usbsim_lock();
+  drv = simdev_present() && !attached && !enumerating ? driver : NULL;
+  enumerating = (drv != NULL);
+  usbsim_unlock();
+  if (!drv)
+    return 0;
+
+  if (drv->probe(SIM_DEVICE_ID) == SCE_USBD_PROBE_SUCCEEDED)
+    r = drv->attach(SIM_DEVICE_ID);
+  else
+    r = SCE_USBD_PROBE_FAILED;
+
+  usbsim_lock();
+  enumerating = 0;
+  attached    = (r == SCE_USBD_ATTACH_SUCCEEDED);
+  pthread_cond_broadcast(&attach_cond);
+  usbsim_unlock();
+  return r;
+}
+
+static void *_enumerate_main(void *arg)
+{
+  _enumerate();
+  return NULL;
+}
+
+int usbsim_plug(const usbsimConfig *cfg)
+{
+  pthread_once(&engine_once, _engine_init);
+
+  usbsim_lock();
+  if (simdev_present())
+  {
+    usbsim_unlock();
+    return USBSIM_ERROR_BUSY;
+  }
+  int r = simdev_configure(cfg, _now());
+  usbsim_unlock();
+  if (r < 0)
+    return r;
+
+  return _enumerate();
+}
+
+void usbsim_unplug(void)
+{
+  const SceUsbdDriver *drv;
+
+  usbsim_lock();
+  if (!simdev_present())
+  {
+    usbsim_unlock();
+    return;
+  }
+  simdev_remove();
+  drv      = attached ? driver : NULL;
+  attached = 0;
+  usbsim_unlock();
+
+  if (drv)
+    drv->detach(SIM_DEVICE_ID);
+
+  usbsim_lock();
+  for (int i = 0; i < SIM_MAX_PIPES; i++)
+  {
+    _cancel_pipe(&pipes[i]);
+    pipes[i].used = 0;
+  }
+  usbsim_unlock();
+}
+
+int usbsim_wait_attached(unsigned int timeout_us)
+{
+  struct timespec ts;
+  int r = 0;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout_us / 1000000;
+  ts.tv_nsec += (long)(timeout_us % 1000000) * 1000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  usbsim_lock();
+  while (!attached && r != ETIMEDOUT)
+    r = pthread_cond_timedwait(&attach_cond, &engine_lock, &ts);
+  r = attached ? 0 : -1;
+  usbsim_unlock();
+  return r;
+}
+
+/* SceUsbdForDriver */
+
+int ksceUsbdRegisterDriver(const SceUsbdDriver *drv)
+{
+  pthread_t th;
+
+  pthread_once(&engine_once, _engine_init);
+
+  usbsim_lock();
+  driver   = drv;
+  attached = 0;
+  usbsim_unlock();
+
+  // like usbd, an already connected device is enumerated asynchronously
+  if (pthread_create(&th, NULL, _enumerate_main, NULL) == 0)
+    pthread_detach(th);
+  return 0;
+}
+
+int ksceUsbdUnregisterDriver(const SceUsbdDriver *drv)
+{
+  usbsim_lock();
+  if (driver == drv)
+  {
+    driver   = NULL;
+    attached = 0;
+  }
+  usbsim_unlock();
+  return 0;
+}
+
+void *ksceUsbdScanStaticDescriptor(SceUID device_id, void *start, SceUInt8 type)
+{
+  unsigned int len;
+  const unsigned char *desc = simdev_descriptors(&len);
+  const unsigned char *p    = desc;
+
+  if (device_id != SIM_DEVICE_ID || !desc)
+    return NULL;
+
+  // start itself is never returned, so the result can be fed back in
+  if (start)
+    p = (const unsigned char *)start + ((const unsigned char *)start)[0];
+
+  while (p + 2 <= desc + len && p[0] >= 2)
+  {
+    if (p[1] == type)
+      return (void *)p;
+    p += p[0];
+  }
+  return NULL;
+}
+
+SceUID ksceUsbdOpenPipe(int device_id, SceUsbdEndpointDescriptor *endpoint)
+{
+  SceUID uid = USBSIM_ERROR_BUSY;
+
+  usbsim_lock();
+  if (device_id != SIM_DEVICE_ID || !simdev_present())
+  {
+    usbsim_unlock();
+    return USBSIM_ERROR_NO_DEVICE;
+  }
+
+  for (int i = 0; i < SIM_MAX_PIPES; i++)
+  {
+    if (pipes[i].used)
+      continue;
+    memset(&pipes[i], 0, sizeof(pipes[i]));
+    pipes[i].used = 1;
+    if (endpoint)
+    {
+      pipes[i].address    = endpoint->bEndpointAddress;
+      pipes[i].attributes = endpoint->bmAttributes & 3;
+      // full speed interrupt bInterval is in frames
+      pipes[i].interval_us = (endpoint->bInterval ? endpoint->bInterval : 1) * 1000;
+    }
+    uid = SIM_PIPE_UID_BASE + i;
+    break;
+  }
+  usbsim_unlock();
+  return uid;
+}
+
+int ksceUsbdClosePipe(SceUID pipe_id)
+{
+  usbsim_lock();
+  simPipe *pipe = _pipe_get(pipe_id);
+  if (pipe)
+  {
+    _cancel_pipe(pipe);
+    pipe->used = 0;
+  }
+  usbsim_unlock();
+  return pipe ? 0 : USBSIM_ERROR_INVALID_PIPE;
+}
+
+static int _submit(SceUID pipe_id, int attributes, const SceUsbdDeviceRequest *req, unsigned char *buffer,
+                   unsigned int length, ksceUsbdDoneCallback cb, void *user_data)
+{
+  simTransfer *t;
+
+  usbsim_lock();
+  simPipe *pipe = _pipe_get(pipe_id);
+  if (!pipe || pipe->attributes != attributes)
+  {
+    usbsim_unlock();
+    return USBSIM_ERROR_INVALID_PIPE;
+  }
+  if (!simdev_present())
+  {
+    usbsim_unlock();
+    return USBSIM_ERROR_NO_DEVICE;
+  }
+
+  t = calloc(1, sizeof(*t));
+  if (req)
+    t->req = *req;
+  t->buffer = buffer;
+  t->length = length;
+  t->cb     = cb;
+  t->arg    = user_data;
+  // nothing completes before the next (micro)frame
+  t->due = _now() + simdev_frame_us();
+
+  if (pipe->tail)
+    pipe->tail->next = t;
+  else
+    pipe->head = t;
+  pipe->tail = t;
+  usbsim_kick();
+  usbsim_unlock();
+  return 0;
+}
+
+int ksceUsbdSetConfiguration(SceUID pipe_id, SceInt8 config_num, ksceUsbdDoneCallback cb, void *user_data)
+{
+  SceUsbdDeviceRequest req = {SCE_USBD_REQTYPE_DIR_TO_DEVICE | SCE_USBD_REQTYPE_TYPE_STANDARD, 0x09,
+                              (unsigned char)config_num, 0, 0};
+  return _submit(pipe_id, 0, &req, NULL, 0, cb, user_data);
+}
+
+int ksceUsbdControlTransfer(SceUID pipe_id, const SceUsbdDeviceRequest *req, unsigned char *buffer,
+                            ksceUsbdDoneCallback cb, void *user_data)
+{
+  return _submit(pipe_id, 0, req, buffer, req->wLength, cb, user_data);
+}
+
+int ksceUsbdBulkTransfer(SceUID pipe_id, unsigned char *buffer, unsigned int length, ksceUsbdDoneCallback cb,
+                         void *user_data)
+{
+  return _submit(pipe_id, 2, NULL, buffer, length, cb, user_data);
+}
+
+int ksceUsbdInterruptTransfer(SceUID pipe_id, unsigned char *buffer, unsigned int length, ksceUsbdDoneCallback cb,
+                              void *user_data)
+{
+  return _submit(pipe_id, 3, NULL, buffer, length, cb, user_data);
+}
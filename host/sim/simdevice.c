@@ -0,0 +1,1096 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Virtual FTDI/CH34x adapter.
+ *
+ * The UART moves one character per character time in each direction. The
+ * chip FIFOs are bounded: a full TX FIFO NAKs bulk OUT, a full RX FIFO
+ * overruns unless hardware flow control holds the peer off. Bus bandwidth is
+ * a byte credit refilled at full/high speed bulk rates.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/devices/ch34x.h"
+#include "../../src/devices/ftdi.h"
+#include "simdevice.h"
+
+#define SIM_CAPTURE_SIZE (256 * 1024)
+
+#define FS_BULK_BYTES_PER_US 1.216 // 19 x 64 byte packets per 1 ms frame
+#define HS_BULK_BYTES_PER_US 40.0  // what real EHCI hosts manage on bulk
+
+#define RX_ERR_PE FTDI_RS_PE
+#define RX_ERR_FE FTDI_RS_FE
+#define RX_ERR_BI FTDI_RS_BI
+
+typedef struct simFifo
+{
+  unsigned char *data;
+  unsigned char *flags;
+  unsigned int size;
+  unsigned int head;
+  unsigned int count;
+} simFifo;
+
+typedef struct simChunk
+{
+  struct simChunk *next;
+  int64_t start;
+  unsigned int delay_us;
+  unsigned int len;
+  unsigned int pos;
+  unsigned char data[];
+} simChunk;
+
+static struct
+{
+  int present;
+  usbsimConfig cfg;
+  unsigned int mps;
+  int high_speed;
+  unsigned char desc[64];
+  unsigned int desc_len;
+
+  // line settings
+  unsigned int baudrate;
+  unsigned int char_bits; // half bits
+  double char_us;
+  unsigned int flowctrl;
+  unsigned char xon_char;
+  unsigned char xoff_char;
+  int dtr;
+  int rts;
+  int break_on;
+  int peer_msr;
+
+  // FTDI
+  unsigned char latency_ms;
+  unsigned char bitmode;
+  unsigned char bitmask;
+  unsigned char pins;
+  int mpsse_loopback;
+  unsigned char mpsse_cmd; // shift command in its data phase
+  unsigned int mpsse_left; // bytes of it still to clock
+  int64_t last_flush;
+  unsigned char lsr_pending;
+
+  // CH34x
+  unsigned char regs[256];
+  int ch34x_reported_msr;
+
+  simFifo tx;
+  simFifo rx;
+  simFifo capture;
+  int64_t tx_next;
+  int xoff_received;
+
+  simChunk *inject_head;
+  simChunk *inject_tail;
+  unsigned int inject_pending;
+  unsigned int peer_baud;
+  int64_t peer_next;
+
+  double bus_credit;
+  double bus_rate;
+  double ff_credit;
+  int64_t ff_last;
+  unsigned char ff_counter;
+  int64_t last_tick;
+
+  unsigned int overruns;
+  unsigned int control_requests;
+} dev;
+
+/* FIFOs */
+
+static int _fifo_init(simFifo *f, unsigned int size)
+{
+  f->data  = malloc(size);
+  f->flags = calloc(1, size);
+  f->size  = size;
+  f->head  = 0;
+  f->count = 0;
+  return f->data && f->flags ? 0 : -1;
+}
+
+static void _fifo_free(simFifo *f)
+{
+  free(f->data);
+  free(f->flags);
+  memset(f, 0, sizeof(*f));
+}
+
+static int _fifo_put(simFifo *f, unsigned char c, unsigned char flags)
+{
+  if (f->count == f->size)
+    return -1;
+  unsigned int i = (f->head + f->count) % f->size;
+  f->data[i]     = c;
+  f->flags[i]    = flags;
+  f->count++;
+  return 0;
+}
+
+static unsigned char _fifo_get(simFifo *f, unsigned char *flags)
+{
+  unsigned char c = f->data[f->head];
+  if (flags)
+    *flags = f->flags[f->head];
+  f->head = (f->head + 1) % f->size;
+  f->count--;
+  return c;
+}
+
+static unsigned char _fifo_peek_flags(simFifo *f, unsigned int i)
+{
+  return f->flags[(f->head + i) % f->size];
+}
+
+static void _fifo_clear(simFifo *f)
+{
+  f->head  = 0;
+  f->count = 0;
+}
+
+/* Chip model */
+
+static int _is_ftdi(void)
+{
+  return dev.cfg.type != USBSIM_CH340;
+}
+
+static void _update_char_time(void)
+{
+  if (dev.baudrate)
+    dev.char_us = (double)dev.char_bits * 500000.0 / dev.baudrate;
+}
+
+static double _peer_char_us(void)
+{
+  if (!dev.peer_baud)
+    return dev.char_us;
+  return (double)dev.char_bits * 500000.0 / dev.peer_baud;
+}
+
+/* RX FIFO above 3/4: hardware flow control holds the far end off */
+static int _rx_throttled(void)
+{
+  return dev.rx.count >= dev.rx.size - dev.rx.size / 4;
+}
+
+static int _rts_line(void)
+{
+  if ((dev.flowctrl & FLOW_RTS_CTS) && _rx_throttled())
+    return 0;
+  return dev.rts;
+}
+
+static int _dtr_line(void)
+{
+  if ((dev.flowctrl & FLOW_DTR_DSR) && _rx_throttled())
+    return 0;
+  return dev.dtr;
+}
+
+static int _modem_status(void)
+{
+  if (!dev.cfg.loopback)
+    return dev.peer_msr;
+  return (_rts_line() ? MODEM_CTS : 0) | (_dtr_line() ? MODEM_DSR | MODEM_DCD : 0);
+}
+
+static int _tx_halted(void)
+{
+  int msr = _modem_status();
+  if ((dev.flowctrl & FLOW_RTS_CTS) && !(msr & MODEM_CTS))
+    return 1;
+  if ((dev.flowctrl & FLOW_DTR_DSR) && !(msr & MODEM_DSR))
+    return 1;
+  if (dev.flowctrl & FLOW_XON_XOFF)
+    return dev.cfg.loopback ? _rx_throttled() : dev.xoff_received;
+  return 0;
+}
+
+static int _peer_halted(void)
+{
+  if ((dev.flowctrl & FLOW_RTS_CTS) && !_rts_line())
+    return 1;
+  if ((dev.flowctrl & FLOW_DTR_DSR) && !_dtr_line())
+    return 1;
+  if ((dev.flowctrl & FLOW_XON_XOFF) && _rx_throttled())
+    return 1;
+  return 0;
+}
+
+static void _rx_char(unsigned char c, unsigned char flags)
+{
+  // FTDI handles XON/XOFF in the chip, they never reach the host
+  if (_is_ftdi() && (dev.flowctrl & FLOW_XON_XOFF) && !flags)
+  {
+    if (c == dev.xoff_char)
+    {
+      dev.xoff_received = 1;
+      return;
+    }
+    if (c == dev.xon_char)
+    {
+      dev.xoff_received = 0;
+      return;
+    }
+  }
+
+  if (_fifo_put(&dev.rx, c, flags) < 0)
+  {
+    dev.overruns++;
+    dev.lsr_pending |= FTDI_RS_OE;
+  }
+}
+
+/* A peer at the wrong rate shows up as garbage with framing errors */
+static void _rx_peer_char(unsigned char c)
+{
+  unsigned int a = dev.baudrate;
+  unsigned int b = dev.peer_baud;
+
+  if (!b || (a > b ? a - b : b - a) * 25 <= a)
+  {
+    _rx_char(c, 0);
+    return;
+  }
+  _rx_char((unsigned char)(((c << 1) | 1) ^ (b * 16 / a)), RX_ERR_FE);
+}
+
+static void _tx_char(unsigned char c)
+{
+  if (dev.cfg.loopback)
+    _rx_char(c, 0);
+  else if (_fifo_put(&dev.capture, c, 0) < 0)
+  {
+    // keep the newest bytes
+    _fifo_get(&dev.capture, NULL);
+    _fifo_put(&dev.capture, c, 0);
+  }
+}
+
+static void _tick_uart(int64_t now)
+{
+  while (dev.tx.count && !_tx_halted() && dev.tx_next + dev.char_us <= now)
+  {
+    _tx_char(_fifo_get(&dev.tx, NULL));
+    dev.tx_next += dev.char_us;
+  }
+  if (!dev.tx.count || _tx_halted())
+    dev.tx_next = now;
+
+  double peer_us = _peer_char_us();
+  simChunk *chunk;
+  while ((chunk = dev.inject_head) && !_peer_halted())
+  {
+    if (!chunk->start)
+      chunk->start = (dev.peer_next > now ? dev.peer_next : now) + chunk->delay_us;
+    if (dev.peer_next < chunk->start)
+      dev.peer_next = chunk->start;
+    if (dev.peer_next + peer_us > now)
+      break;
+
+    _rx_peer_char(chunk->data[chunk->pos++]);
+    dev.inject_pending--;
+    dev.peer_next += peer_us;
+
+    if (chunk->pos == chunk->len)
+    {
+      dev.inject_head = chunk->next;
+      if (!dev.inject_head)
+        dev.inject_tail = NULL;
+      free(chunk);
+    }
+  }
+  if (!dev.inject_head || _peer_halted())
+    dev.peer_next = dev.peer_next > now ? dev.peer_next : now;
+}
+
+/*
+ * Synchronous 245 FIFO: the far side produces and consumes at fifo_rate. The
+ * chip FIFO is refilled as packets go out too, otherwise the engine tick
+ * rather than the FIFO size would bound throughput.
+ */
+static void _syncff_fill(int64_t now)
+{
+  double rate = dev.cfg.fifo_rate ? dev.cfg.fifo_rate : 40000000;
+
+  dev.ff_credit += (double)(now - dev.ff_last) * rate / 1000000.0;
+  dev.ff_last = now;
+  if (dev.ff_credit > rate / 1000.0)
+    dev.ff_credit = rate / 1000.0;
+
+  while (dev.ff_credit >= 1.0 && dev.rx.count < dev.rx.size)
+  {
+    _fifo_put(&dev.rx, dev.ff_counter++, 0);
+    dev.ff_credit -= 1.0;
+  }
+}
+
+static void _tick_syncff(int64_t now)
+{
+  _syncff_fill(now);
+  while (dev.tx.count)
+    _tx_char(_fifo_get(&dev.tx, NULL));
+}
+
+/*
+ * MPSSE command header length, 0 if more bytes are needed. Shift commands
+ * are only the header here, their data is clocked by _tick_mpsse() a byte
+ * at a time.
+ */
+static unsigned int _mpsse_cmd_len(void)
+{
+  unsigned char cmd = dev.tx.data[dev.tx.head];
+  unsigned int len;
+
+  if (cmd & 0x80)
+  {
+    switch (cmd)
+    {
+      case 0x80:
+      case 0x82:
+      case 0x86:
+      case 0x8F:
+        len = 3;
+        break;
+      case 0x8E:
+        len = 2;
+        break;
+      default:
+        len = 1;
+        break;
+    }
+  }
+  else if (cmd & 0x40 || cmd & 0x02)
+    len = 2; // TMS / bits: length
+  else
+    len = 3; // bytes: length low, length high
+  return dev.tx.count >= len ? len : 0;
+}
+
+/*
+ * Like the engine, a shift stalls while the next byte to send hasn't
+ * arrived or the receive buffer is full, long commands don't have to fit
+ * the TX buffer and replies are never dropped.
+ */
+static void _tick_mpsse(void)
+{
+  unsigned int len;
+
+  for (;;)
+  {
+    if (dev.mpsse_left)
+    {
+      unsigned char cmd = dev.mpsse_cmd;
+      int wr            = cmd & 0x10 || cmd & 0x40;
+      int rd            = cmd & 0x20;
+      int loop          = dev.cfg.loopback || dev.mpsse_loopback;
+
+      if ((wr && !dev.tx.count) || (rd && dev.rx.count == dev.rx.size))
+        return;
+
+      unsigned char c = wr ? _fifo_get(&dev.tx, NULL) : 0xFF;
+      if (rd)
+        _fifo_put(&dev.rx, loop ? c : 0xFF, 0);
+      dev.mpsse_left--;
+      continue;
+    }
+
+    // room for a pin read or a bad command reply
+    if (!dev.tx.count || dev.rx.size - dev.rx.count < 2 || !(len = _mpsse_cmd_len()))
+      return;
+
+    unsigned char cmd = _fifo_get(&dev.tx, NULL);
+    unsigned char b[2] = {0, 0};
+    unsigned int i;
+
+    if (cmd & 0x80)
+    {
+      for (i = 1; i < len; i++)
+        b[i - 1] = _fifo_get(&dev.tx, NULL);
+      switch (cmd)
+      {
+        case 0x80:
+          dev.pins = b[0];
+          break;
+        case 0x81:
+        case 0x83:
+          _fifo_put(&dev.rx, dev.pins, 0);
+          break;
+        case 0x84:
+          dev.mpsse_loopback = 1;
+          break;
+        case 0x85:
+          dev.mpsse_loopback = 0;
+          break;
+        case 0x82:
+        case 0x86:
+        case 0x87:
+        case 0x8A:
+        case 0x8B:
+        case 0x8C:
+        case 0x8D:
+        case 0x8E:
+        case 0x8F:
+        case 0x96:
+        case 0x97:
+          break;
+        default:
+          // bad command
+          _fifo_put(&dev.rx, 0xFA, 0);
+          _fifo_put(&dev.rx, cmd, 0);
+          break;
+      }
+      continue;
+    }
+
+    dev.mpsse_cmd = cmd;
+    if (cmd & 0x02 || cmd & 0x40)
+    {
+      _fifo_get(&dev.tx, NULL); // bit count
+      dev.mpsse_left = 1;
+    }
+    else
+    {
+      dev.mpsse_left = _fifo_get(&dev.tx, NULL);
+      dev.mpsse_left |= _fifo_get(&dev.tx, NULL) << 8;
+      dev.mpsse_left++;
+    }
+  }
+}
+
+void simdev_tick(int64_t now)
+{
+  int64_t elapsed = now - dev.last_tick;
+  dev.last_tick   = now;
+
+  dev.bus_credit += elapsed * dev.bus_rate;
+  if (dev.bus_credit > dev.bus_rate * 1000 + dev.mps)
+    dev.bus_credit = dev.bus_rate * 1000 + dev.mps;
+
+  if (!_is_ftdi() || dev.bitmode == BITMODE_RESET)
+    _tick_uart(now);
+  else if (dev.bitmode == BITMODE_SYNCFF)
+    _tick_syncff(now);
+  else if (dev.bitmode == BITMODE_MPSSE)
+    _tick_mpsse();
+  else
+  {
+    // bitbang modes: the last byte written drives the pins
+    while (dev.tx.count)
+      dev.pins = _fifo_get(&dev.tx, NULL);
+  }
+}
+
+/* Bulk endpoints */
+
+unsigned int simdev_out(const unsigned char *data, unsigned int len, int64_t now)
+{
+  unsigned int n = 0;
+
+  if (!dev.tx.count)
+    dev.tx_next = now;
+
+  while (n < len && dev.tx.count < dev.tx.size && dev.bus_credit >= 1.0)
+  {
+    _fifo_put(&dev.tx, data[n++], 0);
+    dev.bus_credit -= 1.0;
+  }
+  return n;
+}
+
+static unsigned char _ftdi_lsr(void)
+{
+  unsigned char lsr = dev.lsr_pending;
+  if (dev.rx.count)
+    lsr |= FTDI_RS_DR;
+  if (!dev.tx.count)
+    lsr |= FTDI_RS_THRE | FTDI_RS_TEMT;
+  return lsr;
+}
+
+/*
+ * FTDI sends a packet once mps - 2 bytes are buffered or the latency timer
+ * runs out. Errors are per packet, so a byte with errors goes out alone.
+ */
+static int _ftdi_in(unsigned char *buf, unsigned int len, unsigned int *actual, int64_t now)
+{
+  while (*actual + 2 <= len)
+  {
+    unsigned int room = len - *actual;
+    unsigned int n    = 0;
+    unsigned char err = 0;
+    int full;
+
+    if (room > dev.mps)
+      room = dev.mps;
+    room -= 2;
+
+    if (dev.bus_credit < dev.mps)
+      return 0;
+
+    if (dev.bitmode == BITMODE_SYNCFF)
+      _syncff_fill(now);
+
+    while (n < room && n < dev.rx.count)
+    {
+      unsigned char flags = _fifo_peek_flags(&dev.rx, n);
+      if (flags)
+      {
+        if (n == 0)
+        {
+          err = flags;
+          n   = 1;
+        }
+        break;
+      }
+      n++;
+    }
+
+    full = (n == room) || err || (n && n < dev.rx.count);
+    if (!full && now - dev.last_flush < (int64_t)dev.latency_ms * 1000)
+      return 0;
+
+    unsigned char *pkt = buf + *actual;
+    pkt[0]             = 0x01 | (_modem_status() << FTDI_RS0_MODEM_SHIFT);
+    for (unsigned int i = 0; i < n; i++)
+      pkt[2 + i] = _fifo_get(&dev.rx, NULL);
+    pkt[1]          = _ftdi_lsr() | err;
+    dev.lsr_pending = 0;
+
+    *actual += n + 2;
+    dev.bus_credit -= n + 2;
+    dev.last_flush = now;
+
+    // a short packet ends the transfer
+    if (n + 2 < dev.mps)
+      return 1;
+  }
+  return 1;
+}
+
+/* CH34x hands over whatever it has, unless bit 7 of the prescaler is clear */
+static int _ch34x_in(unsigned char *buf, unsigned int len, unsigned int *actual)
+{
+  unsigned int n = dev.rx.count;
+
+  if (!n || dev.bus_credit < dev.mps)
+    return 0;
+  if (!(dev.regs[CH34X_REG_PRESCALER] & 0x80) && n < dev.mps)
+    return 0;
+
+  if (n > dev.mps)
+    n = dev.mps;
+  if (n > len)
+    n = len;
+
+  for (unsigned int i = 0; i < n; i++)
+    buf[i] = _fifo_get(&dev.rx, NULL);
+  *actual = n;
+  dev.bus_credit -= n;
+  return 1;
+}
+
+int simdev_in(unsigned char *buf, unsigned int len, unsigned int *actual, int64_t now)
+{
+  if (_is_ftdi())
+    return _ftdi_in(buf, len, actual, now);
+  return _ch34x_in(buf, len, actual);
+}
+
+int simdev_intr(unsigned char *buf, unsigned int len)
+{
+  int msr = _modem_status();
+
+  if (_is_ftdi() || len < 4 || msr == dev.ch34x_reported_msr)
+    return 0;
+
+  buf[0]                 = 0;
+  buf[1]                 = 0;
+  buf[2]                 = ~msr;
+  buf[3]                 = 0;
+  dev.ch34x_reported_msr = msr;
+  return 4;
+}
+
+/* FTDI vendor requests */
+
+static void _ftdi_set_baud(unsigned short value, unsigned short index)
+{
+  // inverse of frac_code in ftdi.c, in eighths
+  static const unsigned char eighths[8] = {0, 4, 2, 1, 3, 5, 6, 7};
+  unsigned int base = 3000000;
+  unsigned int code;
+  unsigned int div;
+
+  if (dev.cfg.type == USBSIM_FT232H)
+  {
+    code = (value >> 14) | ((index >> 6) & 4);
+    if (index & 0x200)
+      base = 12000000;
+  }
+  else
+    code = (value >> 14) | ((index & 1) << 2);
+
+  div = (value & 0x3FFF) * 8 + eighths[code];
+  if (div == 0)
+    dev.baudrate = base;
+  else if (div == 8)
+    dev.baudrate = base * 2 / 3;
+  else
+    dev.baudrate = (unsigned int)(((uint64_t)base * 8 + div / 2) / div);
+  _update_char_time();
+}
+
+static void _ftdi_set_data(unsigned short value)
+{
+  unsigned int bits   = value & 0x0F;
+  unsigned int parity = (value >> 8) & 0x07;
+  unsigned int stop   = (value >> 11) & 0x03;
+  int brk             = (value >> 14) & 1;
+
+  dev.char_bits = 2 * (1 + bits + (parity ? 1 : 0)) + (stop == 0 ? 2 : stop == 1 ? 3 : 4);
+  _update_char_time();
+
+  // loopback sees a break as a NUL with BI/FE
+  if (brk && !dev.break_on && dev.cfg.loopback)
+    _rx_char(0, RX_ERR_BI | RX_ERR_FE);
+  dev.break_on = brk;
+}
+
+static int _ftdi_control(const SceUsbdDeviceRequest *req, unsigned char *data)
+{
+  switch (req->bRequest)
+  {
+    case SIO_RESET_REQUEST:
+      if (req->wValue == SIO_RESET_SIO)
+      {
+        _fifo_clear(&dev.rx);
+        _fifo_clear(&dev.tx);
+      }
+      else if (req->wValue == SIO_TCIFLUSH)
+        _fifo_clear(&dev.rx);
+      else if (req->wValue == SIO_TCOFLUSH)
+        _fifo_clear(&dev.tx);
+      return 0;
+    case SIO_SET_MODEM_CTRL_REQUEST:
+      if (req->wValue & (SIO_SET_DTR_MASK << 8))
+        dev.dtr = req->wValue & SIO_SET_DTR_MASK;
+      if (req->wValue & (SIO_SET_RTS_MASK << 8))
+        dev.rts = (req->wValue & SIO_SET_RTS_MASK) != 0;
+      return 0;
+    case SIO_SET_FLOW_CTRL_REQUEST:
+      dev.flowctrl = req->wIndex & 0xFF00;
+      if (dev.flowctrl & FLOW_XON_XOFF)
+      {
+        dev.xon_char  = req->wValue & 0xFF;
+        dev.xoff_char = req->wValue >> 8;
+      }
+      dev.xoff_received = 0;
+      return 0;
+    case SIO_SET_BAUDRATE_REQUEST:
+      _ftdi_set_baud(req->wValue, req->wIndex);
+      return 0;
+    case SIO_SET_DATA_REQUEST:
+      _ftdi_set_data(req->wValue);
+      return 0;
+    case SIO_POLL_MODEM_STATUS_REQUEST:
+      data[0] = 0x01 | (_modem_status() << FTDI_RS0_MODEM_SHIFT);
+      data[1] = _ftdi_lsr();
+      return 2;
+    case SIO_SET_EVENT_CHAR_REQUEST:
+    case SIO_SET_ERROR_CHAR_REQUEST:
+      return 0;
+    case SIO_SET_LATENCY_TIMER_REQUEST:
+      if ((req->wValue & 0xFF) == 0)
+        return -1;
+      dev.latency_ms = req->wValue & 0xFF;
+      return 0;
+    case SIO_GET_LATENCY_TIMER_REQUEST:
+      data[0] = dev.latency_ms;
+      return 1;
+    case SIO_SET_BITMODE_REQUEST:
+      dev.bitmode = req->wValue >> 8;
+      dev.bitmask = req->wValue & 0xFF;
+      if ((dev.bitmode == BITMODE_MPSSE || dev.bitmode == BITMODE_SYNCFF) && dev.cfg.type != USBSIM_FT232H)
+      {
+        dev.bitmode = BITMODE_RESET;
+        return -1;
+      }
+      dev.mpsse_loopback = 0;
+      dev.mpsse_left     = 0;
+      return 0;
+    case SIO_READ_PINS_REQUEST:
+      data[0] = dev.pins;
+      return 1;
+    case SIO_READ_EEPROM_REQUEST:
+      data[0] = 0xFF;
+      data[1] = 0xFF;
+      return 2;
+  }
+  return -1;
+}
+
+/* CH34x vendor requests */
+
+static void _ch34x_apply_regs(void)
+{
+  unsigned char ps  = dev.regs[CH34X_REG_PRESCALER];
+  unsigned char lcr = dev.regs[CH34X_REG_LCR];
+  unsigned int div  = 0x100 - dev.regs[CH34X_REG_DIVISOR];
+  int brk;
+
+  dev.baudrate = 48000000 / ((1 << (12 - 3 * (ps & 3) - ((ps >> 2) & 1))) * div);
+
+  dev.char_bits = 2 * (1 + 5 + (lcr & 3) + ((lcr & CH34X_LCR_ENABLE_PAR) ? 1 : 0))
+                  + ((lcr & CH34X_LCR_STOP_BITS_2) ? 4 : 2);
+  _update_char_time();
+
+  dev.flowctrl = (dev.regs[CH34X_REG_FLOW_CTL] & CH34X_FLOW_CTL_RTSCTS) ? FLOW_RTS_CTS : FLOW_NONE;
+
+  brk = !(dev.regs[CH34X_REG_BREAK] & CH34X_NBREAK_BITS) || !(lcr & CH34X_LCR_ENABLE_TX);
+  if (brk && !dev.break_on && dev.cfg.loopback)
+    _rx_char(0, RX_ERR_BI | RX_ERR_FE);
+  dev.break_on = brk;
+}
+
+static unsigned char _ch34x_read_reg(unsigned char reg)
+{
+  if (reg == 0x06)
+    return ~_modem_status();
+  return dev.regs[reg];
+}
+
+static int _ch34x_control(const SceUsbdDeviceRequest *req, unsigned char *data)
+{
+  switch (req->bRequest)
+  {
+    case CH34X_REQ_READ_VERSION:
+      data[0] = 0x31;
+      data[1] = 0x00;
+      return 2;
+    case CH34X_REQ_SERIAL_INIT:
+      _fifo_clear(&dev.rx);
+      _fifo_clear(&dev.tx);
+      return 0;
+    case CH34X_REQ_WRITE_REG:
+      dev.regs[req->wValue & 0xFF] = req->wIndex & 0xFF;
+      dev.regs[req->wValue >> 8]   = req->wIndex >> 8;
+      _ch34x_apply_regs();
+      return 0;
+    case CH34X_REQ_READ_REG:
+      data[0] = _ch34x_read_reg(req->wValue & 0xFF);
+      if (req->wLength > 1)
+        data[1] = _ch34x_read_reg(req->wValue >> 8);
+      return req->wLength > 1 ? 2 : 1;
+    case CH34X_REQ_MODEM_CTRL:
+      // active low
+      dev.dtr = !(req->wValue & CH34X_BIT_DTR);
+      dev.rts = !(req->wValue & CH34X_BIT_RTS);
+      return 0;
+  }
+  return -1;
+}
+
+int simdev_control(const SceUsbdDeviceRequest *req, unsigned char *data)
+{
+  dev.control_requests++;
+
+  if ((req->bmRequestType & 0x60) == SCE_USBD_REQTYPE_TYPE_STANDARD)
+    return req->bRequest == 0x09 ? 0 : -1; // SET_CONFIGURATION
+
+  if ((req->bmRequestType & 0x80) && req->wLength && !data)
+    return -1;
+
+  return _is_ftdi() ? _ftdi_control(req, data) : _ch34x_control(req, data);
+}
+
+/* Descriptors */
+
+static unsigned char *_put16(unsigned char *p, unsigned short v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static unsigned char *_put_endpoint(unsigned char *p, unsigned char addr, unsigned char attr, unsigned short mps,
+                                    unsigned char interval)
+{
+  *p++ = 7;
+  *p++ = SCE_USBD_DESCRIPTOR_ENDPOINT;
+  *p++ = addr;
+  *p++ = attr;
+  p    = _put16(p, mps);
+  *p++ = interval;
+  return p;
+}
+
+static void _build_descriptors(unsigned short vid, unsigned short pid, unsigned short bcd, int serial)
+{
+  unsigned char *p = dev.desc;
+  unsigned char *cfg;
+  int ch34x = !_is_ftdi();
+
+  *p++ = 18;
+  *p++ = SCE_USBD_DESCRIPTOR_DEVICE;
+  p    = _put16(p, 0x0200);
+  *p++ = ch34x ? 0xFF : 0x00;
+  *p++ = 0;
+  *p++ = 0;
+  *p++ = dev.high_speed ? 64 : 8;
+  p    = _put16(p, vid);
+  p    = _put16(p, pid);
+  p    = _put16(p, bcd);
+  *p++ = 1;
+  *p++ = 2;
+  *p++ = serial ? 3 : 0;
+  *p++ = 1;
+
+  cfg  = p;
+  *p++ = 9;
+  *p++ = SCE_USBD_DESCRIPTOR_CONFIGURATION;
+  p += 2; // wTotalLength
+  *p++ = 1;
+  *p++ = 1;
+  *p++ = 0;
+  *p++ = 0x80;
+  *p++ = 45;
+
+  *p++ = 9;
+  *p++ = SCE_USBD_DESCRIPTOR_INTERFACE;
+  *p++ = 0;
+  *p++ = 0;
+  *p++ = ch34x ? 3 : 2;
+  *p++ = 0xFF;
+  *p++ = ch34x ? 0x01 : 0xFF;
+  *p++ = ch34x ? 0x02 : 0xFF;
+  *p++ = 2;
+
+  if (ch34x)
+  {
+    p = _put_endpoint(p, 0x82, 2, dev.mps, 0);
+    p = _put_endpoint(p, 0x02, 2, dev.mps, 0);
+    p = _put_endpoint(p, 0x81, 3, 8, 1);
+  }
+  else
+  {
+    p = _put_endpoint(p, 0x81, 2, dev.mps, 0);
+    p = _put_endpoint(p, 0x02, 2, dev.mps, 0);
+  }
+
+  _put16(cfg + 2, p - cfg);
+  dev.desc_len = p - dev.desc;
+}
+
+/* Lifecycle */
+
+static void _free_all(void)
+{
+  simChunk *c = dev.inject_head;
+  while (c)
+  {
+    simChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  _fifo_free(&dev.rx);
+  _fifo_free(&dev.tx);
+  _fifo_free(&dev.capture);
+}
+
+int simdev_configure(const usbsimConfig *cfg, int64_t now)
+{
+  unsigned int rx_fifo, tx_fifo;
+
+  _free_all();
+  memset(&dev, 0, sizeof(dev));
+  dev.cfg = *cfg;
+
+  switch (cfg->type)
+  {
+    case USBSIM_FT232R:
+      dev.mps = 64;
+      rx_fifo = 256;
+      tx_fifo = 128;
+      _build_descriptors(0x0403, 0x6001, 0x0600, 1);
+      break;
+    case USBSIM_FT232H:
+      dev.mps        = 512;
+      dev.high_speed = 1;
+      rx_fifo        = 1024;
+      tx_fifo        = 1024;
+      _build_descriptors(0x0403, 0x6014, 0x0900, 1);
+      break;
+    case USBSIM_CH340:
+      dev.mps = 32;
+      rx_fifo = 128;
+      tx_fifo = 128;
+      _build_descriptors(0x1a86, 0x7523, 0x0254, 0);
+      break;
+    default:
+      return -1;
+  }
+
+  if (cfg->rx_fifo)
+    rx_fifo = cfg->rx_fifo;
+  if (cfg->tx_fifo)
+    tx_fifo = cfg->tx_fifo;
+
+  if (_fifo_init(&dev.rx, rx_fifo) < 0 || _fifo_init(&dev.tx, tx_fifo) < 0
+      || _fifo_init(&dev.capture, SIM_CAPTURE_SIZE) < 0)
+  {
+    _free_all();
+    return -1;
+  }
+
+  // power-on defaults: 9600 8N1, 16 ms latency timer
+  dev.baudrate   = 9600;
+  dev.char_bits  = 20;
+  dev.latency_ms = 16;
+  dev.pins       = 0xFF;
+  dev.peer_baud  = cfg->peer_baud;
+  dev.bus_rate   = dev.high_speed ? HS_BULK_BYTES_PER_US : FS_BULK_BYTES_PER_US;
+  dev.last_tick  = now;
+  dev.last_flush = now;
+  dev.tx_next    = now;
+  dev.peer_next  = now;
+  dev.ff_last    = now;
+  dev.regs[CH34X_REG_BREAK]     = CH34X_NBREAK_BITS;
+  dev.regs[CH34X_REG_LCR]       = CH34X_LCR_ENABLE_RX | CH34X_LCR_ENABLE_TX | CH34X_LCR_CS8;
+  dev.ch34x_reported_msr        = -1;
+  _update_char_time();
+
+  dev.present = 1;
+  return 0;
+}
+
+void simdev_remove(void)
+{
+  dev.present = 0;
+}
+
+int simdev_present(void)
+{
+  return dev.present;
+}
+
+const unsigned char *simdev_descriptors(unsigned int *len)
+{
+  *len = dev.desc_len;
+  return dev.present ? dev.desc : NULL;
+}
+
+unsigned int simdev_frame_us(void)
+{
+  if (dev.cfg.frame_us)
+    return dev.cfg.frame_us;
+  return dev.high_speed ? 125 : 1000;
+}
+
+/* Test bench side */
+
+int usbsim_inject(const void *data, unsigned int len, unsigned int delay_us)
+{
+  simChunk *chunk = malloc(sizeof(*chunk) + len);
+  if (!chunk)
+    return -1;
+  memcpy(chunk->data, data, len);
+  chunk->next     = NULL;
+  chunk->start    = 0;
+  chunk->delay_us = delay_us;
+  chunk->len      = len;
+  chunk->pos      = 0;
+
+  usbsim_lock();
+  if (!dev.present || !len)
+  {
+    usbsim_unlock();
+    free(chunk);
+    return dev.present ? 0 : USBSIM_ERROR_NO_DEVICE;
+  }
+  if (dev.inject_tail)
+    dev.inject_tail->next = chunk;
+  else
+    dev.inject_head = chunk;
+  dev.inject_tail = chunk;
+  dev.inject_pending += len;
+  usbsim_kick();
+  usbsim_unlock();
+  return len;
+}
+
+unsigned int usbsim_inject_pending(void)
+{
+  usbsim_lock();
+  unsigned int n = dev.inject_pending;
+  usbsim_unlock();
+  return n;
+}
+
+int usbsim_capture(void *data, unsigned int len)
+{
+  unsigned char *p = data;
+  unsigned int n   = 0;
+
+  usbsim_lock();
+  while (n < len && dev.capture.count)
+    p[n++] = _fifo_get(&dev.capture, NULL);
+  usbsim_unlock();
+  return n;
+}
+
+void usbsim_set_modem_status(int msr)
+{
+  usbsim_lock();
+  dev.peer_msr = msr & 0x0F;
+  usbsim_kick();
+  usbsim_unlock();
+}
+
+void usbsim_set_peer_baud(unsigned int baud)
+{
+  usbsim_lock();
+  dev.peer_baud = baud;
+  usbsim_unlock();
+}
+
+void usbsim_get_status(usbsimStatus *status)
+{
+  usbsim_lock();
+  status->baudrate         = dev.baudrate;
+  status->char_bits        = dev.char_bits;
+  status->latency_ms       = dev.latency_ms;
+  status->bitmode          = dev.bitmode << 8 | dev.bitmask;
+  status->flowctrl         = dev.flowctrl;
+  status->dtr              = dev.dtr;
+  status->rts              = dev.rts;
+  status->break_on         = dev.break_on;
+  status->rx_level         = dev.rx.count;
+  status->tx_level         = dev.tx.count;
+  status->overruns         = dev.overruns;
+  status->control_requests = dev.control_requests;
+  usbsim_unlock();
+}
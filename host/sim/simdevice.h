@@ -0,0 +1,54 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SIMDEVICE_H__
+#define __SIMDEVICE_H__
+
+#include <psp2kern/usbd.h>
+#include <stdint.h>
+
+#include "usbsim.h"
+
+/*
+ * Device side of the simulation. All simdev_* calls are made with the usbd
+ * engine lock held (usbsim_lock), times are in microseconds.
+ */
+
+void usbsim_lock(void);
+void usbsim_unlock(void);
+// wake the engine after changing device state from outside
+void usbsim_kick(void);
+
+int simdev_configure(const usbsimConfig *cfg, int64_t now);
+void simdev_remove(void);
+int simdev_present(void);
+const unsigned char *simdev_descriptors(unsigned int *len);
+unsigned int simdev_frame_us(void);
+
+// advance the UART and FIFOs to now
+void simdev_tick(int64_t now);
+// handle a control request, returns the data stage length or <0 to stall
+int simdev_control(const SceUsbdDeviceRequest *req, unsigned char *data);
+// bulk OUT: returns the number of bytes the chip accepted
+unsigned int simdev_out(const unsigned char *data, unsigned int len, int64_t now);
+// bulk IN: appends to buf, returns 1 when the transfer completes
+int simdev_in(unsigned char *buf, unsigned int len, unsigned int *actual, int64_t now);
+// interrupt IN: returns the report length or 0 when nothing changed
+int simdev_intr(unsigned char *buf, unsigned int len);
+
+#endif // __SIMDEVICE_H__
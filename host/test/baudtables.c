@@ -0,0 +1,86 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The compile-time divisor tables must match the runtime calculation for
+ * every entry. The drivers are included to reach their static tables.
+ */
+
+#include "devices/ftdi.c"
+#include "devices/ch34x.c"
+
+#include <stdio.h>
+
+static int failures;
+
+static void _check_ftdi(const char *name, enum ftdi_chip_type type, const ftdiBaud *table, int count)
+{
+  serialDevice dev;
+  int i;
+
+  memset(&dev, 0, sizeof(dev));
+  dev.ftdi_type = type;
+
+  for (i = 0; i < count; i++)
+  {
+    unsigned long encoded_divisor;
+    int actual = _ftdi_calc_baudrate(&dev, table[i].baudrate, &encoded_divisor);
+
+    if (actual != table[i].actual || encoded_divisor != table[i].encoded_divisor)
+    {
+      printf("%s %d: table %d/0x%05lx, runtime %d/0x%05lx\n", name, table[i].baudrate, table[i].actual,
+             table[i].encoded_divisor, actual, encoded_divisor);
+      failures++;
+    }
+  }
+}
+
+static void _check_ch34x(void)
+{
+  serialDevice dev;
+  unsigned int i;
+
+  memset(&dev, 0, sizeof(dev));
+
+  for (i = 0; i < sizeof(ch34x_baud) / sizeof(ch34x_baud[0]); i++)
+  {
+    int divisor = _ch34x_calc_divisor(&dev, ch34x_baud[i].baudrate);
+    int actual  = divisor < 0 ? -1 : CH34X_DIVISOR_RATE(divisor);
+
+    if (actual != ch34x_baud[i].actual || divisor != ch34x_baud[i].divisor)
+    {
+      printf("ch34x %d: table %d/0x%04x, runtime %d/0x%04x\n", ch34x_baud[i].baudrate, ch34x_baud[i].actual,
+             ch34x_baud[i].divisor, actual, divisor);
+      failures++;
+    }
+  }
+}
+
+int main(void)
+{
+  _check_ftdi("ftdi", TYPE_R, ftdi_baud_c, sizeof(ftdi_baud_c) / sizeof(ftdi_baud_c[0]));
+  _check_ftdi("ftdi-h", TYPE_232H, ftdi_baud_h, sizeof(ftdi_baud_h) / sizeof(ftdi_baud_h[0]));
+  _check_ch34x();
+
+  if (failures)
+  {
+    printf("%d divisor table entries differ\n", failures);
+    return 1;
+  }
+  return 0;
+}
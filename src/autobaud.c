@@ -0,0 +1,261 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "autobaud.h"
+#include "devicelist.h"
+#include "libusbserial_private.h"
+#include "ringbuf.h"
+#include "devices/ftdi.h"
+#include "devices/ch34x.h"
+
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+/* enough characters at one rate to call it without looking further */
+#define AUTOBAUD_LOCK_CHARS 16
+/* fewest characters a rate is judged on when time ran out */
+#define AUTOBAUD_MIN_CHARS 4
+/* good characters per thousand */
+#define AUTOBAUD_LOCK_QUALITY 980
+#define AUTOBAUD_MIN_QUALITY 900
+/* this many bad characters end a visit early */
+#define AUTOBAUD_REJECT_CHARS 8
+/* listen for up to this many character times per visit, plus the chip latency */
+#define AUTOBAUD_DWELL_CHARS 64
+#define AUTOBAUD_MIN_DWELL 2000 // us
+
+typedef struct
+{
+  int rate;
+  uint32_t chars;
+  uint32_t errors;
+  uint32_t bad;  // not text with AUTOBAUD_TEXT
+  uint32_t sync; // sync bytes seen
+} abCandidate;
+
+static const int default_rates[] = {115200, 57600, 38400, 19200, 9600, 4800, 2400, 1200, 230400, 460800, 921600};
+
+static abCandidate cand[AUTOBAUD_MAX_CANDIDATES];
+
+/* how much of a PARMRK marker _score has seen */
+enum
+{
+  MARK_NONE,
+  MARK_FF,
+  MARK_FF00,
+};
+static int mark;
+
+static int _set_rate(serialDevice *ctx, int rate)
+{
+  int ret = -1;
+
+  if (ctx->type == TYPE_FTDI)
+  {
+    ret = _ftdi_set_baudrate(ctx, rate);
+    if (ret == 0)
+      ret = _ftdi_tciflush();
+  }
+  else if (ctx->type == TYPE_CH34X)
+  {
+    ret = _ch34x_set_baudrate(ctx, rate);
+    // only the chip purge drops what it took at the old rate, TX is idle here
+    if (ret == 0)
+      ret = _ch34x_tcioflush(ctx);
+  }
+  // bytes taken at the old rate can't count for this one
+  ringbuf_reset();
+  mark = MARK_NONE;
+  return ret;
+}
+
+static int _is_text(unsigned char c)
+{
+  return (c >= 0x20 && c < 0x7F) || c == '\r' || c == '\n' || c == '\t';
+}
+
+/*
+ * Take what arrived into c. On FTDI the stream is PARMRK-marked: 0xFF 0x00 x
+ * is a byte from a packet with errors, 0xFF 0xFF a data 0xFF. A marker cut
+ * by the ring boundary carries over in mark to the next chunk or call.
+ */
+static void _score(serialDevice *ctx, abCandidate *c, int sync, int flags)
+{
+  unsigned char buf[256];
+  int n;
+
+  while ((n = ringbuf_available()) > 0)
+  {
+    int i;
+
+    if (n > (int)sizeof(buf))
+      n = sizeof(buf);
+    n = ringbuf_get(buf, n);
+
+    for (i = 0; i < n; i++)
+    {
+      unsigned char b = buf[i];
+      int err         = 0;
+
+      if (ctx->ftdi_parmrk)
+      {
+        if (mark == MARK_FF)
+        {
+          mark = (b == 0x00) ? MARK_FF00 : MARK_NONE;
+          if (mark == MARK_FF00)
+            continue;
+        }
+        else if (mark == MARK_FF00)
+        {
+          mark = MARK_NONE;
+          err  = 1;
+        }
+        else if (b == 0xFF)
+        {
+          mark = MARK_FF;
+          continue;
+        }
+      }
+
+      c->chars++;
+      if (err)
+        c->errors++;
+      else if ((flags & AUTOBAUD_TEXT) && !_is_text(b))
+        c->bad++;
+      if (!err && sync >= 0 && b == sync)
+        c->sync++;
+    }
+  }
+}
+
+static uint32_t _quality(const abCandidate *c, int sync)
+{
+  if (!c->chars || (sync >= 0 && !c->sync))
+    return 0;
+  return (uint64_t)(c->chars - c->errors - c->bad) * 1000 / c->chars;
+}
+
+/*
+ * Visit the candidates round robin until one is clearly right or timeout
+ * runs out, then settle on the best one seen. Returns the rate, 0 if none
+ * matched (the old rate is restored) or -1 on a USB failure.
+ */
+int autobaud_run(serialDevice *ctx, const int *candidates, int count, int sync, int flags, SceUInt timeout,
+                 struct libusbserial_autobaud_result *result)
+{
+  uint32_t start  = ksceKernelGetSystemTimeLow();
+  int old_rate    = ctx->baudrate;
+  uint8_t parmrk  = ctx->ftdi_parmrk;
+  abCandidate *best = NULL;
+  int i;
+
+  if (!candidates)
+  {
+    candidates = default_rates;
+    count      = sizeof(default_rates) / sizeof(default_rates[0]);
+  }
+
+  memset(cand, 0, sizeof(cand));
+  for (i = 0; i < count; i++)
+    cand[i].rate = candidates[i];
+
+  memset(result, 0, sizeof(*result));
+
+  // error flags per byte instead of per packet counters
+  if (ctx->type == TYPE_FTDI)
+    ctx->ftdi_parmrk = 1;
+
+  for (i = 0;; i = (i + 1) % count)
+  {
+    abCandidate *c = &cand[i];
+    SceUInt dwell  = AUTOBAUD_DWELL_CHARS * DIV_ROUND_UP(ctx->char_bits * 1000000, c->rate) + ctx->rx_latency_us;
+    uint32_t left;
+
+    if (dwell < AUTOBAUD_MIN_DWELL)
+      dwell = AUTOBAUD_MIN_DWELL;
+
+    left = timeout - (ksceKernelGetSystemTimeLow() - start);
+    if ((int32_t)left <= 0)
+      break;
+    if (dwell > left)
+      dwell = left;
+
+    if (_set_rate(ctx, c->rate) < 0)
+    {
+      // a rate this chip can't do is skipped
+      if (ctx->in_pipe_id > 0)
+        continue;
+      ctx->ftdi_parmrk = parmrk;
+      return -1;
+    }
+    result->tried++;
+
+    // leave as soon as the rate is plainly right or plainly wrong
+    for (;;)
+    {
+      _score(ctx, c, sync, flags);
+      if (c->chars >= AUTOBAUD_LOCK_CHARS || c->errors + c->bad >= AUTOBAUD_REJECT_CHARS)
+        break;
+      if (ringbuf_wait(AUTOBAUD_LOCK_CHARS - c->chars, AUTOBAUD_LOCK_CHARS, &dwell) < 0)
+      {
+        _score(ctx, c, sync, flags);
+        break;
+      }
+    }
+
+    if (c->chars >= AUTOBAUD_LOCK_CHARS && _quality(c, sync) >= AUTOBAUD_LOCK_QUALITY)
+    {
+      best = c;
+      break;
+    }
+    if (ctx->in_pipe_id <= 0)
+      break;
+  }
+
+  if (!best)
+  {
+    for (i = 0; i < count; i++)
+    {
+      uint32_t q = _quality(&cand[i], sync);
+
+      if (cand[i].chars < AUTOBAUD_MIN_CHARS || q < AUTOBAUD_MIN_QUALITY)
+        continue;
+      if (!best || q > _quality(best, sync) || (q == _quality(best, sync) && cand[i].chars > best->chars))
+        best = &cand[i];
+    }
+  }
+
+  // marked bytes must not reach readers
+  ctx->ftdi_parmrk = parmrk;
+  ringbuf_reset();
+
+  if (best && best->rate != ctx->baudrate && _set_rate(ctx, best->rate) < 0)
+    return -1;
+  if (!best && ctx->baudrate != old_rate && _set_rate(ctx, old_rate) < 0)
+    return -1;
+
+  if (best)
+  {
+    result->baudrate = best->rate;
+    result->chars    = best->chars;
+    result->errors   = best->errors;
+    result->quality  = _quality(best, sync);
+  }
+  result->elapsed_us = ksceKernelGetSystemTimeLow() - start;
+  return best ? best->rate : 0;
+}
@@ -0,0 +1,33 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __AUTOBAUD_H__
+#define __AUTOBAUD_H__
+
+#include "serialdevice.h"
+
+#include <psp2kern/types.h>
+
+/* Baudrate detection by scoring received data at candidate rates */
+
+#define AUTOBAUD_MAX_CANDIDATES 32
+
+int autobaud_run(serialDevice *ctx, const int *candidates, int count, int sync, int flags, SceUInt timeout,
+                 struct libusbserial_autobaud_result *result);
+
+#endif // __AUTOBAUD_H__
@@ -0,0 +1,188 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "crc.h"
+
+/*
+ * Slicing-by-4: table k gives the CRC of a byte followed by k zero bytes,
+ * so four input bytes cost four lookups that don't depend on each other
+ * instead of a chain of four. There is no NEON here, kernel code doesn't
+ * own the VFP/NEON state.
+ */
+static uint16_t t_modbus[4][256];
+static uint16_t t_ccitt[4][256];
+static uint32_t t_crc32[4][256];
+
+// CRC over data followed by its own CRC, as crc_final() gives it
+#define CRC32_RESIDUE 0x2144DF1C
+
+void crc_init(void)
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+  {
+    uint32_t r = i;
+    uint32_t c = i;
+    uint32_t n = i << 8;
+
+    for (k = 0; k < 8; k++)
+    {
+      r = (r & 1) ? (r >> 1) ^ 0xA001 : r >> 1;
+      c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+      n = (n & 0x8000) ? (n << 1) ^ 0x1021 : n << 1;
+    }
+    t_modbus[0][i] = r;
+    t_crc32[0][i]  = c;
+    t_ccitt[0][i]  = n;
+  }
+
+  for (k = 1; k < 4; k++)
+  {
+    for (i = 0; i < 256; i++)
+    {
+      t_modbus[k][i] = (t_modbus[k - 1][i] >> 8) ^ t_modbus[0][t_modbus[k - 1][i] & 0xFF];
+      t_crc32[k][i]  = (t_crc32[k - 1][i] >> 8) ^ t_crc32[0][t_crc32[k - 1][i] & 0xFF];
+      t_ccitt[k][i]  = (t_ccitt[k - 1][i] << 8) ^ t_ccitt[0][t_ccitt[k - 1][i] >> 8];
+    }
+  }
+}
+
+int crc_len(enum crc_type type)
+{
+  switch (type)
+  {
+  case CRC16_MODBUS:
+  case CRC16_CCITT:
+  case CRC16_XMODEM:
+    return 2;
+  case CRC32_IEEE:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+uint32_t crc_start(enum crc_type type)
+{
+  switch (type)
+  {
+  case CRC16_MODBUS:
+  case CRC16_CCITT:
+    return 0xFFFF;
+  case CRC32_IEEE:
+    return 0xFFFFFFFF;
+  default:
+    return 0;
+  }
+}
+
+/* reflected 16 bit, the register lines up with the first two bytes */
+static uint32_t _update_modbus(uint32_t crc, const unsigned char *p, int len)
+{
+  for (; len >= 4; len -= 4, p += 4)
+  {
+    uint32_t c = crc ^ (p[0] | p[1] << 8);
+    crc = t_modbus[3][c & 0xFF] ^ t_modbus[2][c >> 8] ^ t_modbus[1][p[2]] ^ t_modbus[0][p[3]];
+  }
+  while (len--)
+    crc = (crc >> 8) ^ t_modbus[0][(crc ^ *p++) & 0xFF];
+  return crc;
+}
+
+/* MSB first 16 bit */
+static uint32_t _update_ccitt(uint32_t crc, const unsigned char *p, int len)
+{
+  for (; len >= 4; len -= 4, p += 4)
+  {
+    uint32_t c = crc ^ (p[0] << 8 | p[1]);
+    crc = t_ccitt[3][c >> 8] ^ t_ccitt[2][c & 0xFF] ^ t_ccitt[1][p[2]] ^ t_ccitt[0][p[3]];
+  }
+  while (len--)
+    crc = ((crc << 8) & 0xFFFF) ^ t_ccitt[0][(crc >> 8) ^ *p++];
+  return crc;
+}
+
+static uint32_t _update_crc32(uint32_t crc, const unsigned char *p, int len)
+{
+  for (; len >= 4; len -= 4, p += 4)
+  {
+    uint32_t c = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+    crc = t_crc32[3][c & 0xFF] ^ t_crc32[2][(c >> 8) & 0xFF] ^ t_crc32[1][(c >> 16) & 0xFF] ^ t_crc32[0][c >> 24];
+  }
+  while (len--)
+    crc = (crc >> 8) ^ t_crc32[0][(crc ^ *p++) & 0xFF];
+  return crc;
+}
+
+uint32_t crc_update(enum crc_type type, uint32_t crc, const unsigned char *buf, int len)
+{
+  switch (type)
+  {
+  case CRC16_MODBUS:
+    return _update_modbus(crc, buf, len);
+  case CRC16_CCITT:
+  case CRC16_XMODEM:
+    return _update_ccitt(crc, buf, len);
+  case CRC32_IEEE:
+    return _update_crc32(crc, buf, len);
+  default:
+    return crc;
+  }
+}
+
+uint32_t crc_final(enum crc_type type, uint32_t crc)
+{
+  return type == CRC32_IEEE ? ~crc : crc;
+}
+
+/* Is crc, taken over a frame including its trailing CRC, the one of a good frame */
+int crc_check(enum crc_type type, uint32_t crc)
+{
+  return crc_final(type, crc) == (type == CRC32_IEEE ? CRC32_RESIDUE : 0);
+}
+
+/* Store a final CRC in wire order, LSB first for the reflected ones */
+void crc_put(enum crc_type type, uint32_t crc, unsigned char *out)
+{
+  switch (type)
+  {
+  case CRC16_MODBUS:
+    out[0] = crc & 0xFF;
+    out[1] = crc >> 8;
+    break;
+  case CRC16_CCITT:
+  case CRC16_XMODEM:
+    out[0] = crc >> 8;
+    out[1] = crc & 0xFF;
+    break;
+  case CRC32_IEEE:
+    out[0] = crc & 0xFF;
+    out[1] = crc >> 8;
+    out[2] = crc >> 16;
+    out[3] = crc >> 24;
+    break;
+  default:
+    break;
+  }
+}
+
+uint16_t crc16_modbus(const unsigned char *buf, int len)
+{
+  return _update_modbus(0xFFFF, buf, len);
+}
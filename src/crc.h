@@ -0,0 +1,37 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#include "libusbserial.h"
+
+#include <stdint.h>
+
+void crc_init(void);
+
+int crc_len(enum crc_type type);
+uint32_t crc_start(enum crc_type type);
+uint32_t crc_update(enum crc_type type, uint32_t crc, const unsigned char *buf, int len);
+uint32_t crc_final(enum crc_type type, uint32_t crc);
+int crc_check(enum crc_type type, uint32_t crc);
+void crc_put(enum crc_type type, uint32_t crc, unsigned char *out);
+
+uint16_t crc16_modbus(const unsigned char *buf, int len);
+
+#endif // __CRC_H__
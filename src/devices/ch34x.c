@@ -19,6 +19,7 @@
 #include "../libusbserial.h"
 #include "../libusbserial_private.h"
 #include "../serialdevice.h"
+#include "../softflow.h"
 #include "ch34x.h"
 
 #include <psp2kern/kernel/cpu.h>
@@ -64,7 +65,57 @@ static uint32_t clamp_val(uint32_t val, uint32_t min, uint32_t max)
  *      2 <= div <= 256 if fact = 0, or
  *      9 <= div <= 256 if fact = 1
  */
-static int _ch34x_get_divisor(serialDevice *ctx, uint32_t speed)
+
+/*
+ * Compile-time form of _ch34x_calc_divisor() without quirks, for the
+ * divisor table below. Must agree with the function for every rate in
+ * COMMON_BAUDRATES.
+ */
+#define CH34X_PS(s)                                                                                                    \
+    ((s) > CH34X_MIN_RATE(3) ? 3 : (s) > CH34X_MIN_RATE(2) ? 2 : (s) > CH34X_MIN_RATE(1) ? 1 : 0)
+#define CH34X_DIV1(s)   (CH34X_CLKRATE / (CH34X_CLK_DIV(CH34X_PS(s), 1) * (s)))
+#define CH34X_HALVE(s)  (CH34X_DIV1(s) < 9 || CH34X_DIV1(s) > 255)
+#define CH34X_FACT(s)   (CH34X_HALVE(s) ? 0 : 1)
+#define CH34X_DIV(s)    (CH34X_HALVE(s) ? CH34X_DIV1(s) / 2 : CH34X_DIV1(s))
+#define CH34X_CDIV(s)   CH34X_CLK_DIV(CH34X_PS(s), CH34X_FACT(s))
+#define CH34X_RDIV(s)                                                                                                  \
+    (CH34X_DIV(s) + (16 * CH34X_CLKRATE / (CH34X_CDIV(s) * CH34X_DIV(s)) - 16 * (s) >=                                 \
+                     16 * (s) - 16 * CH34X_CLKRATE / (CH34X_CDIV(s) * (CH34X_DIV(s) + 1))))
+#define CH34X_DIVISOR(s)                                                                                               \
+    (CH34X_FACT(s) == 1 && CH34X_RDIV(s) % 2 == 0 ? (0x100 - CH34X_RDIV(s) / 2) << 8 | CH34X_PS(s)                   \
+                                                  : (0x100 - CH34X_RDIV(s)) << 8 | CH34X_FACT(s) << 2 | CH34X_PS(s))
+
+/* Line rate of a divisor register value, rounded */
+#define CH34X_DIVISOR_CLK(v)  (CH34X_CLK_DIV((v) & 3, ((v) >> 2) & 1) * (0x100 - (((v) >> 8) & 0xFF)))
+#define CH34X_DIVISOR_RATE(v) ((CH34X_CLKRATE + CH34X_DIVISOR_CLK(v) / 2) / CH34X_DIVISOR_CLK(v))
+
+typedef struct
+{
+    int baudrate;
+    int actual;
+    int divisor;
+} ch34xBaud;
+
+#define CH34X_ENTRY(b) {b, CH34X_DIVISOR_RATE(CH34X_DIVISOR(b)), CH34X_DIVISOR(b)},
+
+static const ch34xBaud ch34x_baud[] = {COMMON_BAUDRATES(CH34X_ENTRY)};
+
+static const ch34xBaud *_ch34x_baud_lookup(serialDevice *ctx, uint32_t speed)
+{
+    unsigned int i;
+
+    if (ctx->ch34x_quirks & CH34X_QUIRK_LIMITED_PRESCALER)
+        return NULL;
+
+    for (i = 0; i < sizeof(ch34x_baud) / sizeof(ch34x_baud[0]); i++) {
+        if (ch34x_baud[i].baudrate == speed)
+            return &ch34x_baud[i];
+    }
+    return NULL;
+}
+
+/* Runtime divisor calculation, the table above is checked against it */
+static int _ch34x_calc_divisor(serialDevice *ctx, uint32_t speed)
 {
     uint32_t fact, div, clk_div;
     uint8_t force_fact0 = 0;
@@ -128,6 +179,34 @@ static int _ch34x_get_divisor(serialDevice *ctx, uint32_t speed)
     return (0x100 - div) << 8 | fact << 2 | ps;
 }
 
+static int _ch34x_get_divisor(serialDevice *ctx, uint32_t speed)
+{
+    const ch34xBaud *entry = _ch34x_baud_lookup(ctx, speed);
+
+    if (entry)
+        return entry->divisor;
+    return _ch34x_calc_divisor(ctx, speed);
+}
+
+int _ch34x_query_baudrate(serialDevice *ctx, int baudrate)
+{
+    const ch34xBaud *entry;
+    int val;
+
+    if (baudrate <= 0)
+        return -1;
+
+    entry = _ch34x_baud_lookup(ctx, baudrate);
+    if (entry)
+        return entry->actual;
+
+    val = _ch34x_get_divisor(ctx, baudrate);
+    if (val < 0)
+        return -1;
+
+    return CH34X_DIVISOR_RATE(val);
+}
+
 static int _ch34x_set_baudrate_lcr(serialDevice *ctx, uint32_t baud_rate, uint8_t lcr)
 {
     int val;
@@ -154,6 +233,8 @@ static int _ch34x_set_baudrate_lcr(serialDevice *ctx, uint32_t baud_rate, uint8_
     if (r < 0)
         return -1;
 
+    ctx->actual_baudrate = CH34X_DIVISOR_RATE(val);
+
     /*
      * Chip versions before version 0x30 as read using
      * CH341_REQ_READ_VERSION used separate registers for line control
@@ -177,7 +258,7 @@ static int _ch34x_set_handshake(uint8_t control)
     return 0;
 }
 
-static int _ch34x_get_status(serialDevice *ctx)
+int _ch34x_get_status(serialDevice *ctx)
 {
     const uint32_t size = 2;
     unsigned char buffer[64] __attribute__((aligned(64)));
@@ -291,11 +372,6 @@ static int _ch34x_set_flow_control(serialDevice* ctx, uint16_t flow_ctl)
 {
     int r;
 
-//    if (C_CRTSCTS(tty))
-//        flow_ctl = CH34X_FLOW_CTL_RTSCTS;
-//    else
-//        flow_ctl = CH34X_FLOW_CTL_NONE;
-
     r = _control_transfer(SCE_USBD_REQTYPE_TYPE_VENDOR | SCE_USBD_REQTYPE_RECIP_DEVICE | SCE_USBD_REQTYPE_DIR_TO_DEVICE, CH34X_REQ_WRITE_REG, (CH34X_REG_FLOW_CTL << 8) | CH34X_REG_FLOW_CTL, (flow_ctl << 8) | flow_ctl, NULL, 0);
     if (r < 0) return -1;
     return 0;
@@ -371,28 +447,96 @@ int _ch34x_set_line_property(serialDevice* ctx, enum bits_type bits, enum stopbi
   return r;
 }
 
-int _ch34x_tciflush()
+/*
+ * CH34x has no per-direction purge request. Re-running serial init drops
+ * both UART FIFOs, after that line settings, modem control and flow
+ * control have to be written again.
+ */
+static int _ch34x_purge(serialDevice* ctx)
 {
-    // TODO
-    return 0;
+    int r;
+
+    r = _control_transfer(SCE_USBD_REQTYPE_TYPE_VENDOR | SCE_USBD_REQTYPE_RECIP_DEVICE | SCE_USBD_REQTYPE_DIR_TO_DEVICE, CH34X_REQ_SERIAL_INIT, 0, 0, NULL, 0);
+    if (r < 0)
+        return -1;
+
+    r = _ch34x_set_baudrate_lcr(ctx, ctx->baudrate, ctx->ch34x_lcr);
+    if (r < 0)
+        return -1;
+
+    r = _ch34x_set_handshake(ctx->ch34x_mcr);
+    if (r < 0)
+        return -1;
+
+    return _ch34x_set_flow_control(ctx, (ctx->flowctrl & FLOW_RTS_CTS) ? CH34X_FLOW_CTL_RTSCTS : CH34X_FLOW_CTL_NONE);
 }
 
-int _ch34x_tcoflush()
+/*
+ * SERIAL_INIT empties both chip FIFOs, there is no RX-only purge. So
+ * tciflush leaves the chip alone and the caller drops what the driver holds;
+ * the few bytes still in the chip arrive afterwards.
+ */
+int _ch34x_tciflush(serialDevice* ctx)
 {
-    // TODO
+    softflow_release_rx(ctx);
     return 0;
 }
 
+/* Also drops input the chip hasn't sent yet */
+int _ch34x_tcoflush(serialDevice* ctx)
+{
+    int r = _ch34x_purge(ctx);
+
+    softflow_release_tx(ctx);
+    return r;
+}
+
+int _ch34x_tcioflush(serialDevice* ctx)
+{
+    int r = _ch34x_purge(ctx);
+
+    // after the purge, which would drop a queued XON too
+    softflow_release_rx(ctx);
+    softflow_release_tx(ctx);
+    return r;
+}
+
 int _ch34x_setflowctrl(serialDevice* ctx, int flowctrl)
 {
-  uint16_t flow_ctl = 0;
-  return _ch34x_set_flow_control(ctx, flow_ctl);
+    uint16_t flow_ctl = CH34X_FLOW_CTL_NONE;
+
+    // no DSR/DTR handshake in hardware
+    if (flowctrl & FLOW_DTR_DSR)
+        return -1;
+
+    if (flowctrl & FLOW_RTS_CTS)
+        flow_ctl = CH34X_FLOW_CTL_RTSCTS;
+
+    if (_ch34x_set_flow_control(ctx, flow_ctl) < 0)
+        return -1;
+
+    ctx->flowctrl = flowctrl;
+
+    if (flowctrl & FLOW_XON_XOFF)
+        return _ch34x_setflowctrl_xonxoff(ctx, 0x11, 0x13);
+
+    softflow_release_rx(ctx);
+    ctx->soft_flow = 0;
+    softflow_release_tx(ctx);
+    return 0;
 }
 
 int _ch34x_setflowctrl_xonxoff(serialDevice* ctx, unsigned char xon, unsigned char xoff)
 {
-    // TODO
-    return -1;
+    // no XON/XOFF in hardware, emulated in RX/TX paths. A throttled peer
+    // is released with the XON it was stopped with
+    softflow_release_rx(ctx);
+    ctx->xon_char  = xon;
+    ctx->xoff_char = xoff;
+    softflow_release_tx(ctx);
+    ctx->flowctrl |= FLOW_XON_XOFF;
+    ctx->soft_flow = 1;
+    return 0;
 }
 
 int _ch34x_setdtr_rts(serialDevice* ctx, int dtr, int rts)
@@ -429,7 +573,38 @@ int _ch34x_setrts(serialDevice* ctx, int rtsstate)
 
 }
 
+/*
+ * Interrupt endpoint packet: data[1] has CH34X_MULT_STAT when more than one
+ * status change was latched, data[2] is the inverted modem status.
+ * Returns 1 if modem status changed.
+ */
+int _ch34x_update_status(serialDevice* ctx, unsigned char *data, int len)
+{
+    uint8_t status;
+    uint8_t delta;
+
+    if (len < 4)
+        return 0;
+
+    status = (~data[2]) & CH34X_BITS_MODEM_STAT;
+    delta = status ^ ctx->ch34x_msr;
+    ctx->ch34x_msr = status;
+    ctx->line_status.modem_status = status;
+
+    if (data[1] & CH34X_MULT_STAT)
+    {
+        trace("multiple status change\n");
+    }
+
+    return delta != 0;
+}
+
 unsigned int _ch34x_determine_max_packet_size(serialDevice* ctx)
 {
     return 32; // TODO
 }
+
+unsigned int _ch34x_determine_tx_fifo_size(serialDevice* ctx)
+{
+    return 128;
+}
@@ -69,16 +69,21 @@
 
 
 unsigned int _ch34x_determine_max_packet_size(serialDevice* ctx);
+unsigned int _ch34x_determine_tx_fifo_size(serialDevice* ctx);
 int _ch34x_reset(serialDevice* ctx);
 int _ch34x_set_baudrate(serialDevice* ctx, int baudrate);
+int _ch34x_query_baudrate(serialDevice* ctx, int baudrate);
 int _ch34x_set_line_property(serialDevice* ctx, enum bits_type bits, enum stopbits_type sbit, enum parity_type parity, enum break_type break_type);
-int _ch34x_tciflush();
-int _ch34x_tcoflush();
+int _ch34x_tciflush(serialDevice* ctx);
+int _ch34x_tcoflush(serialDevice* ctx);
+int _ch34x_tcioflush(serialDevice* ctx);
 int _ch34x_setflowctrl(serialDevice* ctx, int flowctrl);
 int _ch34x_setflowctrl_xonxoff(serialDevice* ctx, unsigned char xon, unsigned char xoff);
 int _ch34x_setdtr_rts(serialDevice* ctx, int dtr, int rts);
 int _ch34x_setdtr(serialDevice* ctx, int dtrstate);
 int _ch34x_setrts(serialDevice* ctx, int rtsstate);
+int _ch34x_get_status(serialDevice* ctx);
+int _ch34x_update_status(serialDevice* ctx, unsigned char *data, int len);
 
 
 #endif // __FTDI_H__
@@ -52,6 +52,24 @@ unsigned int _ftdi_determine_max_packet_size(serialDevice* ctx)
   return packet_size;
 }
 
+unsigned int _ftdi_determine_tx_fifo_size(serialDevice* ctx)
+{
+  // transmit buffer per channel, from the datasheets
+  switch (ctx->ftdi_type)
+  {
+  case TYPE_2232H:
+    return 4096;
+  case TYPE_4232H:
+    return 2048;
+  case TYPE_232H:
+    return 1024;
+  case TYPE_230X:
+    return 512;
+  default:
+    return 128;
+  }
+}
+
 /*  ftdi_to_clkbits_AM For the AM device, convert a requested baudrate
                     to encoded divisor and the achievable baudrate
     Function is only used internally
@@ -209,24 +227,63 @@ static int _ftdi_to_clkbits(int baudrate, int clk, int clk_div, unsigned long *e
   }
   return best_baud;
 }
-/**
-    ftdi_convert_baudrate returns nearest supported baud rate to that requested.
-    Function is only used internally
-    \internal
-*/
-static int _ftdi_convert_baudrate(serialDevice* ctx, int baudrate, unsigned short *value, unsigned short *index)
+
+#define H_CLK 120000000
+#define C_CLK 48000000
+
+/*
+ * Compile-time form of _ftdi_to_clkbits() for the divisor tables below,
+ * must give the same result for every rate in COMMON_BAUDRATES.
+ */
+#define FTDI_FRAC_CODE(d) ((0x76514230 >> (((d) & 7) * 4)) & 0xF)
+#define FTDI_DIV_RAW(b, clk, cd) (((clk) * 16 / (cd) / (b) + 1) / 2)
+#define FTDI_DIV(b, clk, cd) (FTDI_DIV_RAW(b, clk, cd) > 0x20000 ? 0x1ffff : FTDI_DIV_RAW(b, clk, cd))
+#define FTDI_ENCODED(b, clk, cd)                                                                                       \
+  ((b) >= (clk) / (cd) ? 0                                                                                             \
+   : (b) >= (clk) / ((cd) + (cd) / 2) ? 1                                                                              \
+   : (b) >= (clk) / (2 * (cd)) ? 2                                                                                     \
+   : (FTDI_DIV(b, clk, cd) >> 3) | (FTDI_FRAC_CODE(FTDI_DIV(b, clk, cd)) << 14))
+#define FTDI_ACTUAL(b, clk, cd)                                                                                        \
+  ((b) >= (clk) / (cd) ? (clk) / (cd)                                                                                  \
+   : (b) >= (clk) / ((cd) + (cd) / 2) ? (clk) / ((cd) + (cd) / 2)                                                      \
+   : (b) >= (clk) / (2 * (cd)) ? (clk) / (2 * (cd))                                                                    \
+   : ((clk) * 16 / (cd) / FTDI_DIV(b, clk, cd) + 1) / 2)
+/* H types switch to the 120 MHz clock (index bit 9) above H_CLK / 10 / 0x3fff */
+#define FTDI_H_FAST(b) ((b) * 10 > H_CLK / 0x3fff)
+
+typedef struct
 {
-  int best_baud;
+  int baudrate;
+  int actual;
   unsigned long encoded_divisor;
+} ftdiBaud;
 
-  if (baudrate <= 0)
+#define FTDI_C_ENTRY(b) {b, FTDI_ACTUAL(b, C_CLK, 16), FTDI_ENCODED(b, C_CLK, 16)},
+#define FTDI_H_ENTRY(b)                                                                                                \
+  {b, FTDI_H_FAST(b) ? FTDI_ACTUAL(b, H_CLK, 10) : FTDI_ACTUAL(b, C_CLK, 16),                                         \
+   FTDI_H_FAST(b) ? (FTDI_ENCODED(b, H_CLK, 10) | 0x20000) : FTDI_ENCODED(b, C_CLK, 16)},
+
+/* BM, 2232C, R, 230X */
+static const ftdiBaud ftdi_baud_c[] = {COMMON_BAUDRATES(FTDI_C_ENTRY)};
+/* 2232H, 4232H, 232H */
+static const ftdiBaud ftdi_baud_h[] = {COMMON_BAUDRATES(FTDI_H_ENTRY) FTDI_H_ENTRY(6000000) FTDI_H_ENTRY(12000000)};
+
+static const ftdiBaud *_ftdi_baud_lookup(const ftdiBaud *table, int count, int baudrate)
+{
+  int i;
+  for (i = 0; i < count; i++)
   {
-    // Return error
-    return -1;
+    if (table[i].baudrate == baudrate)
+      return &table[i];
   }
+  return NULL;
+}
+
+/* Runtime divisor calculation, the tables above are checked against it */
+static int _ftdi_calc_baudrate(serialDevice* ctx, int baudrate, unsigned long *encoded_divisor)
+{
+  int best_baud;
 
-#define H_CLK 120000000
-#define C_CLK 48000000
   if ((ctx->ftdi_type == TYPE_2232H) || (ctx->ftdi_type == TYPE_4232H) || (ctx->ftdi_type == TYPE_232H))
   {
     if (baudrate * 10 > H_CLK / 0x3fff)
@@ -236,20 +293,53 @@ static int _ftdi_convert_baudrate(serialDevice* ctx, int baudrate, unsigned shor
          three fractional bits and a 120 MHz clock
          Assume AN_120 "Sub-integer divisors between 0 and 2 are not allowed" holds for
          DIV/10 CLK too, so /1, /1.5 and /2 can be handled the same*/
-      best_baud = _ftdi_to_clkbits(baudrate, H_CLK, 10, &encoded_divisor);
-      encoded_divisor |= 0x20000; /* switch on CLK/10*/
+      best_baud = _ftdi_to_clkbits(baudrate, H_CLK, 10, encoded_divisor);
+      *encoded_divisor |= 0x20000; /* switch on CLK/10*/
     }
     else
-      best_baud = _ftdi_to_clkbits(baudrate, C_CLK, 16, &encoded_divisor);
+      best_baud = _ftdi_to_clkbits(baudrate, C_CLK, 16, encoded_divisor);
   }
   else if ((ctx->ftdi_type == TYPE_BM) || (ctx->ftdi_type == TYPE_2232C) || (ctx->ftdi_type == TYPE_R) || (ctx->ftdi_type == TYPE_230X))
   {
-    best_baud = _ftdi_to_clkbits(baudrate, C_CLK, 16, &encoded_divisor);
+    best_baud = _ftdi_to_clkbits(baudrate, C_CLK, 16, encoded_divisor);
   }
   else
   {
-    best_baud = _ftdi_to_clkbits_AM(baudrate, &encoded_divisor);
+    best_baud = _ftdi_to_clkbits_AM(baudrate, encoded_divisor);
+  }
+  return best_baud;
+}
+
+/**
+    ftdi_convert_baudrate returns nearest supported baud rate to that requested.
+    Function is only used internally
+    \internal
+*/
+static int _ftdi_convert_baudrate(serialDevice* ctx, int baudrate, unsigned short *value, unsigned short *index)
+{
+  int best_baud;
+  unsigned long encoded_divisor;
+  const ftdiBaud *entry = NULL;
+
+  if (baudrate <= 0)
+  {
+    // Return error
+    return -1;
+  }
+
+  if ((ctx->ftdi_type == TYPE_2232H) || (ctx->ftdi_type == TYPE_4232H) || (ctx->ftdi_type == TYPE_232H))
+    entry = _ftdi_baud_lookup(ftdi_baud_h, sizeof(ftdi_baud_h) / sizeof(ftdi_baud_h[0]), baudrate);
+  else if ((ctx->ftdi_type == TYPE_BM) || (ctx->ftdi_type == TYPE_2232C) || (ctx->ftdi_type == TYPE_R) || (ctx->ftdi_type == TYPE_230X))
+    entry = _ftdi_baud_lookup(ftdi_baud_c, sizeof(ftdi_baud_c) / sizeof(ftdi_baud_c[0]), baudrate);
+
+  if (entry)
+  {
+    best_baud       = entry->actual;
+    encoded_divisor = entry->encoded_divisor;
   }
+  else
+    best_baud = _ftdi_calc_baudrate(ctx, baudrate, &encoded_divisor);
+
   // Split into "value" and "index" values
   *value = (unsigned short)(encoded_divisor & 0xFFFF);
   if (ctx->ftdi_type == TYPE_2232H || ctx->ftdi_type == TYPE_4232H || ctx->ftdi_type == TYPE_232H)
@@ -265,15 +355,9 @@ static int _ftdi_convert_baudrate(serialDevice* ctx, int baudrate, unsigned shor
   return best_baud;
 }
 
-int _ftdi_set_baudrate(serialDevice* ctx, int baudrate)
+/* Nearest rate the chip can do, -1 if that is off by more than about 5% */
+static int _ftdi_check_baudrate(int baudrate, int actual_baudrate)
 {
-  unsigned short value, index;
-  int actual_baudrate;
-
-  trace("setting baudrate %d\n", baudrate);
-
-  actual_baudrate = _ftdi_convert_baudrate(ctx, baudrate, &value, &index);
-
   if (actual_baudrate <= 0)
   {
     return -1;
@@ -287,12 +371,37 @@ int _ftdi_set_baudrate(serialDevice* ctx, int baudrate)
     return -1;
   }
 
+  return actual_baudrate;
+}
+
+int _ftdi_query_baudrate(serialDevice* ctx, int baudrate)
+{
+  unsigned short value, index;
+
+  return _ftdi_check_baudrate(baudrate, _ftdi_convert_baudrate(ctx, baudrate, &value, &index));
+}
+
+int _ftdi_set_baudrate(serialDevice* ctx, int baudrate)
+{
+  unsigned short value, index;
+  int actual_baudrate;
+
+  trace("setting baudrate %d\n", baudrate);
+
+  actual_baudrate = _ftdi_check_baudrate(baudrate, _ftdi_convert_baudrate(ctx, baudrate, &value, &index));
+
+  if (actual_baudrate < 0)
+  {
+    return -1;
+  }
+
   if (_control_transfer(FTDI_DEVICE_OUT_REQTYPE, SIO_SET_BAUDRATE_REQUEST, value, index, NULL, 0) < 0)
   {
     return -2;
   }
 
-  ctx->baudrate = baudrate;
+  ctx->baudrate        = baudrate;
+  ctx->actual_baudrate = actual_baudrate;
   return 0;
 }
 
@@ -439,3 +548,216 @@ int _ftdi_setrts(int rtsstate)
 
   return 0;
 }
+
+int _ftdi_set_bitmode(serialDevice* ctx, unsigned char bitmask, unsigned char mode)
+{
+  unsigned short usb_val;
+
+  usb_val = bitmask; // low byte: bitmask
+  usb_val |= (mode << 8);
+  if (_control_transfer(FTDI_DEVICE_OUT_REQTYPE, SIO_SET_BITMODE_REQUEST, usb_val, 0, NULL, 0) < 0)
+    return -1;
+
+  ctx->ftdi_bitmode = mode;
+  return 0;
+}
+
+int _ftdi_read_pins(unsigned char *pins)
+{
+  unsigned char buffer[64] __attribute__((aligned(64)));
+
+  if (_control_transfer(FTDI_DEVICE_IN_REQTYPE, SIO_READ_PINS_REQUEST, 0, 0, buffer, 1) < 0)
+    return -1;
+
+  *pins = buffer[0];
+  return 0;
+}
+
+static int _ftdi_read_eeprom_word(int addr, uint16_t *word)
+{
+  unsigned char buffer[64] __attribute__((aligned(64)));
+
+  buffer[0] = buffer[1] = 0xFF;
+  if (_control_transfer(FTDI_DEVICE_IN_REQTYPE, SIO_READ_EEPROM_REQUEST, 0, addr, buffer, 2) < 0)
+    return -1;
+
+  *word = buffer[0] | (buffer[1] << 8);
+  return 0;
+}
+
+/*
+ * Whether a CBUS pin is programmed as TXDEN, the chip then drives the
+ * transceiver itself. R: CBUS0-4 nibbles at bytes 0x14-0x16, function 0.
+ * 232H: ACBUS0-9 nibbles at bytes 0x18-0x1C, function 9.
+ */
+int _ftdi_has_txden(serialDevice* ctx)
+{
+  int first, pins, txden;
+  int i;
+
+  if (ctx->ftdi_type == TYPE_R)
+  {
+    first = 0x14;
+    pins  = 5;
+    txden = 0;
+  }
+  else if (ctx->ftdi_type == TYPE_232H)
+  {
+    first = 0x18;
+    pins  = 10;
+    txden = 9;
+  }
+  else
+    return 0;
+
+  // words hold two bytes of two pins each, an erased EEPROM reads 0xF
+  for (i = first & ~1; i < first + (pins + 1) / 2; i += 2)
+  {
+    uint16_t word;
+    int b;
+
+    if (_ftdi_read_eeprom_word(i / 2, &word) < 0)
+      return 0;
+
+    for (b = 0; b < 2; b++)
+    {
+      int pin         = (i + b - first) * 2;
+      unsigned char v = word >> (8 * b);
+
+      if (pin < 0 || pin >= pins)
+        continue;
+      if ((v & 0x0F) == txden || (pin + 1 < pins && (v >> 4) == txden))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+int _ftdi_set_latency_timer(serialDevice* ctx, unsigned char latency)
+{
+  if (latency < 1)
+    return -1;
+
+  if (_control_transfer(FTDI_DEVICE_OUT_REQTYPE, SIO_SET_LATENCY_TIMER_REQUEST, latency, 0, NULL, 0) < 0)
+    return -1;
+
+  ctx->rx_latency_us = latency * 1000;
+  return 0;
+}
+
+/* Decode the two header bytes, returns 1 if modem status changed */
+static inline int _ftdi_status(serialDevice* ctx, const unsigned char *hdr)
+{
+  uint8_t msr = (hdr[0] >> FTDI_RS0_MODEM_SHIFT) & 0x0F;
+  uint8_t lsr = hdr[1];
+
+  ctx->line_status.line_status = lsr;
+
+  // error bits are rare, keep the common path to one test
+  if (lsr & FTDI_RS_ERR_MASK)
+  {
+    if (lsr & FTDI_RS_OE)
+      ctx->line_status.overrun++;
+    if (lsr & FTDI_RS_PE)
+      ctx->line_status.parity++;
+    if (lsr & FTDI_RS_FE)
+      ctx->line_status.framing++;
+    if (lsr & FTDI_RS_BI)
+      ctx->line_status.breaks++;
+  }
+
+  if (msr != ctx->ftdi_msr)
+  {
+    ctx->ftdi_msr = msr;
+    ctx->line_status.modem_status = msr;
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Every packet of max_packet_size starts with two modem/line status bytes.
+ * Payload of the first packet is left in place at buf + 2, payloads of the
+ * following packets are squeezed behind it so a multi-packet transfer goes to
+ * the ring in one put. Returns the number of payload bytes at *payload.
+ */
+int _ftdi_strip_status(serialDevice* ctx, unsigned char *buf, int count, unsigned char **payload)
+{
+  unsigned int mps = ctx->max_packet_size;
+  unsigned char *dst;
+  int offset;
+
+  *payload = buf + 2;
+
+  if (count < 2)
+    return 0;
+
+  if (_ftdi_status(ctx, buf))
+    ctx->modem_changes++;
+
+  if (count <= (int)mps)
+    return count - 2;
+
+  dst = buf + mps;
+  for (offset = mps; offset < count; offset += mps)
+  {
+    int len = count - offset;
+    if (len > (int)mps)
+      len = mps;
+    if (len < 2)
+      continue;
+
+    if (_ftdi_status(ctx, buf + offset))
+      ctx->modem_changes++;
+
+    memmove(dst, buf + offset + 2, len - 2);
+    dst += len - 2;
+  }
+
+  return dst - *payload;
+}
+
+/*
+ * Slow path of _ftdi_strip_status with PARMRK-style marking into out, which
+ * must hold 3 times count. FTDI reports errors per packet, so like Linux every
+ * byte of a packet with parity/framing/break gets the marker.
+ * Overruns are not tied to a byte and only counted.
+ */
+int _ftdi_mark_errors(serialDevice* ctx, unsigned char *buf, int count, unsigned char *out)
+{
+  unsigned int mps = ctx->max_packet_size;
+  unsigned char *dst = out;
+  int offset;
+
+  for (offset = 0; offset < count; offset += mps)
+  {
+    int len = count - offset;
+    int i;
+    int err;
+    if (len > (int)mps)
+      len = mps;
+    if (len < 2)
+      continue;
+
+    if (_ftdi_status(ctx, buf + offset))
+      ctx->modem_changes++;
+
+    err = buf[offset + 1] & (FTDI_RS_PE | FTDI_RS_FE | FTDI_RS_BI);
+    for (i = 2; i < len; i++)
+    {
+      unsigned char c = buf[offset + i];
+      if (err)
+      {
+        *dst++ = 0xFF;
+        *dst++ = 0x00;
+      }
+      else if (c == 0xFF)
+      {
+        *dst++ = 0xFF;
+      }
+      *dst++ = c;
+    }
+  }
+
+  return dst - out;
+}
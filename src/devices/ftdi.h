@@ -71,9 +71,39 @@
 
 #define SIO_RTS_CTS_HS (0x1 << 8)
 
+/* Status bytes prepended to every IN packet */
+#define FTDI_RS0_CTS (1 << 4)
+#define FTDI_RS0_DSR (1 << 5)
+#define FTDI_RS0_RI (1 << 6)
+#define FTDI_RS0_RLSD (1 << 7)
+#define FTDI_RS0_MODEM_SHIFT 4
+
+#define FTDI_RS_DR 1
+#define FTDI_RS_OE (1 << 1)
+#define FTDI_RS_PE (1 << 2)
+#define FTDI_RS_FE (1 << 3)
+#define FTDI_RS_BI (1 << 4)
+#define FTDI_RS_THRE (1 << 5)
+#define FTDI_RS_TEMT (1 << 6)
+#define FTDI_RS_FIFO (1 << 7)
+#define FTDI_RS_ERR_MASK (FTDI_RS_OE | FTDI_RS_PE | FTDI_RS_FE | FTDI_RS_BI)
+
+/* MPSSE commands, see AN108 */
+#define MPSSE_DO_WRITE_BYTES_NVE_MSB 0x11
+#define MPSSE_DO_RW_BYTES_NVE_PVE_MSB 0x31
+#define MPSSE_SET_BITS_LOW 0x80
+#define MPSSE_LOOPBACK_END 0x85
+#define MPSSE_TCK_DIVISOR 0x86
+#define MPSSE_SEND_IMMEDIATE 0x87
+#define MPSSE_DIS_DIV_5 0x8A
+#define MPSSE_DIS_3_PHASE 0x8D
+#define MPSSE_DIS_ADAPTIVE 0x97
+
 unsigned int _ftdi_determine_max_packet_size(serialDevice* ctx);
+unsigned int _ftdi_determine_tx_fifo_size(serialDevice* ctx);
 int _ftdi_reset();
 int _ftdi_set_baudrate(serialDevice* ctx, int baudrate);
+int _ftdi_query_baudrate(serialDevice* ctx, int baudrate);
 int _ftdi_set_line_property(enum bits_type bits, enum stopbits_type sbit, enum parity_type parity, enum break_type break_type);
 int _ftdi_tciflush();
 int _ftdi_tcoflush();
@@ -82,6 +112,15 @@ int _ftdi_setflowctrl_xonxoff(unsigned char xon, unsigned char xoff);
 int _ftdi_setdtr_rts(int dtr, int rts);
 int _ftdi_setdtr(int dtrstate);
 int _ftdi_setrts(int rtsstate);
+int _ftdi_set_bitmode(serialDevice* ctx, unsigned char bitmask, unsigned char mode);
+int _ftdi_read_pins(unsigned char *pins);
+int _ftdi_set_latency_timer(serialDevice* ctx, unsigned char latency);
+int _ftdi_strip_status(serialDevice* ctx, unsigned char *buf, int count, unsigned char **payload);
+int _ftdi_mark_errors(serialDevice* ctx, unsigned char *buf, int count, unsigned char *out);
+int _ftdi_has_txden(serialDevice* ctx);
+int _ftdi_has_mpsse(serialDevice* ctx);
+int _ftdi_mpsse_spi_init(serialDevice* ctx, unsigned int clock_hz);
+int _ftdi_mpsse_spi_batch(serialDevice* ctx, const struct libusbserial_spi_transfer *xfers, int count, SceUInt timeout);
 
 
 #endif // __FTDI_H__
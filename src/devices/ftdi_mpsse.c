@@ -0,0 +1,245 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../libusbserial.h"
+#include "../libusbserial_private.h"
+#include "../serialdevice.h"
+#include "../ringbuf.h"
+#include "ftdi.h"
+
+#include <psp2kern/kernel/sysclib.h>
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <string.h>
+
+/* ADBUS0 SCK, ADBUS1 MOSI, ADBUS2 MISO, ADBUS3 CS */
+#define SPI_PIN_CS 0x08
+#define SPI_PINS_DIR 0x0B
+#define SPI_PINS_IDLE SPI_PIN_CS
+
+/* CS toggle, command header, CS release, send immediate */
+#define SPI_CMD_OVERHEAD (3 + 3 + 3 + 1)
+
+#define SPI_MAX_SEGMENTS 512
+
+typedef struct
+{
+  unsigned char *rx;
+  int len;
+} spiSegment;
+
+static spiSegment segments[SPI_MAX_SEGMENTS];
+/* replies a failed batch still had coming */
+static int stale = 0;
+
+int _ftdi_has_mpsse(serialDevice* ctx)
+{
+  return ctx->ftdi_type == TYPE_2232C || ctx->ftdi_type == TYPE_2232H || ctx->ftdi_type == TYPE_4232H
+         || ctx->ftdi_type == TYPE_232H;
+}
+
+static int _is_h_type(serialDevice* ctx)
+{
+  return ctx->ftdi_type == TYPE_2232H || ctx->ftdi_type == TYPE_4232H || ctx->ftdi_type == TYPE_232H;
+}
+
+int _ftdi_mpsse_spi_init(serialDevice* ctx, unsigned int clock_hz)
+{
+  unsigned char *cmd = ctx->writebuffer;
+  unsigned int divisor;
+  int len = 0;
+
+  if (!_ftdi_has_mpsse(ctx) || clock_hz == 0)
+    return -1;
+
+  if (_ftdi_set_bitmode(ctx, 0, BITMODE_RESET) < 0)
+    return -1;
+  if (_ftdi_set_bitmode(ctx, 0, BITMODE_MPSSE) < 0)
+    return -1;
+  // answers to read commands should come back immediately
+  if (_ftdi_set_latency_timer(ctx, 1) < 0)
+    return -1;
+
+  if (_is_h_type(ctx))
+  {
+    // 60 MHz base clock with divide-by-5 off: f = 60MHz / ((1 + div) * 2)
+    divisor = DIV_ROUND_UP(30000000, clock_hz);
+    cmd[len++] = MPSSE_DIS_DIV_5;
+    cmd[len++] = MPSSE_DIS_ADAPTIVE;
+    cmd[len++] = MPSSE_DIS_3_PHASE;
+  }
+  else
+  {
+    // 12 MHz base clock: f = 12MHz / ((1 + div) * 2)
+    divisor = DIV_ROUND_UP(6000000, clock_hz);
+  }
+
+  if (divisor > 0)
+    divisor--;
+  if (divisor > 0xFFFF)
+    divisor = 0xFFFF;
+
+  cmd[len++] = MPSSE_TCK_DIVISOR;
+  cmd[len++] = divisor & 0xFF;
+  cmd[len++] = (divisor >> 8) & 0xFF;
+  cmd[len++] = MPSSE_LOOPBACK_END;
+  cmd[len++] = MPSSE_SET_BITS_LOW;
+  cmd[len++] = SPI_PINS_IDLE;
+  cmd[len++] = SPI_PINS_DIR;
+
+  if (_send(cmd, len) != len)
+    return -1;
+
+  stale = 0;
+  ringbuf_reset();
+  return 0;
+}
+
+/* collect clocked-in bytes for one bulk OUT and scatter them to the user buffers */
+static int _collect(spiSegment *seg, int nseg, SceUInt timeout)
+{
+  unsigned char kbuf[64];
+  int i;
+
+  for (i = 0; i < nseg; i++)
+  {
+    int pos = 0;
+    while (pos < seg[i].len)
+    {
+      int chunk = seg[i].len - pos;
+      if (chunk > (int)sizeof(kbuf))
+        chunk = sizeof(kbuf);
+
+      int ret = ringbuf_get_wait(kbuf, chunk, timeout);
+      if (ret <= 0)
+      {
+        stale = seg[i].len - pos;
+        while (++i < nseg)
+          stale += seg[i].len;
+        return -1;
+      }
+
+      ksceKernelMemcpyKernelToUser(seg[i].rx + pos, kbuf, ret);
+      pos += ret;
+    }
+  }
+  return 0;
+}
+
+static int _flush(unsigned char *cmd, int len, int nseg, SceUInt timeout)
+{
+  cmd[len++] = MPSSE_SEND_IMMEDIATE;
+  if (_send(cmd, len) != len)
+    return -1;
+
+  return _collect(segments, nseg, timeout);
+}
+
+/*
+ * Pack as many transactions as fit into the write buffer, one bulk OUT per buffer.
+ * Transactions longer than a buffer keep CS asserted across the split.
+ */
+int _ftdi_mpsse_spi_batch(serialDevice* ctx, const struct libusbserial_spi_transfer *xfers, int count,
+                          SceUInt timeout)
+{
+  unsigned char *cmd = ctx->writebuffer;
+  int space = sizeof(ctx->writebuffer) - 1; // reserve send immediate
+  int len = 0;
+  int nseg = 0;
+  int i;
+
+  if (ctx->ftdi_bitmode != BITMODE_MPSSE)
+    return -1;
+
+  // late replies of a batch that timed out would shift every reply after them
+  while (stale > 0)
+  {
+    unsigned char kbuf[64];
+    int ret = ringbuf_get_wait(kbuf, stale < (int)sizeof(kbuf) ? stale : (int)sizeof(kbuf), timeout);
+    if (ret <= 0)
+      break;
+    stale -= ret;
+  }
+  stale = 0;
+  ringbuf_reset();
+
+  for (i = 0; i < count; i++)
+  {
+    struct libusbserial_spi_transfer xfer;
+    int done = 0;
+
+    ksceKernelMemcpyUserToKernel(&xfer, &xfers[i], sizeof(xfer));
+    if (xfer.len <= 0)
+      continue;
+
+    if (len + SPI_CMD_OVERHEAD > space || nseg == SPI_MAX_SEGMENTS)
+    {
+      if (_flush(cmd, len, nseg, timeout) < 0)
+        return -1;
+      len  = 0;
+      nseg = 0;
+    }
+
+    cmd[len++] = MPSSE_SET_BITS_LOW;
+    cmd[len++] = SPI_PINS_IDLE & ~SPI_PIN_CS;
+    cmd[len++] = SPI_PINS_DIR;
+
+    while (done < xfer.len)
+    {
+      int chunk = space - len - 3 - 3; // header and CS release
+      if (chunk <= 0 || nseg == SPI_MAX_SEGMENTS)
+      {
+        if (_flush(cmd, len, nseg, timeout) < 0)
+          return -1;
+        len   = 0;
+        nseg  = 0;
+        chunk = space - 3 - 3;
+      }
+      if (chunk > xfer.len - done)
+        chunk = xfer.len - done;
+
+      cmd[len++] = xfer.rx ? MPSSE_DO_RW_BYTES_NVE_PVE_MSB : MPSSE_DO_WRITE_BYTES_NVE_MSB;
+      cmd[len++] = (chunk - 1) & 0xFF;
+      cmd[len++] = ((chunk - 1) >> 8) & 0xFF;
+      if (xfer.tx)
+        ksceKernelMemcpyUserToKernel(cmd + len, xfer.tx + done, chunk);
+      else
+        memset(cmd + len, 0, chunk);
+      len += chunk;
+
+      if (xfer.rx)
+      {
+        segments[nseg].rx  = xfer.rx + done;
+        segments[nseg].len = chunk;
+        nseg++;
+      }
+      done += chunk;
+    }
+
+    cmd[len++] = MPSSE_SET_BITS_LOW;
+    cmd[len++] = SPI_PINS_IDLE;
+    cmd[len++] = SPI_PINS_DIR;
+  }
+
+  if (len > 0)
+  {
+    if (_flush(cmd, len, nseg, timeout) < 0)
+      return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,267 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "dmx.h"
+#include "devicelist.h"
+#include "libusbserial_private.h"
+#include "devices/ftdi.h"
+#include "devices/ch34x.h"
+
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+#define DMX_BAUDRATE 250000
+/* 8N2: start, 8 data, 2 stop */
+#define DMX_CHAR_BITS 11
+#define DMX_THREAD_PRIORITY 64
+#define DMX_THREAD_STACK 0x1000
+
+static SceUID mtx_uid    = -1;
+static SceUID thread_uid = -1;
+
+static serialDevice *dev = NULL;
+static volatile int running  = 0;
+static volatile int stopping = 0;
+
+static SceUInt period_us;
+static SceUInt break_len;
+static SceUInt mab_len;
+static int slots;
+
+/* line settings from before DMX, the framing is in ctx->line_* */
+static int saved_baudrate;
+static uint8_t saved_char_bits;
+
+/* what the user set, and the copy going out */
+static unsigned char universe[LIBUSBSERIAL_DMX_SLOTS];
+static unsigned char frame[LIBUSBSERIAL_DMX_SLOTS] __attribute__((aligned(64)));
+
+int dmx_init(void)
+{
+  if (mtx_uid != -1)
+  {
+    // already inited
+    return 0;
+  }
+
+  mtx_uid = ksceKernelCreateMutex("DmxMutex", 0, 0, NULL);
+  if (mtx_uid < 0)
+  {
+    int ret = mtx_uid;
+    mtx_uid = -1;
+    return ret;
+  }
+
+  memset(universe, 0, sizeof(universe));
+  return 0;
+}
+
+int dmx_term(void)
+{
+  if (mtx_uid == -1)
+    return 0;
+
+  dmx_stop();
+  ksceKernelDeleteMutex(mtx_uid);
+  mtx_uid = -1;
+  return 0;
+}
+
+static int _set_break(serialDevice *ctx, enum break_type on)
+{
+  if (ctx->type == TYPE_FTDI)
+    return _ftdi_set_line_property(BITS_8, STOP_BIT_2, PARITY_NONE, on);
+  else if (ctx->type == TYPE_CH34X)
+    return _ch34x_set_line_property(ctx, BITS_8, STOP_BIT_2, PARITY_NONE, on);
+  return -1;
+}
+
+static int _set_baudrate(serialDevice *ctx, int baudrate)
+{
+  if (ctx->type == TYPE_FTDI)
+    return _ftdi_set_baudrate(ctx, baudrate);
+  else if (ctx->type == TYPE_CH34X)
+    return _ch34x_set_baudrate(ctx, baudrate);
+  return -1;
+}
+
+/* Back to the user's line, explicitly out of BREAK in case a frame stopped in it */
+static void _restore_line(serialDevice *ctx)
+{
+  if (ctx->type == TYPE_FTDI)
+    _ftdi_set_line_property(ctx->line_bits, ctx->line_stop, ctx->line_parity, BREAK_OFF);
+  else if (ctx->type == TYPE_CH34X)
+    _ch34x_set_line_property(ctx, ctx->line_bits, ctx->line_stop, ctx->line_parity, BREAK_OFF);
+  _set_baudrate(ctx, saved_baudrate);
+  ctx->char_bits = saved_char_bits;
+}
+
+/*
+ * One frame per period, scheduled on absolute times so the rate doesn't
+ * drift with how long the control transfers took. Once a whole period
+ * behind, frames go back to back until the schedule is met again.
+ */
+static int _dmx_thread(SceSize args, void *argp)
+{
+  serialDevice *ctx = dev;
+  SceUInt char_us   = DIV_ROUND_UP(DMX_CHAR_BITS * 1000000, DMX_BAUDRATE);
+  uint32_t next     = ksceKernelGetSystemTimeLow();
+  uint32_t first    = next;
+  uint32_t last     = next;
+  uint32_t wire_end = next;
+
+  while (!stopping && ctx->out_pipe_id > 0)
+  {
+    uint32_t now  = ksceKernelGetSystemTimeLow();
+    uint32_t when = (int32_t)(wire_end - next) > 0 ? wire_end : next;
+    unsigned int queued;
+
+    // a break before the last slot left the chip would cut it short
+    if ((int32_t)(when - now) > 0)
+    {
+      ksceKernelDelayThread(when - now);
+      now = ksceKernelGetSystemTimeLow();
+    }
+
+    // jitter is how far a frame interval strays from the average one
+    if (ctx->stats.dmx_frames++ == 0)
+      first = now;
+    else
+    {
+      int32_t dev_us;
+
+      ctx->stats.dmx_period_us = (now - first) / (ctx->stats.dmx_frames - 1);
+      dev_us = (int32_t)(now - last - ctx->stats.dmx_period_us);
+      if (dev_us < 0)
+        dev_us = -dev_us;
+      if (ctx->stats.dmx_frames > 2 && (uint32_t)dev_us > ctx->stats.dmx_jitter_us)
+        ctx->stats.dmx_jitter_us = dev_us;
+    }
+    last = now;
+
+    next += period_us;
+    if ((int32_t)(now - next) > 0)
+      next = now;
+
+    if (_set_break(ctx, BREAK_ON) < 0)
+      break;
+    ksceKernelDelayThread(break_len);
+    if (_set_break(ctx, BREAK_OFF) < 0)
+      break;
+    if (mab_len)
+      ksceKernelDelayThread(mab_len);
+
+    ksceKernelLockMutex(mtx_uid, 1, NULL);
+    memcpy(frame, universe, slots);
+    ksceKernelUnlockMutex(mtx_uid, 1);
+
+    if (_send(frame, slots) != slots)
+      break;
+
+    queued   = (unsigned int)slots < ctx->tx_fifo_size + 1 ? (unsigned int)slots : ctx->tx_fifo_size + 1;
+    wire_end = ctx->tx_done_ts + queued * char_us;
+  }
+
+  // an unplugged device comes back at its defaults
+  if (ctx->out_pipe_id > 0)
+    _restore_line(ctx);
+  running = 0;
+  return 0;
+}
+
+/*
+ * Channels and times are checked by the caller. Returns -2 if the line
+ * couldn't be set to DMX_BAUDRATE 8N2, the thread puts the old settings
+ * back when it ends.
+ */
+int dmx_start(serialDevice *ctx, SceUInt period, int channels, SceUInt break_us, SceUInt mab_us)
+{
+  if (mtx_uid == -1 || running)
+    return -1;
+  // reap a thread that ended on unplug
+  dmx_stop();
+
+  saved_baudrate  = ctx->baudrate;
+  saved_char_bits = ctx->char_bits;
+  if (_set_baudrate(ctx, DMX_BAUDRATE) < 0 || _set_break(ctx, BREAK_OFF) < 0)
+  {
+    _restore_line(ctx);
+    return -2;
+  }
+  ctx->char_bits = DMX_CHAR_BITS;
+
+  dev       = ctx;
+  period_us = period;
+  break_len = break_us;
+  mab_len   = mab_us;
+  slots     = channels + 1;
+
+  ctx->stats.dmx_frames    = 0;
+  ctx->stats.dmx_period_us = 0;
+  ctx->stats.dmx_jitter_us = 0;
+
+  thread_uid = ksceKernelCreateThread("DmxThread", _dmx_thread, DMX_THREAD_PRIORITY, DMX_THREAD_STACK, 0, 0, NULL);
+  if (thread_uid < 0)
+  {
+    thread_uid = -1;
+    _restore_line(ctx);
+    return -1;
+  }
+
+  stopping = 0;
+  running  = 1;
+  if (ksceKernelStartThread(thread_uid, 0, NULL) < 0)
+  {
+    running = 0;
+    ksceKernelDeleteThread(thread_uid);
+    thread_uid = -1;
+    _restore_line(ctx);
+    return -1;
+  }
+  return 0;
+}
+
+/* Let the frame on the wire finish, then leave the line idle (mark) at the old settings */
+int dmx_stop(void)
+{
+  if (thread_uid == -1)
+    return 0;
+
+  stopping = 1;
+  ksceKernelWaitThreadEnd(thread_uid, NULL, NULL);
+  ksceKernelDeleteThread(thread_uid);
+  thread_uid = -1;
+  return 0;
+}
+
+int dmx_active(void)
+{
+  return running;
+}
+
+int dmx_set_user(int slot, const unsigned char *data, int len)
+{
+  if (mtx_uid == -1)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  ksceKernelMemcpyUserToKernel(universe + slot, data, len);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return len;
+}
@@ -0,0 +1,36 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DMX_H__
+#define __DMX_H__
+
+#include "serialdevice.h"
+
+#include <psp2kern/types.h>
+
+/* DMX512 transmitter thread: break, mark-after-break, start code and slots */
+
+int dmx_init(void);
+int dmx_term(void);
+
+int dmx_start(serialDevice *ctx, SceUInt period, int channels, SceUInt break_us, SceUInt mab_us);
+int dmx_stop(void);
+int dmx_active(void);
+int dmx_set_user(int slot, const unsigned char *data, int len);
+
+#endif // __DMX_H__
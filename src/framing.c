@@ -0,0 +1,187 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "framing.h"
+#include "crc.h"
+#include "msgqueue.h"
+
+#include <psp2kern/kernel/threadmgr.h>
+
+/* RFC 1055 */
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+/* Frame being decoded, runs in the receive callback only */
+static unsigned char frame[LIBUSBSERIAL_MAX_FRAME];
+static int frame_len     = 0;
+static int frame_max     = LIBUSBSERIAL_MAX_FRAME;
+static uint8_t bad       = 0; // error seen, drop at the delimiter
+static uint8_t escape    = 0; // SLIP: ESC seen
+static int cobs_left     = 0; // COBS: data bytes left in this block
+static uint8_t cobs_code = 0;
+static uint8_t frame_crc = CRC_NONE; // trailing CRC checked and stripped at the delimiter
+
+void framing_reset(int max_frame)
+{
+  frame_len = 0;
+  frame_max = (max_frame > 0 && max_frame <= LIBUSBSERIAL_MAX_FRAME) ? max_frame : LIBUSBSERIAL_MAX_FRAME;
+  bad       = 0;
+  escape    = 0;
+  cobs_left = 0;
+  cobs_code = 0;
+}
+
+void framing_set_crc(enum crc_type type)
+{
+  frame_crc = type;
+}
+
+static void _append(serialDevice *ctx, unsigned char c)
+{
+  if (frame_len < frame_max)
+  {
+    frame[frame_len++] = c;
+  }
+  else if (!bad)
+  {
+    ctx->stats.frame_oversize++;
+    bad = 1;
+  }
+}
+
+static void _end(serialDevice *ctx, int ok)
+{
+  if (!ok && !bad)
+  {
+    ctx->stats.frame_errors++;
+    bad = 1;
+  }
+
+  // the frame is still in cache, one pass over it
+  if (!bad && frame_len && frame_crc)
+  {
+    int n = crc_len(frame_crc);
+
+    if (frame_len < n || !crc_check(frame_crc, crc_update(frame_crc, crc_start(frame_crc), frame, frame_len)))
+    {
+      ctx->stats.frame_errors++;
+      bad = 1;
+    }
+    else
+      frame_len -= n;
+  }
+
+  // back to back delimiters are idle fill, not frames
+  if (!bad && frame_len)
+  {
+    if (msgq_put(frame, frame_len, ksceKernelGetSystemTimeLow()) == 0)
+      ctx->stats.rx_frames++;
+    else
+      ctx->stats.frame_drops++;
+  }
+
+  frame_len = 0;
+  bad       = 0;
+  escape    = 0;
+  cobs_left = 0;
+  cobs_code = 0;
+}
+
+static void _slip(serialDevice *ctx, const unsigned char *buf, int len)
+{
+  while (len--)
+  {
+    unsigned char c = *buf++;
+
+    if (c == SLIP_END)
+    {
+      _end(ctx, !escape);
+    }
+    else if (escape)
+    {
+      escape = 0;
+      if (c == SLIP_ESC_END)
+        _append(ctx, SLIP_END);
+      else if (c == SLIP_ESC_ESC)
+        _append(ctx, SLIP_ESC);
+      else if (!bad)
+      {
+        ctx->stats.frame_errors++;
+        bad = 1;
+      }
+    }
+    else if (c == SLIP_ESC)
+      escape = 1;
+    else
+      _append(ctx, c);
+  }
+}
+
+/*
+ * Each block is a code byte n followed by n - 1 data bytes, blocks with
+ * n < 0xFF imply a zero after them unless the frame ends there. The zero is
+ * appended lazily when the next block starts.
+ */
+static void _cobs(serialDevice *ctx, const unsigned char *buf, int len)
+{
+  while (len--)
+  {
+    unsigned char c = *buf++;
+
+    if (c == 0)
+    {
+      // a frame cut short inside a block is broken
+      _end(ctx, cobs_left == 0);
+    }
+    else if (cobs_left)
+    {
+      _append(ctx, c);
+      cobs_left--;
+    }
+    else
+    {
+      if (cobs_code && cobs_code != 0xFF)
+        _append(ctx, 0);
+      cobs_code = c;
+      cobs_left = c - 1;
+    }
+  }
+}
+
+/* Transfer boundaries are the message boundaries, ts is the transfer's arrival */
+static void _message(serialDevice *ctx, const unsigned char *buf, int len, uint32_t ts)
+{
+  if (len > frame_max)
+    ctx->stats.frame_oversize++;
+  else if (msgq_put(buf, len, ts) == 0)
+    ctx->stats.rx_frames++;
+  else
+    ctx->stats.frame_drops++;
+}
+
+void framing_rx(serialDevice *ctx, const unsigned char *buf, int len, uint32_t ts)
+{
+  if (ctx->frame_mode == FRAME_MESSAGE)
+    _message(ctx, buf, len, ts);
+  else if (ctx->frame_mode == FRAME_SLIP)
+    _slip(ctx, buf, len);
+  else if (ctx->frame_mode == FRAME_COBS)
+    _cobs(ctx, buf, len);
+}
@@ -0,0 +1,30 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FRAMING_H__
+#define __FRAMING_H__
+
+#include "serialdevice.h"
+
+/* SLIP/COBS decoding or per-transfer messages of received data into msgqueue */
+
+void framing_reset(int max_frame);
+void framing_set_crc(enum crc_type type);
+void framing_rx(serialDevice *ctx, const unsigned char *buf, int len, uint32_t ts);
+
+#endif // __FRAMING_H__
@@ -0,0 +1,67 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "histogram.h"
+
+#include <psp2kern/kernel/sysclib.h>
+#include <string.h>
+
+static struct libusbserial_histogram hists[LATENCY_OPS];
+
+/* see libusbserial_hist_bucket_floor() for the inverse */
+static inline int _bucket(uint32_t us)
+{
+  int msb;
+  int b;
+
+  if (us < 4)
+    return us;
+
+  msb = 31 - __builtin_clz(us);
+  b   = (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+  if (b >= LIBUSBSERIAL_HIST_BUCKETS)
+    b = LIBUSBSERIAL_HIST_BUCKETS - 1;
+  return b;
+}
+
+void histogram_record(enum latency_op op, uint32_t us)
+{
+  struct libusbserial_histogram *h = &hists[op];
+
+  if (h->count == 0 || us < h->min_us)
+    h->min_us = us;
+  if (us > h->max_us)
+    h->max_us = us;
+  h->count++;
+  h->sum_us += us;
+  h->buckets[_bucket(us)]++;
+}
+
+int histogram_get(enum latency_op op, struct libusbserial_histogram *out)
+{
+  if ((unsigned int)op >= LATENCY_OPS)
+    return -1;
+
+  memcpy(out, &hists[op], sizeof(*out));
+  return 0;
+}
+
+void histogram_reset(void)
+{
+  memset(hists, 0, sizeof(hists));
+}
@@ -21,6 +21,7 @@
 
 #include <psp2/types.h>
 #include <stdint.h>
+#include <string.h>
 
 /** Parity mode for usbserial_set_line_property() */
 enum parity_type
@@ -51,6 +52,351 @@ enum break_type
   BREAK_ON  = 1
 };
 
+/** Flow control for libusbserial_setflowctrl() */
+enum flow_control
+{
+  FLOW_NONE     = 0x0,
+  FLOW_RTS_CTS  = (0x1 << 8),
+  FLOW_DTR_DSR  = (0x2 << 8),
+  FLOW_XON_XOFF = (0x4 << 8)
+};
+
+/** Transceiver direction control for libusbserial_set_rs485() */
+enum rs485_mode
+{
+  RS485_OFF   = 0,
+  RS485_RTS   = 1, /**< driver raises RTS for each write and drops it after the last stop bit */
+  RS485_TXDEN = 2, /**< a CBUS pin programmed as TXDEN switches the transceiver in hardware */
+  RS485_AUTO  = 3, /**< TXDEN when the EEPROM has it, RTS otherwise */
+};
+
+/** Options for libusbserial_set_rs485() */
+enum rs485_flags
+{
+  RS485_RTS_ACTIVE_LOW = 0x1, /**< transmit with RTS low */
+  RS485_ECHO           = 0x2, /**< drop our own bytes coming back from the bus */
+};
+
+/** Modem status lines, returned by libusbserial_get_modem_status() */
+enum modem_status
+{
+  MODEM_CTS = 0x01,
+  MODEM_DSR = 0x02,
+  MODEM_RI  = 0x04,
+  MODEM_DCD = 0x08
+};
+
+/** Checksums for libusbserial_crc() and the CRC options of framing and transactions */
+enum crc_type
+{
+  CRC_NONE     = 0,
+  CRC16_MODBUS = 1, /**< poly 0x8005 reflected, init 0xFFFF, sent LSB first */
+  CRC16_CCITT  = 2, /**< poly 0x1021, init 0xFFFF, sent MSB first */
+  CRC16_XMODEM = 3, /**< poly 0x1021, init 0, sent MSB first */
+  CRC32_IEEE   = 4, /**< IEEE 802.3 / zlib, sent LSB first */
+};
+
+/** Flags for libusbserial_transact() */
+enum transact_flags
+{
+  TRANSACT_FLUSH_RX   = 0x1, /**< discard buffered input before sending, like libusbserial_tciflush() */
+  TRANSACT_APPEND_CRC = 0x2, /**< send the CRC of tx after it */
+  TRANSACT_CHECK_CRC  = 0x4, /**< reply ends in a CRC (before the terminator), fail with -4 if it's wrong */
+};
+/** CRC used by TRANSACT_APPEND_CRC / TRANSACT_CHECK_CRC, enum crc_type */
+#define TRANSACT_CRC(type) ((type) << 8)
+
+/** libusbserial_set_frame_mode() */
+enum frame_mode
+{
+  FRAME_NONE = 0, /**< byte stream */
+  FRAME_SLIP = 1, /**< RFC 1055, frames end with 0xC0 */
+  FRAME_COBS = 2, /**< consistent overhead byte stuffing, frames end with 0x00 */
+  FRAME_MESSAGE = 3, /**< one record per USB transfer, no delimiters */
+};
+
+/** Largest decoded frame */
+#define LIBUSBSERIAL_MAX_FRAME 4096
+
+/** DMX512 start code + 512 channels, libusbserial_dmx_set() */
+#define LIBUSBSERIAL_DMX_SLOTS 513
+
+/** Options for libusbserial_autobaud() */
+enum autobaud_flags
+{
+  AUTOBAUD_TEXT = 0x1, /**< the peer sends printable ASCII, anything else counts against a rate */
+};
+
+/** libusbserial_autobaud() */
+struct libusbserial_autobaud_result
+{
+  int32_t baudrate;    /**< rate locked onto, 0 if none matched */
+  uint32_t elapsed_us; /**< time detection took */
+  uint32_t tried;      /**< rate changes made */
+  uint32_t chars;      /**< characters seen at the locked rate */
+  uint32_t errors;     /**< of those, from packets with framing/parity/break errors (FTDI only) */
+  uint32_t quality;    /**< good characters per thousand at the locked rate */
+};
+
+/** Protocols for libusbserial_xmodem_send() */
+enum xmodem_protocol
+{
+  XMODEM_1K = 1, /**< 1024 byte blocks with CRC-16, 128 byte ones for short tails and checksum receivers */
+  YMODEM    = 2, /**< XMODEM-1K after a block with the file name and size, one file per batch */
+};
+
+/** Progress of libusbserial_xmodem_send() */
+enum xmodem_state
+{
+  XMODEM_IDLE       = 0,
+  XMODEM_WAIT_START = 1, /**< waiting for the receiver's 'C' or NAK */
+  XMODEM_SENDING    = 2,
+  XMODEM_FINISHING  = 3, /**< EOT and the YMODEM end of batch */
+  XMODEM_DONE       = 4,
+  XMODEM_FAILED     = 5, /**< result says why */
+};
+
+/** Transfer failures in libusbserial_xmodem_status.result */
+enum xmodem_error
+{
+  XMODEM_ERR_DEVICE  = -2, /**< device went away */
+  XMODEM_ERR_TIMEOUT = -3, /**< receiver stopped answering */
+  XMODEM_ERR_CANCEL  = -4, /**< cancelled by the receiver or libusbserial_xmodem_cancel() */
+  XMODEM_ERR_RETRIES = -5, /**< a block was refused too often */
+};
+
+/** Longest YMODEM file name */
+#define LIBUSBSERIAL_XMODEM_MAX_NAME 64
+
+/** libusbserial_xmodem_status() */
+struct libusbserial_xmodem_status
+{
+  int32_t state;     /**< enum xmodem_state */
+  int32_t result;    /**< 0 or enum xmodem_error once done */
+  uint32_t position; /**< file bytes acknowledged */
+  uint32_t size;     /**< file size */
+  uint32_t blocks;   /**< data blocks acknowledged */
+  uint32_t retries;  /**< blocks sent again after a NAK or timeout */
+};
+
+/** Longest terminator for libusbserial_read_until_seq() */
+#define LIBUSBSERIAL_MAX_TERMINATOR 16
+
+/** Line status counters, libusbserial_get_line_status() */
+struct libusbserial_line_status
+{
+  uint8_t modem_status; /**< enum modem_status */
+  uint8_t line_status;  /**< last FTDI line status byte */
+  uint16_t reserved;
+  uint32_t overrun;     /**< chip RX FIFO overruns */
+  uint32_t parity;
+  uint32_t framing;
+  uint32_t breaks;
+};
+
+/** Number of distinct USB error codes tracked in libusbserial_stats */
+#define LIBUSBSERIAL_STATS_ERROR_CODES 8
+
+/** Driver counters, libusbserial_get_stats() */
+struct libusbserial_stats
+{
+  uint64_t rx_bytes;          /**< payload bytes put into the ring */
+  uint64_t tx_bytes;          /**< bytes acknowledged by OUT transfers */
+  uint32_t rx_transfers;      /**< completed IN transfers */
+  uint32_t tx_transfers;      /**< completed OUT transfers, tx_bytes / tx_transfers is the average chunk */
+  uint32_t rx_errors;         /**< IN transfers completed with error */
+  uint32_t tx_errors;         /**< OUT transfers completed with error */
+  uint32_t submit_errors;     /**< transfers usbd refused to queue */
+  uint32_t control_transfers; /**< control transfers issued */
+  uint32_t control_errors;
+  uint32_t callbacks;         /**< USB completion callbacks run */
+  uint32_t ring_drops;        /**< bytes overwritten before a reader got them */
+  uint32_t ring_high_water;   /**< max ring occupancy in bytes */
+  struct
+  {
+    int32_t code;
+    uint32_t count;
+  } errors[LIBUSBSERIAL_STATS_ERROR_CODES]; /**< errors by usbd result code */
+  uint32_t errors_other;      /**< errors with codes that didn't fit the table */
+  uint32_t rx_wakeups;        /**< times a blocked reader was woken by data */
+  uint32_t rx_frames;         /**< decoded frames / messages queued */
+  uint32_t frame_errors;      /**< bad escapes / truncated COBS blocks / CRC mismatches */
+  uint32_t frame_oversize;    /**< frames longer than the frame limit */
+  uint32_t frame_drops;       /**< good frames lost to a full frame queue */
+  uint32_t echo_drops;        /**< RS-485 local echo bytes dropped */
+  uint32_t dmx_frames;        /**< DMX512 frames sent */
+  uint32_t dmx_period_us;     /**< average DMX512 frame period, 1000000 / refresh rate */
+  uint32_t dmx_jitter_us;     /**< largest distance of a DMX512 frame interval from the average */
+  uint64_t loop_bytes;        /**< received bytes loopback mode sent back out */
+  uint32_t loop_stalls;       /**< IN transfers that found the loopback buffer short of room */
+  uint32_t loop_drops;        /**< bytes lost to a full loopback buffer, XON/XOFF emulation or a stall not held */
+  uint32_t loop_high_water;   /**< max loopback buffer occupancy in bytes */
+};
+
+/** Event ids of libusbserial_trace_record, also bit numbers for libusbserial_trace_set_mask() */
+enum trace_event
+{
+  TRACE_LOST        = 0,  /**< arg1: records overwritten before drain */
+  TRACE_RX_SUBMIT   = 1,  /**< arg0: size, arg1: usbd return */
+  TRACE_RX_DONE     = 2,  /**< arg0: count, arg1: result */
+  TRACE_TX_SUBMIT   = 3,  /**< arg0: size, arg1: usbd return */
+  TRACE_TX_DONE     = 4,  /**< arg0: count, arg1: result */
+  TRACE_CTRL_SUBMIT = 5,  /**< arg0: bRequest << 16 | wValue, arg1: usbd return */
+  TRACE_CTRL_DONE   = 6,  /**< arg0: count, arg1: result */
+  TRACE_STATUS_DONE = 7,  /**< arg0: count, arg1: result */
+  TRACE_RING_PUT    = 8,  /**< arg0: bytes, arg1: ring level after */
+  TRACE_RING_GET    = 9,  /**< arg0: bytes, arg1: ring level after */
+  TRACE_MODEM       = 10, /**< arg0: modem status, arg1: line status */
+};
+
+/** Binary trace record, libusbserial_trace_read() */
+struct libusbserial_trace_record
+{
+  uint32_t seq;       /**< per-ring sequence number + 1 */
+  uint32_t timestamp; /**< system time in microseconds, low 32 bits */
+  uint16_t event;     /**< enum trace_event */
+  uint16_t reserved;
+  uint32_t arg0;
+  int32_t arg1;
+};
+
+/** Operations with latency histograms, libusbserial_get_latency_histogram() */
+enum latency_op
+{
+  LATENCY_CONTROL    = 0, /**< control transfer submit to completion */
+  LATENCY_TX         = 1, /**< OUT transfer submit to completion */
+  LATENCY_RX_DELIVER = 2, /**< IN packet arrival until a reader takes its first byte */
+  LATENCY_TRANSACT   = 3, /**< libusbserial_transact() request sent until the reply arrived */
+  LATENCY_RX_WORKER  = 4, /**< IN completion until the RX worker thread picked it up */
+  LATENCY_LOOPBACK   = 5, /**< IN completion until loopback mode sent its last byte */
+  LATENCY_OPS
+};
+
+#define LIBUSBSERIAL_HIST_BUCKETS 100
+
+/**
+ * Log-linear latency histogram in microseconds, 4 buckets per power of two.
+ * Buckets 0-3 hold exactly 0-3 us, bucket b >= 4 starts at
+ * (4 + b % 4) << (b / 4 - 1) us. The last bucket also holds everything above.
+ */
+struct libusbserial_histogram
+{
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint32_t reserved;
+  uint64_t sum_us;
+  uint32_t buckets[LIBUSBSERIAL_HIST_BUCKETS];
+};
+
+/** Lower bound in microseconds of histogram bucket b */
+static inline uint32_t libusbserial_hist_bucket_floor(int b)
+{
+  if (b < 4)
+    return b;
+  return (uint32_t)(4 + b % 4) << (b / 4 - 1);
+}
+
+/** Largest Modbus RTU frame, address + PDU + CRC */
+#define LIBUSBSERIAL_MODBUS_MAX_ADU 256
+
+/** Modbus RTU failures, exception replies give MODBUS_ERR_EXCEPTION - code */
+enum modbus_error
+{
+  MODBUS_ERR_TIMEOUT   = -3,    /**< no reply */
+  MODBUS_ERR_CRC       = -4,    /**< reply with a bad CRC */
+  MODBUS_ERR_FRAME     = -5,    /**< reply from the wrong slave, function or length */
+  MODBUS_ERR_EXCEPTION = -0x100
+};
+
+/**
+ * One entry of a libusbserial_modbus_poll() table. Functions 1-4 read into
+ * data, 5, 6, 15 and 16 write from it. Registers are in host byte order,
+ * coils are packed LSB first like on the wire.
+ */
+struct libusbserial_modbus_request
+{
+  uint8_t slave;
+  uint8_t function;
+  uint16_t address;
+  uint16_t count; /**< registers or coils, ignored by 5 and 6 */
+  uint16_t reserved;
+  void *data;
+  int32_t result;  /**< out: count on success or enum modbus_error */
+  uint32_t rtt_us; /**< out: request sent until the reply was complete */
+};
+
+/** FTDI bit mode for libusbserial_ftdi_set_bitmode() */
+enum ftdi_bitmode
+{
+  BITMODE_RESET   = 0x00, /**< switch off bitbang mode, back to regular serial */
+  BITMODE_BITBANG = 0x01, /**< classical asynchronous bitbang mode */
+  BITMODE_MPSSE   = 0x02, /**< MPSSE mode, available on 2232x and 232H chips */
+  BITMODE_SYNCBB  = 0x04, /**< synchronous bitbang mode */
+  BITMODE_MCU     = 0x08, /**< MCU host bus emulation mode */
+  BITMODE_OPTO    = 0x10, /**< fast opto-isolated serial interface mode */
+  BITMODE_CBUS    = 0x20, /**< bitbang on CBUS pins of R-type chips */
+  BITMODE_SYNCFF  = 0x40, /**< single channel synchronous 245 FIFO mode, 2232H and 232H only */
+  BITMODE_FT1284  = 0x80, /**< FT1284 mode, 232H only */
+};
+
+/** One SPI transaction for libusbserial_ftdi_mpsse_spi_batch() */
+struct libusbserial_spi_transfer
+{
+  const unsigned char *tx; /**< bytes to clock out, NULL sends zeroes */
+  unsigned char *rx;       /**< buffer for clocked in bytes, NULL for write only */
+  int len;
+};
+
+/** Offset of the receive ring in a libusbserial_shm_attach() block */
+#define LIBUSBSERIAL_SHM_HEADER 0x1000
+
+/**
+ * Status page at the start of a libusbserial_shm_attach() block. The driver
+ * only moves head, the reader only moves tail, both count bytes modulo 2^32.
+ */
+struct libusbserial_shm
+{
+  volatile uint32_t head;          /**< bytes received */
+  volatile uint32_t tail;          /**< bytes consumed by the reader */
+  uint32_t size;                   /**< ring size, a power of two */
+  volatile uint32_t dropped;       /**< bytes lost to a full ring */
+  volatile uint32_t plugged;       /**< cleared when the device goes away */
+  volatile uint32_t modem_status;  /**< enum modem_status */
+  volatile uint32_t modem_changes; /**< bumped on every modem status change */
+};
+
+/** Bytes waiting in the shared ring */
+static inline int libusbserial_shm_available(const struct libusbserial_shm *shm)
+{
+  return __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) - shm->tail;
+}
+
+/** Take up to size bytes from the shared ring, no syscall involved */
+static inline int libusbserial_shm_read(struct libusbserial_shm *shm, unsigned char *buf, int size)
+{
+  const unsigned char *ring = (const unsigned char *)shm + LIBUSBSERIAL_SHM_HEADER;
+  uint32_t tail             = shm->tail;
+  uint32_t n                = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) - tail;
+  uint32_t off              = tail & (shm->size - 1);
+  uint32_t first            = shm->size - off;
+
+  if (n > (uint32_t)size)
+    n = size;
+  if (first > n)
+    first = n;
+  memcpy(buf, ring + off, first);
+  memcpy(buf + first, ring, n - first);
+  __atomic_store_n(&shm->tail, tail + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+/** Drop everything in the shared ring */
+static inline void libusbserial_shm_discard(struct libusbserial_shm *shm)
+{
+  __atomic_store_n(&shm->tail, __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -62,24 +408,159 @@ extern "C"
   int libusbserial_device_connected(void);
 
   int libusbserial_set_baudrate(int baudrate);
+  /* rate the chip really runs at, and what it would run at for baudrate (ppm = error in parts per million) */
+  int libusbserial_get_actual_baudrate(void);
+  int libusbserial_query_baudrate(int baudrate, int *actual, int *ppm);
   int libusbserial_set_line_property(enum bits_type bits, enum stopbits_type sbit, enum parity_type parity,
                               enum break_type break_type);
+  /*
+   * listen at each candidate rate (NULL = common rates) until one gives
+   * clean data, sync >= 0 must be seen too. Returns the rate it locked
+   * onto, 0 if none matched within timeout us; consumes what it heard
+   */
+  int libusbserial_autobaud(const int *candidates, int count, int sync, int flags, SceUInt timeout,
+                            struct libusbserial_autobaud_result *result);
 
   int libusbserial_write_data(const unsigned char *buf, int size);
   int libusbserial_read_data(unsigned char *buf, int size);
   int libusbserial_read_data_blocking(unsigned char *buf, int size, SceUInt timeout);
+  /* return at min bytes, after interbyte us of silence once data came, or at timeout us; 0 = no timer */
+  int libusbserial_read_data_timed(unsigned char *buf, int size, int min, SceUInt timeout, SceUInt interbyte);
   int libusbserial_available_count(void);
+  /* one record up to and including delim/term or until buf or the ring is full, 0 on timeout, nothing consumed */
+  int libusbserial_read_until(unsigned char *buf, int size, unsigned char delim, SceUInt timeout);
+  int libusbserial_read_until_seq(unsigned char *buf, int size, const unsigned char *term, int term_len, SceUInt timeout);
+  /* blocked readers wake at threshold bytes, or coalesce us after the oldest unread byte (0 = never) */
+  int libusbserial_set_rx_wakeup(int threshold, SceUInt coalesce);
+  /*
+   * process IN completions in a driver thread of the given priority and
+   * CPU affinity mask (0 = defaults) instead of the USB callback
+   */
+  int libusbserial_set_rx_worker(int enable, int priority, int cpu_mask);
+
+  /*
+   * send tx, then wait up to timeout us (0 = forever) for a reply ending in
+   * term, or of exactly rx_size bytes with term_len 0. Returns the reply
+   * length as the read_until / read_data_timed calls do
+   */
+  int libusbserial_transact(const unsigned char *tx, int tx_len, unsigned char *rx, int rx_size,
+                            const unsigned char *term, int term_len, int flags, SceUInt timeout);
+
+  /*
+   * Modbus RTU master, frames are separated by 3.5 character times at the
+   * actual baudrate and CRCs are added and checked by the driver. req is
+   * slave address + PDU, the reply comes back the same way without CRC
+   */
+  int libusbserial_modbus_transact(const unsigned char *req, int len, unsigned char *reply, int size, SceUInt timeout);
+  /* next frame seen on the bus (slave or monitor side), 0 on timeout */
+  int libusbserial_modbus_read_frame(unsigned char *buf, int size, SceUInt timeout);
+  /* run a request table back to back, timeout per request, returns how many succeeded */
+  int libusbserial_modbus_poll(struct libusbserial_modbus_request *reqs, int count, SceUInt timeout);
 
+  /* final CRC of len bytes */
+  int libusbserial_crc(enum crc_type type, const unsigned char *buf, int len, uint32_t *crc);
+
+  /* CH34x can only purge both chip FIFOs at once: tciflush drops the driver's
+     input only, tcoflush also drops input still in the chip */
   int libusbserial_tciflush(void);
   int libusbserial_tcoflush(void);
   int libusbserial_tcioflush(void);
 
+  /* decoded frames instead of a byte stream, 0 = LIBUSBSERIAL_MAX_FRAME */
+  int libusbserial_set_frame_mode(enum frame_mode mode, int max_frame);
+  /* frames end in a CRC that the decoder checks and strips, CRC_NONE turns it off */
+  int libusbserial_set_frame_crc(enum crc_type type);
+  /* one frame, returns its length (more than size if truncated), 0 on timeout */
+  int libusbserial_read_frame(unsigned char *buf, int size, SceUInt timeout);
+  /* FRAME_MESSAGE: one transfer and its arrival time (us, system time low word) */
+  int libusbserial_read_message(unsigned char *buf, int size, uint32_t *timestamp, SceUInt timeout);
+
+  /*
+   * receive into a page aligned user block of LIBUSBSERIAL_SHM_HEADER + 2^n
+   * bytes (n >= 12) read with libusbserial_shm_read(), wait blocks for need
+   * bytes and returns the amount available, 0 on timeout
+   */
+  int libusbserial_shm_attach(void *block, int size);
+  int libusbserial_shm_detach(void);
+  int libusbserial_shm_wait(int need, SceUInt timeout);
+
+  /*
+   * DMX512 output at 250 kbaud 8N2 kept running by the driver. 0 selects
+   * back to back frames (about 44 Hz with 512 channels), 512 channels, a
+   * 176 us break and 16 us mark-after-break. Writes are refused until
+   * libusbserial_dmx_stop(), which puts the previous rate and line
+   * settings back
+   */
+  int libusbserial_dmx_start(int refresh_hz, int channels, SceUInt break_us, SceUInt mab_us);
+  int libusbserial_dmx_stop(void);
+  /* slot 0 is the start code, channels start at 1. Goes out with the next frame */
+  int libusbserial_dmx_set(int slot, const unsigned char *data, int len);
+
+  /*
+   * send a file to an XMODEM-1K / YMODEM receiver from a driver thread,
+   * data is copied in first. timeout is per reply in us, 0 = 10 s. Poll
+   * libusbserial_xmodem_status() for progress, writes are refused meanwhile
+   */
+  int libusbserial_xmodem_send(enum xmodem_protocol proto, const unsigned char *data, int size, const char *name,
+                               int name_len, SceUInt timeout);
+  int libusbserial_xmodem_status(struct libusbserial_xmodem_status *status);
+  int libusbserial_xmodem_cancel(void);
+
+  /*
+   * loopback (echo) mode: send everything the adapter receives back out
+   * of the same adapter from a driver thread, through a buffer of 2^n
+   * bytes (0 = 64 KiB). Reception pauses while the buffer is short of
+   * room. Readers get nothing and writes are refused until
+   * libusbserial_loopback_stop()
+   */
+  int libusbserial_loopback_start(int buffer_size);
+  int libusbserial_loopback_stop(void);
+
   /* flow control */
   int libusbserial_setflowctrl(int flowctrl);
   int libusbserial_setflowctrl_xonxoff(unsigned char xon, unsigned char xoff);
+  /* longest a write waits for XON in us (0 = forever), then it returns what was sent or -1 */
+  int libusbserial_set_write_timeout(SceUInt timeout);
   int libusbserial_setdtr_rts(int dtr, int rts);
   int libusbserial_setdtr(int state);
   int libusbserial_setrts(int state);
+  /*
+   * half-duplex RS-485, delays in us around the transmission. Returns the
+   * enum rs485_mode in effect, RS485_AUTO resolves to TXDEN or RTS
+   */
+  int libusbserial_set_rs485(enum rs485_mode mode, int flags, SceUInt delay_before, SceUInt delay_after);
+
+  /* modem status */
+  int libusbserial_get_modem_status(void);
+  int libusbserial_wait_modem_status(int mask, SceUInt timeout);
+  int libusbserial_get_line_status(struct libusbserial_line_status *status);
+  /* PARMRK-style: bytes with errors are delivered as 0xFF 0x00 c, data 0xFF as 0xFF 0xFF */
+  int libusbserial_set_error_marking(int enable);
+
+  /* statistics */
+  int libusbserial_get_stats(struct libusbserial_stats *stats);
+  int libusbserial_reset_stats(void);
+
+  /* latency histograms */
+  int libusbserial_get_latency_histogram(enum latency_op op, struct libusbserial_histogram *hist);
+  int libusbserial_reset_latency_histograms(void);
+
+  /* binary event trace, mask is a set of BIT(enum trace_event) */
+  int libusbserial_trace_set_mask(unsigned int mask);
+  int libusbserial_trace_read(struct libusbserial_trace_record *records, int max);
+
+  /* FTDI specific */
+  int libusbserial_ftdi_set_bitmode(unsigned char bitmask, unsigned char mode);
+  int libusbserial_ftdi_read_pins(unsigned char *pins);
+  int libusbserial_ftdi_set_latency_timer(unsigned char latency);
+
+  /* synchronous 245 FIFO capture, 0 selects defaults */
+  int libusbserial_ftdi_stream_start(int transfers, int transfer_size);
+  int libusbserial_ftdi_stream_stop(void);
+
+  /* MPSSE SPI master, mode 0, CS on ADBUS3 */
+  int libusbserial_ftdi_mpsse_spi_init(unsigned int clock_hz);
+  int libusbserial_ftdi_mpsse_spi_batch(const struct libusbserial_spi_transfer *xfers, int count, SceUInt timeout);
 
 #ifdef __cplusplus
 }
@@ -34,7 +34,11 @@
     return code;                                                                                                       \
   } while (0);
 
-#define trace(...) ksceKernelDelayThread(5000);ksceDebugPrintf(__VA_ARGS__)
+#define trace(...)                                                                                                     \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    ksceDebugPrintf(__VA_ARGS__);                                                                                      \
+  } while (0)
 
 #else
 #define _error_return(code, str)                                                                                       \
@@ -48,6 +52,18 @@
 
 #endif
 
+/* transfer_ev */
+#define EVF_SEND 1
+#define EVF_RECV 2
+#define EVF_CTRL 4
+
+/* status_ev */
+#define EVF_MODEM 1
+#define EVF_XON 2
+
+extern SceUID transfer_ev;
+extern SceUID status_ev;
+
 #define BIT(nr) (1UL << (nr))
 #define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
 
@@ -55,5 +71,6 @@ void _callback_control(int32_t result, int32_t count, void *arg);
 void _callback_send(int32_t result, int32_t count, void *arg);
 void _callback_recv(int32_t result, int32_t count, void *arg);
 int _control_transfer(int rtype, int req, int val, int idx, void *data, int len);
+int _send(unsigned char *request, unsigned int length);
 
 #endif // __LIBUSBSERIAL_PRIVATE_H__
\ No newline at end of file
@@ -0,0 +1,377 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "loopback.h"
+#include "histogram.h"
+#include "libusbserial_private.h"
+
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+#define LOOPBACK_EVF_DATA 0x00000001
+
+#define LOOPBACK_THREAD_PRIORITY 64
+#define LOOPBACK_THREAD_STACK 0x1000
+/* how often an idle thread looks for unplug */
+#define LOOPBACK_IDLE_TIMEOUT 100000 // us
+#define LOOPBACK_XOFF_POLL 1000      // us
+
+/* received chunks waiting for their last byte to go out, for LATENCY_LOOPBACK */
+#define LOOPBACK_MARKS 32
+
+typedef struct
+{
+  unsigned int end;
+  uint32_t ts;
+} loopbackMark;
+
+static SceUID evf_uid      = -1;
+static SceUID mtx_uid      = -1;
+static SceUID memblock_uid = -1;
+static SceUID thread_uid   = -1;
+
+static serialDevice *dev      = NULL;
+static loopback_resume resubmit = NULL;
+static volatile int running   = 0;
+static volatile int stopping  = 0;
+
+/* byte fifo, offsets run free so the size has to be a power of two */
+static unsigned char *base = NULL;
+static unsigned int size_  = 0;
+static unsigned int head   = 0;
+static unsigned int tail   = 0;
+
+static loopbackMark marks[LOOPBACK_MARKS];
+static unsigned int mark_head = 0;
+static unsigned int mark_tail = 0;
+
+/* IN transfers not resubmitted until there is room for a whole one */
+static rxTransfer *held[RX_STREAM_MAX_TRANSFERS + 1];
+static int held_count = 0;
+
+static unsigned char chunk[4096] __attribute__((aligned(64)));
+
+int loopback_init(void)
+{
+  if (mtx_uid != -1)
+  {
+    // already inited
+    return 0;
+  }
+
+  evf_uid = ksceKernelCreateEventFlag("LoopbackEventFlag", SCE_EVENT_WAITMULTIPLE, 0, NULL);
+  if (evf_uid < 0)
+  {
+    int ret = evf_uid;
+    evf_uid = -1;
+    return ret;
+  }
+
+  mtx_uid = ksceKernelCreateMutex("LoopbackMutex", 0, 0, NULL);
+  if (mtx_uid < 0)
+  {
+    int ret = mtx_uid;
+    ksceKernelDeleteEventFlag(evf_uid);
+    evf_uid = mtx_uid = -1;
+    return ret;
+  }
+  return 0;
+}
+
+int loopback_term(void)
+{
+  if (mtx_uid == -1)
+    return 0;
+
+  loopback_stop();
+  ksceKernelDeleteMutex(mtx_uid);
+  ksceKernelDeleteEventFlag(evf_uid);
+  evf_uid = mtx_uid = -1;
+  return 0;
+}
+
+/* Hand held transfers back, the caller holds the mutex */
+static int _take_held(rxTransfer **out, unsigned int space)
+{
+  int n = 0;
+
+  while (n < held_count && (!running || held[n]->size <= space))
+    n++;
+
+  memcpy(out, held, n * sizeof(held[0]));
+  memmove(held, held + n, (held_count - n) * sizeof(held[0]));
+  held_count -= n;
+  return n;
+}
+
+static void _resume(rxTransfer **xfers, int n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    resubmit(xfers[i]);
+}
+
+/*
+ * Chunks are copied out under the lock and sent without it, so the
+ * receive side only ever waits for a memcpy.
+ */
+static int _loopback_thread(SceSize args, void *argp)
+{
+  serialDevice *ctx = dev;
+  rxTransfer *resume[RX_STREAM_MAX_TRANSFERS + 1];
+  int n;
+
+  while (!stopping && ctx->out_pipe_id > 0)
+  {
+    unsigned int len, max, off, first;
+    int sent;
+
+    // XON is seen by the receive side, which never holds with XON/XOFF on
+    if (ctx->soft_flow && ctx->tx_stopped)
+    {
+      ksceKernelDelayThread(LOOPBACK_XOFF_POLL);
+      continue;
+    }
+
+    ksceKernelLockMutex(mtx_uid, 1, NULL);
+    len = head - tail;
+    ksceKernelUnlockMutex(mtx_uid, 1);
+
+    if (!len)
+    {
+      SceUInt timeout = LOOPBACK_IDLE_TIMEOUT;
+      ksceKernelWaitEventFlag(evf_uid, LOOPBACK_EVF_DATA, SCE_EVENT_WAITCLEAR_PAT | SCE_EVENT_WAITAND, NULL, &timeout);
+      continue;
+    }
+
+    // with XON/XOFF emulation keep chunks small so XOFF is honoured quickly
+    max = ctx->soft_flow ? ctx->max_packet_size : ctx->writebuffer_chunksize;
+    if (max > sizeof(chunk))
+      max = sizeof(chunk);
+    if (len > max)
+      len = max;
+
+    // only the thread moves tail, so the bytes stay put while unlocked
+    off   = tail & (size_ - 1);
+    first = size_ - off;
+    if (first > len)
+      first = len;
+    memcpy(chunk, base + off, first);
+    memcpy(chunk + first, base, len - first);
+
+    sent = _send(chunk, len);
+    if (sent < 0)
+      break;
+
+    ksceKernelLockMutex(mtx_uid, 1, NULL);
+    tail += sent;
+    ctx->stats.loop_bytes += sent;
+    while (mark_tail != mark_head && (int)(tail - marks[mark_tail % LOOPBACK_MARKS].end) >= 0)
+    {
+      histogram_record(LATENCY_LOOPBACK, ctx->tx_done_ts - marks[mark_tail % LOOPBACK_MARKS].ts);
+      mark_tail++;
+    }
+    n = _take_held(resume, size_ - (head - tail));
+    ksceKernelUnlockMutex(mtx_uid, 1);
+
+    _resume(resume, n);
+  }
+
+  // whatever is held goes back to the readers
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  running = 0;
+  n       = _take_held(resume, 0);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  _resume(resume, n);
+  return 0;
+}
+
+/* size is a power of two, checked by the caller */
+int loopback_start(serialDevice *ctx, int size, loopback_resume resume)
+{
+  if (mtx_uid == -1 || running)
+    return -1;
+  // reap a thread that ended on unplug
+  loopback_stop();
+
+  memblock_uid = ksceKernelAllocMemBlock("LoopbackMemBlock", 0x6020D006, (size + 0xFFF) & ~0xFFF, NULL);
+  if (memblock_uid < 0)
+  {
+    int ret      = memblock_uid;
+    memblock_uid = -1;
+    return ret;
+  }
+  ksceKernelGetMemBlockBase(memblock_uid, (void **)&base);
+
+  dev      = ctx;
+  resubmit = resume;
+  size_    = size;
+  head = tail = 0;
+  mark_head = mark_tail = 0;
+  held_count            = 0;
+
+  ctx->stats.loop_bytes      = 0;
+  ctx->stats.loop_stalls     = 0;
+  ctx->stats.loop_drops      = 0;
+  ctx->stats.loop_high_water = 0;
+
+  thread_uid = ksceKernelCreateThread("LoopbackThread", _loopback_thread, LOOPBACK_THREAD_PRIORITY,
+                                      LOOPBACK_THREAD_STACK, 0, 0, NULL);
+  if (thread_uid < 0)
+  {
+    thread_uid = -1;
+    goto fail;
+  }
+
+  ksceKernelClearEventFlag(evf_uid, ~LOOPBACK_EVF_DATA);
+  stopping = 0;
+  running  = 1;
+  if (ksceKernelStartThread(thread_uid, 0, NULL) < 0)
+  {
+    running = 0;
+    ksceKernelDeleteThread(thread_uid);
+    thread_uid = -1;
+    goto fail;
+  }
+  return 0;
+
+fail:
+  ksceKernelFreeMemBlock(memblock_uid);
+  memblock_uid = -1;
+  base         = NULL;
+  return -1;
+}
+
+/* Bytes not sent yet are dropped, held transfers are resubmitted */
+int loopback_stop(void)
+{
+  if (thread_uid == -1)
+    return 0;
+
+  stopping = 1;
+  ksceKernelSetEventFlag(evf_uid, LOOPBACK_EVF_DATA);
+  ksceKernelWaitThreadEnd(thread_uid, NULL, NULL);
+  ksceKernelDeleteThread(thread_uid);
+  thread_uid = -1;
+
+  ksceKernelFreeMemBlock(memblock_uid);
+  memblock_uid = -1;
+  base         = NULL;
+  return 0;
+}
+
+int loopback_active(void)
+{
+  return running;
+}
+
+/* The transfers died with the device, attach submits fresh ones */
+void loopback_detach(void)
+{
+  if (mtx_uid == -1)
+    return;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  held_count = 0;
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  ksceKernelSetEventFlag(evf_uid, LOOPBACK_EVF_DATA);
+}
+
+/*
+ * From the receive side. Returns -1 when loopback mode is off, the data
+ * is for the readers then. Only overflows with XON/XOFF emulation on or
+ * after loopback_hold() ran out of slots, otherwise it keeps a whole
+ * transfer of room.
+ */
+int loopback_put(serialDevice *ctx, const unsigned char *buf, int len)
+{
+  unsigned int space, off, first;
+
+  if (!running)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (!running)
+  {
+    ksceKernelUnlockMutex(mtx_uid, 1);
+    return -1;
+  }
+
+  space = size_ - (head - tail);
+  if ((unsigned int)len > space)
+  {
+    ctx->stats.loop_drops += len - space;
+    len = space;
+  }
+
+  if (len > 0)
+  {
+    off   = head & (size_ - 1);
+    first = size_ - off;
+    if (first > (unsigned int)len)
+      first = len;
+    memcpy(base + off, buf, first);
+    memcpy(base, buf + first, len - first);
+    head += len;
+
+    // out of marks, the newest one covers this too and reads a bit late
+    if (mark_head - mark_tail == LOOPBACK_MARKS)
+      marks[(mark_head - 1) % LOOPBACK_MARKS].end = head;
+    else
+    {
+      marks[mark_head % LOOPBACK_MARKS].end = head;
+      marks[mark_head % LOOPBACK_MARKS].ts  = ksceKernelGetSystemTimeLow();
+      mark_head++;
+    }
+
+    if (head - tail > ctx->stats.loop_high_water)
+      ctx->stats.loop_high_water = head - tail;
+    ksceKernelSetEventFlag(evf_uid, LOOPBACK_EVF_DATA);
+  }
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return 0;
+}
+
+/*
+ * Backpressure: an IN transfer that might not fit is kept until the
+ * thread made room, the chip buffers meanwhile and then flow control or
+ * its overrun takes over. Returns 1 if the caller must not resubmit.
+ */
+int loopback_hold(serialDevice *ctx, rxTransfer *xfer)
+{
+  int ret = 0;
+
+  // XON has to get through
+  if (!running || ctx->soft_flow)
+    return 0;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (running && size_ - (head - tail) < xfer->size)
+  {
+    ctx->stats.loop_stalls++;
+    // no slot left, it goes back out and loopback_put() counts what it loses
+    if (held_count < RX_STREAM_MAX_TRANSFERS + 1)
+    {
+      held[held_count++] = xfer;
+      ret = 1;
+    }
+  }
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return ret;
+}
@@ -0,0 +1,41 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+
+#include "serialdevice.h"
+
+#include <psp2kern/types.h>
+
+/* Loopback mode, echoes received data to the same adapter from a driver thread */
+
+typedef void (*loopback_resume)(rxTransfer *xfer);
+
+int loopback_init(void);
+int loopback_term(void);
+
+int loopback_start(serialDevice *ctx, int size, loopback_resume resume);
+int loopback_stop(void);
+int loopback_active(void);
+void loopback_detach(void);
+
+int loopback_put(serialDevice *ctx, const unsigned char *buf, int len);
+int loopback_hold(serialDevice *ctx, rxTransfer *xfer);
+
+#endif // __LOOPBACK_H__
@@ -23,25 +23,56 @@
 #include "devices/ch34x.h"
 #include "serialdevice.h"
 #include "ringbuf.h"
+#include "softflow.h"
+#include "tracering.h"
+#include "histogram.h"
+#include "modbus.h"
+#include "msgqueue.h"
+#include "shmring.h"
+#include "crc.h"
+#include "framing.h"
+#include "rs485.h"
+#include "dmx.h"
+#include "xmodem.h"
+#include "autobaud.h"
+#include "rxworker.h"
+#include "loopback.h"
 
 #include <psp2kern/kernel/cpu.h>
 #include <psp2kern/kernel/debug.h>
 #include <psp2kern/kernel/modulemgr.h>
 #include <psp2kern/kernel/suspend.h>
 #include <psp2kern/kernel/sysclib.h>
+#include <psp2kern/kernel/sysmem.h>
 #include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
 #include <psp2kern/kernel/threadmgr/event_flags.h>
 #include <psp2kern/usbd.h>
 #include <psp2kern/usbserv.h>
 #include <string.h>
 
-#define EVF_SEND 1
-#define EVF_RECV 2
-#define EVF_CTRL 4
-
 #define MAX_RINGBUF_SIZE 0x1000
+#define STREAM_RINGBUF_SIZE 0x100000
+#define MSGQ_SIZE 0x4000
+
+#define STREAM_DEFAULT_TRANSFERS 8
+#define STREAM_DEFAULT_TRANSFER_SIZE 0x4000
+#define STREAM_MAX_TRANSFER_SIZE 0x10000
+#define STREAM_STOP_TIMEOUT 100 // ms
+
+#define RX_WORKER_DEFAULT_PRIORITY 64
+
+#define LOOPBACK_DEFAULT_SIZE 0x10000
+#define LOOPBACK_MAX_SIZE 0x100000
+
+#define DMX_DEFAULT_BREAK 176 // us
+#define DMX_DEFAULT_MAB 16    // us
+/* transmitter minimums from E1.11 */
+#define DMX_MIN_BREAK 92
+#define DMX_MIN_MAB 12
 
 SceUID transfer_ev;
+SceUID status_ev;
 
 static uint8_t started = 0;
 static uint8_t plugged = 0;
@@ -65,16 +96,48 @@ static int _init_ctx()
   ctx.in_pipe_id        = 0;
   ctx.out_pipe_id       = 0;
   ctx.control_pipe_id   = 0;
+  ctx.intr_pipe_id      = 0;
 
   ctx.type      = TYPE_UNKNOWN;
   ctx.vendor    = 0;
   ctx.product   = 0;
   ctx.ftdi_type = TYPE_BM; /* chip type */
   ctx.baudrate  = 9600;
+  ctx.actual_baudrate = 9600;
+  ctx.rx_latency_us   = 16000;
+  ctx.char_bits       = 10;
+  ctx.line_bits       = BITS_8;
+  ctx.line_stop       = STOP_BIT_1;
+  ctx.line_parity     = PARITY_NONE;
+  ctx.tx_fifo_size    = 128;
 
   ctx.writebuffer_chunksize = 4096;
   ctx.max_packet_size       = 64;
 
+  ctx.ftdi_bitmode       = BITMODE_RESET;
+  ctx.rx_default.buffer  = ctx.read_buffer;
+  ctx.rx_default.size    = ctx.max_packet_size;
+  ctx.rx_default.retired = 0;
+  ctx.rx_stream_count    = 0;
+  ctx.rx_stream_memblock = -1;
+  ctx.rx_inflight        = 0;
+
+  ctx.flowctrl     = FLOW_NONE;
+  ctx.soft_flow    = 0;
+  ctx.tx_stopped   = 0;
+  ctx.rx_throttled = 0;
+  ctx.tx_timeout   = 0;
+
+  ctx.rs485_mode  = RS485_OFF;
+  ctx.rs485_flags = 0;
+  ctx.rs485_tx_on = 0;
+  ctx.rs485_echo  = 0;
+
+  ctx.ftdi_msr    = 0;
+  ctx.ftdi_parmrk = 0;
+  memset(&ctx.line_status, 0, sizeof(ctx.line_status));
+  memset(&ctx.stats, 0, sizeof(ctx.stats));
+
   return 0;
 }
 
@@ -88,38 +151,205 @@ static int libusbserial_sysevent_handler(int resume, int eventid, void *args, vo
   return 0;
 }
 
+static void _stats_error(int32_t code)
+{
+  int i;
+  for (i = 0; i < LIBUSBSERIAL_STATS_ERROR_CODES; i++)
+  {
+    if (ctx.stats.errors[i].count == 0)
+      ctx.stats.errors[i].code = code;
+    if (ctx.stats.errors[i].code == code)
+    {
+      ctx.stats.errors[i].count++;
+      return;
+    }
+  }
+  ctx.stats.errors_other++;
+}
+
 void _callback_control(int32_t result, int32_t count, void *arg)
 {
-  trace("config cb result: %08x, count: %d\n", result, count);
+  trace_event(TRACE_CTRL_DONE, count, result);
+  histogram_record(LATENCY_CONTROL, ksceKernelGetSystemTimeLow() - ctx.ctrl_submit_ts);
+  ctx.stats.callbacks++;
+  if (result != 0)
+  {
+    ctx.stats.control_errors++;
+    _stats_error(result);
+  }
   ksceKernelSetEventFlag(transfer_ev, EVF_CTRL);
 }
 
 void _callback_send(int32_t result, int32_t count, void *arg)
 {
-  trace("send cb result: %08x, count: %d\n", result, count);
+  trace_event(TRACE_TX_DONE, count, result);
+  ctx.tx_done_ts = ksceKernelGetSystemTimeLow();
+  histogram_record(LATENCY_TX, ctx.tx_done_ts - ctx.tx_submit_ts);
+  ctx.stats.callbacks++;
   if (result == 0)
+  {
     *(int *)arg = count;
+    ctx.stats.tx_transfers++;
+    ctx.stats.tx_bytes += count;
+  }
+  else
+  {
+    ctx.stats.tx_errors++;
+    _stats_error(result);
+  }
   ksceKernelSetEventFlag(transfer_ev, EVF_SEND);
 }
 
-void usb_read(void);
-void _callback_recv(int32_t result, int32_t count, void *arg)
+static void _modem_changed(void)
+{
+  shmring_status(plugged, ctx.line_status.modem_status, ctx.modem_changes);
+  // latched, a waiter clears it when it wakes and then looks at modem_changes
+  ksceKernelSetEventFlag(status_ev, EVF_MODEM);
+}
+
+/* emulated flow control follows whichever ring receives */
+static void _softflow_rx_level(void)
+{
+  if (shmring_active())
+    softflow_check_rx(&ctx, shmring_available(), shmring_size());
+  else
+    softflow_check_rx(&ctx, ringbuf_available(), ringbuf_size());
+}
+
+/* a DMX, XMODEM or loopback thread owns the OUT pipe */
+static int _tx_busy(void)
+{
+  return dmx_active() || xmodem_active() || loopback_active();
+}
+
+/*
+ * In message mode the device's short packet ends a record, so the transfer
+ * must span a whole frame instead of a single packet.
+ */
+static unsigned int _rx_default_size(void)
 {
-  trace("recv cb result: %08x, count: %d\n", result, count);
+  if (ctx.frame_mode == FRAME_MESSAGE)
+    return LIBUSBSERIAL_MAX_FRAME;
+  return ctx.max_packet_size;
+}
+
+void usb_read(rxTransfer *xfer);
+/* loopback mode made room for a transfer it held back */
+static void _rx_resume(rxTransfer *xfer)
+{
+  if (!xfer->retired && plugged)
+    usb_read(xfer);
+}
+
+/* RX side of a completion, in the USB callback or the RX worker, ts is when it arrived */
+static void _rx_complete(rxTransfer *xfer, int32_t result, int32_t count, uint32_t ts)
+{
+  ctx.stats.callbacks++;
+
+  if (result != 0)
+  {
+    ctx.stats.rx_errors++;
+    _stats_error(result);
+  }
+  else
+  {
+    ctx.stats.rx_transfers++;
+  }
 
   if (result == 0 && count > 0)
   {
+    unsigned char *payload = xfer->buffer;
+    int len = count;
+
     // filter FTDI
-    if (ctx.type == TYPE_FTDI && count > 2)
+    if (ctx.type == TYPE_FTDI)
+    {
+        uint32_t changes = ctx.modem_changes;
+
+        if (ctx.ftdi_parmrk && xfer == &ctx.rx_default)
+        {
+            len     = _ftdi_mark_errors(&ctx, xfer->buffer, count, ctx.mark_buffer);
+            payload = ctx.mark_buffer;
+        }
+        else
+        {
+            len = _ftdi_strip_status(&ctx, xfer->buffer, count, &payload);
+        }
+
+        if (changes != ctx.modem_changes)
+        {
+            trace_event(TRACE_MODEM, ctx.ftdi_msr, ctx.line_status.line_status);
+            _modem_changed();
+        }
+    }
+
+    if (ctx.rs485_echo > 0 && len > 0)
+        len = rs485_filter_echo(&ctx, &payload, len);
+
+    if (ctx.soft_flow && len > 0)
+        len = softflow_filter_rx(&ctx, payload, len);
+
+    if (len > 0 && loopback_put(&ctx, payload, len) == 0)
+    {
+        ctx.stats.rx_bytes += len;
+    }
+    else if (len > 0 && ctx.frame_mode)
+    {
+        framing_rx(&ctx, payload, len, ts);
+        ctx.stats.rx_bytes += len;
+    }
+    else if (len > 0 && shmring_active())
+    {
+        shmring_put(payload, len);
+        ctx.stats.rx_bytes += len;
+        trace_event(TRACE_RING_PUT, len, shmring_available());
+    }
+    else if (len > 0)
     {
-        ringbuf_put_clobber(ctx.read_buffer+2, count-2);
+        ringbuf_put_clobber(payload, len);
+        ctx.stats.rx_bytes += len;
+        trace_event(TRACE_RING_PUT, len, ringbuf_available());
     }
-    else if (ctx.type != TYPE_FTDI)
+
+    if (ctx.soft_flow)
+        _softflow_rx_level();
+  }
+
+  if (!xfer->retired && plugged && !loopback_hold(&ctx, xfer))
+    usb_read(xfer);
+
+  // only now are the buffer and the ring free of this transfer
+  __atomic_sub_fetch(&ctx.rx_inflight, 1, __ATOMIC_RELEASE);
+}
+
+void _callback_recv(int32_t result, int32_t count, void *arg)
+{
+  rxTransfer *xfer = (rxTransfer *)arg;
+  uint32_t ts      = ksceKernelGetSystemTimeLow();
+  trace_event(TRACE_RX_DONE, count, result);
+
+  if (rxworker_push(xfer, result, count, ts) < 0)
+    _rx_complete(xfer, result, count, ts);
+}
+
+void usb_read_status(void);
+void _callback_status(int32_t result, int32_t count, void *arg)
+{
+  trace_event(TRACE_STATUS_DONE, count, result);
+  ctx.stats.callbacks++;
+
+  if (result == 0 && count > 0)
+  {
+    if (_ch34x_update_status(&ctx, ctx.ch34x_status_buffer, count))
     {
-        ringbuf_put_clobber(ctx.read_buffer, count);
+      trace_event(TRACE_MODEM, ctx.ch34x_msr, 0);
+      ctx.modem_changes++;
+      _modem_changed();
     }
   }
-  usb_read();
+
+  if (plugged && ctx.intr_pipe_id > 0)
+    usb_read_status();
 }
 
 int _control_transfer(int rtype, int req, int val, int idx, void *data, int len)
@@ -131,10 +361,16 @@ int _control_transfer(int rtype, int req, int val, int idx, void *data, int len)
   _dr.wIndex        = idx;
   _dr.wLength       = len;
 
+  ctx.stats.control_transfers++;
+  ctx.ctrl_submit_ts = ksceKernelGetSystemTimeLow();
   int ret = ksceUsbdControlTransfer(ctx.control_pipe_id, &_dr, data, _callback_control, NULL);
+  trace_event(TRACE_CTRL_SUBMIT, (req << 16) | (val & 0xFFFF), ret);
   if (ret < 0)
+  {
+    ctx.stats.submit_errors++;
+    _stats_error(ret);
     return ret;
-  trace("waiting ef (cfg)\n");
+  }
   ksceKernelWaitEventFlag(transfer_ev, EVF_CTRL, SCE_EVENT_WAITCLEAR_PAT | SCE_EVENT_WAITAND, NULL, 0);
   return 0;
 }
@@ -143,25 +379,45 @@ int _send(unsigned char *request, unsigned int length)
 {
   transferred = 0;
   // transfer
-  trace("sending 0x%08x\n", request);
+  ctx.tx_submit_ts = ksceKernelGetSystemTimeLow();
   int ret = ksceUsbdBulkTransfer(ctx.out_pipe_id, request, length, _callback_send, &transferred);
-  trace("send 0x%08x\n", ret);
+  trace_event(TRACE_TX_SUBMIT, length, ret);
   if (ret < 0)
+  {
+    ctx.stats.submit_errors++;
+    _stats_error(ret);
     return ret;
+  }
   // wait for eventflag
-  trace("waiting ef (send)\n");
   ksceKernelWaitEventFlag(transfer_ev, EVF_SEND, SCE_EVENT_WAITCLEAR_PAT | SCE_EVENT_WAITAND, NULL, 0);
   return transferred;
 }
 
-void usb_read()
+void usb_read(rxTransfer *xfer)
+{
+  __atomic_add_fetch(&ctx.rx_inflight, 1, __ATOMIC_RELAXED);
+  int ret = ksceUsbdBulkTransfer(ctx.in_pipe_id, xfer->buffer, xfer->size, _callback_recv, xfer);
+  trace_event(TRACE_RX_SUBMIT, xfer->size, ret);
+
+  if (ret < 0)
+  {
+    __atomic_sub_fetch(&ctx.rx_inflight, 1, __ATOMIC_RELAXED);
+    ctx.stats.submit_errors++;
+    _stats_error(ret);
+    ksceDebugPrintf("ksceUsbdBulkTransfer(in) error: 0x%08x\n", ret);
+  }
+}
+
+void usb_read_status()
 {
-  int ret = ksceUsbdBulkTransfer(ctx.in_pipe_id, ctx.read_buffer, ctx.max_packet_size, _callback_recv, NULL);
+  int ret = ksceUsbdInterruptTransfer(ctx.intr_pipe_id, ctx.ch34x_status_buffer, ctx.ch34x_status_size,
+                                      _callback_status, NULL);
 
   if (ret < 0)
   {
-    ksceDebugPrintf("ksceUsbdInterruptTransfer(in) error: 0x%08x\n", ret);
-    // error out
+    ctx.stats.submit_errors++;
+    _stats_error(ret);
+    ksceDebugPrintf("ksceUsbdInterruptTransfer(status) error: 0x%08x\n", ret);
   }
 }
 
@@ -255,11 +511,13 @@ int libusbserial_attach(int device_id)
 
       // Determine maximum packet size
       ctx.max_packet_size = _ftdi_determine_max_packet_size(&ctx);
+      ctx.tx_fifo_size    = _ftdi_determine_tx_fifo_size(&ctx);
 
     }
     else if (ctx.type == TYPE_CH34X)
     {
       ctx.max_packet_size = _ch34x_determine_max_packet_size(&ctx);
+      ctx.tx_fifo_size    = _ch34x_determine_tx_fifo_size(&ctx);
     }
 
     trace("max_packet_size = %d\n", ctx.max_packet_size);
@@ -278,6 +536,15 @@ int libusbserial_attach(int device_id)
         ctx.in_pipe_id = ksceUsbdOpenPipe(device_id, endpoint);
         trace("= 0x%08x\n", ctx.in_pipe_id);
       }
+      else if ((endpoint->bEndpointAddress & SCE_USBD_ENDPOINT_DIRECTION_BITS) == SCE_USBD_ENDPOINT_DIRECTION_IN && endpoint->bmAttributes == 3 && ctx.type == TYPE_CH34X)
+      {
+        trace("opening interrupt pipe\n");
+        ctx.intr_pipe_id = ksceUsbdOpenPipe(device_id, endpoint);
+        ctx.ch34x_status_size = endpoint->wMaxPacketSize;
+        if (ctx.ch34x_status_size > sizeof(ctx.ch34x_status_buffer))
+          ctx.ch34x_status_size = sizeof(ctx.ch34x_status_buffer);
+        trace("= 0x%08x\n", ctx.intr_pipe_id);
+      }
       else if ((endpoint->bEndpointAddress & SCE_USBD_ENDPOINT_DIRECTION_BITS) == SCE_USBD_ENDPOINT_DIRECTION_OUT)
       {
         trace("opening out pipe\n");
@@ -287,12 +554,13 @@ int libusbserial_attach(int device_id)
       endpoint = (SceUsbdEndpointDescriptor *)ksceUsbdScanStaticDescriptor(device_id, endpoint,
                                                                            SCE_USBD_DESCRIPTOR_ENDPOINT);
 
-      if (ctx.out_pipe_id > 0 && ctx.in_pipe_id > 0) break;
+      if (ctx.out_pipe_id > 0 && ctx.in_pipe_id > 0 && (ctx.type != TYPE_CH34X || ctx.intr_pipe_id > 0)) break;
 
     }
 
     ctx.control_pipe_id = ksceUsbdOpenPipe(device_id, NULL);
-    // set default config
+    // set default config, it completes through _callback_control() too
+    ctx.ctrl_submit_ts = ksceKernelGetSystemTimeLow();
     int r = ksceUsbdSetConfiguration(ctx.control_pipe_id, cdesc->bConfigurationValue, _callback_control, NULL);
 #ifdef NDEBUG
     (void)r;
@@ -303,13 +571,31 @@ int libusbserial_attach(int device_id)
 
     trace("doing reset\n");
 
+    ctx.flowctrl     = FLOW_NONE;
+    ctx.soft_flow    = 0;
+    ctx.tx_stopped   = 0;
+    ctx.rx_throttled = 0;
+    ctx.rs485_mode   = RS485_OFF;
+    ctx.rs485_tx_on  = 0;
+    ctx.rs485_echo   = 0;
+    // chips come out of reset at 8N1
+    ctx.char_bits    = 10;
+    ctx.line_bits    = BITS_8;
+    ctx.line_stop    = STOP_BIT_1;
+    ctx.line_parity  = PARITY_NONE;
+
     if (ctx.type == TYPE_FTDI)
     {
       _ftdi_reset();
+      // chip default latency timer
+      ctx.rx_latency_us = 16000;
     }
     else if (ctx.type == TYPE_CH34X)
     {
       _ch34x_reset(&ctx);
+      // the interrupt endpoint only reports changes from here on
+      ctx.line_status.modem_status = ctx.ch34x_msr;
+      ctx.rx_latency_us = 1000;
     }
 
     ringbuf_reset();
@@ -334,18 +620,86 @@ int libusbserial_attach(int device_id)
     if (ctx.out_pipe_id > 0 && ctx.in_pipe_id > 0 && ctx.control_pipe_id)
     {
       plugged = 1;
-      usb_read();
+      ringbuf_abort(0);
+      msgq_abort(0);
+      shmring_abort(0);
+      shmring_status(1, ctx.line_status.modem_status, ctx.modem_changes);
+      ctx.rx_default.size    = _rx_default_size();
+      ctx.rx_default.retired = 0;
+      usb_read(&ctx.rx_default);
+      if (ctx.intr_pipe_id > 0)
+        usb_read_status();
       return SCE_USBD_ATTACH_SUCCEEDED;
     }
   }
   return SCE_USBD_ATTACH_FAILED;
 }
 
+/*
+ * Undo a retire of the default transfer. If it is still out it resubmits
+ * itself on completion, otherwise it is submitted here.
+ */
+static void _rx_default_resume(void)
+{
+  ctx.rx_default.retired = 0;
+  if (plugged && __atomic_load_n(&ctx.rx_inflight, __ATOMIC_ACQUIRE) == 0)
+    usb_read(&ctx.rx_default);
+}
+
+/* Wait until no IN transfer is out or still being handled, -1 on timeout */
+static int _rx_drain(void)
+{
+  int waited = 0;
+
+  while (__atomic_load_n(&ctx.rx_inflight, __ATOMIC_ACQUIRE) > 0)
+  {
+    if (waited++ >= STREAM_STOP_TIMEOUT)
+      return -1;
+    ksceKernelDelayThread(1000);
+  }
+  return 0;
+}
+
+/* buffers of stream transfers that didn't come back at stream_stop */
+static SceUID stream_orphan = -1;
+
+static void _stream_orphan_release(void)
+{
+  if (stream_orphan >= 0)
+    ksceKernelFreeMemBlock(stream_orphan);
+  stream_orphan = -1;
+}
+
+static void _stream_release(void)
+{
+  unsigned int i;
+  for (i = 0; i < ctx.rx_stream_count; i++)
+    ctx.rx_stream[i].retired = 1;
+
+  if (ctx.rx_stream_memblock >= 0)
+    ksceKernelFreeMemBlock(ctx.rx_stream_memblock);
+
+  ctx.rx_stream_memblock = -1;
+  ctx.rx_stream_count    = 0;
+}
+
 int libusbserial_detach(int device_id)
 {
-  ctx.in_pipe_id  = 0;
-  ctx.out_pipe_id = 0;
-  plugged         = 0;
+  ctx.in_pipe_id   = 0;
+  ctx.out_pipe_id  = 0;
+  ctx.intr_pipe_id = 0;
+  plugged          = 0;
+  _stream_release();
+  _stream_orphan_release();
+  loopback_detach();
+  _modem_changed();
+  // release blocked readers
+  ringbuf_abort(1);
+  msgq_abort(1);
+  shmring_abort(1);
+  // release writer blocked by XOFF
+  ctx.tx_stopped = 0;
+  ksceKernelSetEventFlag(status_ev, EVF_XON);
   return -1;
 }
 
@@ -373,6 +727,40 @@ int libusbserial_start()
       return -1;
   }
 
+  if (msgq_init(MSGQ_SIZE) < 0)
+  {
+      ringbuf_term();
+      EXIT_SYSCALL(state);
+      return -1;
+  }
+
+  if (shmring_init() < 0)
+  {
+      msgq_term();
+      ringbuf_term();
+      EXIT_SYSCALL(state);
+      return -1;
+  }
+
+  if (dmx_init() < 0)
+  {
+      shmring_term();
+      msgq_term();
+      ringbuf_term();
+      EXIT_SYSCALL(state);
+      return -1;
+  }
+
+  if (loopback_init() < 0)
+  {
+      dmx_term();
+      shmring_term();
+      msgq_term();
+      ringbuf_term();
+      EXIT_SYSCALL(state);
+      return -1;
+  }
+
   started = 1;
   int ret = ksceUsbServMacSelect(2, 0);
 #ifdef NDEBUG
@@ -395,22 +783,37 @@ int libusbserial_stop()
     _error_return(-1, "Not started");
   }
 
+  // output threads still need the pipes to finish what they are sending
+  dmx_term();
+  xmodem_cancel();
+  loopback_term();
+  rxworker_stop();
+
   started = 0;
   plugged = 0;
   if (ctx.in_pipe_id)
     ksceUsbdClosePipe(ctx.in_pipe_id);
   if (ctx.out_pipe_id)
     ksceUsbdClosePipe(ctx.out_pipe_id);
+  if (ctx.intr_pipe_id)
+    ksceUsbdClosePipe(ctx.intr_pipe_id);
   if (ctx.control_pipe_id)
     ksceUsbdClosePipe(ctx.control_pipe_id);
   ksceUsbdUnregisterDriver(&libusbserialDriver);
   ksceUsbServMacSelect(2, 1);
+  _stream_release();
+  _stream_orphan_release();
 
   ksceKernelSetEventFlag(transfer_ev, EVF_CTRL);
   ksceKernelSetEventFlag(transfer_ev, EVF_SEND);
   ksceKernelSetEventFlag(transfer_ev, EVF_RECV);
+  // release writer blocked by XOFF
+  ctx.tx_stopped = 0;
+  ksceKernelSetEventFlag(status_ev, EVF_XON);
 
   ringbuf_term();
+  msgq_term();
+  shmring_term();
 
   EXIT_SYSCALL(state);
 
@@ -432,6 +835,9 @@ int libusbserial_set_baudrate(int baudrate)
   if (!started || !plugged)
     _error_return(-2, "USB device unavailable");
 
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
   if (ctx.type == TYPE_FTDI)
       ret = _ftdi_set_baudrate(&ctx, baudrate);
   else if (ctx.type == TYPE_CH34X)
@@ -447,6 +853,50 @@ int libusbserial_set_baudrate(int baudrate)
   return 0;
 }
 
+int libusbserial_get_actual_baudrate(void)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  ret = ctx.actual_baudrate;
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_query_baudrate(int baudrate, int *actual, int *ppm)
+{
+  int rate = -1;
+  int error;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type == TYPE_FTDI)
+    rate = _ftdi_query_baudrate(&ctx, baudrate);
+  else if (ctx.type == TYPE_CH34X)
+    rate = _ch34x_query_baudrate(&ctx, baudrate);
+
+  if (rate < 0)
+    _error_return(-1, "Unsupported baudrate");
+
+  error = (int)(((int64_t)rate - baudrate) * 1000000 / baudrate);
+
+  if (actual)
+    ksceKernelMemcpyKernelToUser(actual, &rate, sizeof(rate));
+  if (ppm)
+    ksceKernelMemcpyKernelToUser(ppm, &error, sizeof(error));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
 int libusbserial_set_line_property(enum bits_type bits, enum stopbits_type sbit, enum parity_type parity,
                             enum break_type break_type)
 {
@@ -458,6 +908,9 @@ int libusbserial_set_line_property(enum bits_type bits, enum stopbits_type sbit,
 
   trace("libusbserial_set_line_property(%d,%d,%d,%d)\n", bits, sbit, parity, break_type);
 
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
   if (ctx.type == TYPE_FTDI)
   {
     if (_ftdi_set_line_property(bits, sbit, parity, break_type) < 0)
@@ -474,27 +927,93 @@ int libusbserial_set_line_property(enum bits_type bits, enum stopbits_type sbit,
       return -1;
     }
   }
+  ctx.char_bits   = 1 + bits + (parity != PARITY_NONE) + (sbit == STOP_BIT_1 ? 1 : 2);
+  ctx.line_bits   = bits;
+  ctx.line_stop   = sbit;
+  ctx.line_parity = parity;
   EXIT_SYSCALL(state);
 
   return 0;
 }
 
-int libusbserial_write_data(const unsigned char *buf, int size)
+int libusbserial_autobaud(const int *candidates, int count, int sync, int flags, SceUInt timeout,
+                          struct libusbserial_autobaud_result *result)
 {
-  int offset = 0;
-  int actual_length;
+  int rates[AUTOBAUD_MAX_CANDIDATES];
+  struct libusbserial_autobaud_result res;
+  int ret;
+  int i;
   uint32_t state;
   ENTER_SYSCALL(state);
 
   if (!started || !plugged)
     _error_return(-2, "USB device unavailable");
 
+  if (candidates && (count <= 0 || count > AUTOBAUD_MAX_CANDIDATES))
+    _error_return(-1, "Invalid candidate count");
+
+  if (sync > 0xFF || timeout == 0)
+    _error_return(-1, "Invalid argument");
+
+  // scoring reads the byte ring
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  if (candidates)
+  {
+    ksceKernelMemcpyUserToKernel(rates, candidates, count * sizeof(int));
+    for (i = 0; i < count; i++)
+    {
+      if (rates[i] <= 0)
+        _error_return(-1, "Unsupported baudrate");
+    }
+  }
+
+  ret = autobaud_run(&ctx, candidates ? rates : NULL, count, sync, flags, timeout, &res);
+  if (ret < 0)
+    _error_return(-1, "set baudrate failed");
+
+  if (result)
+    ksceKernelMemcpyKernelToUser(result, &res, sizeof(res));
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+/*
+ * Send size bytes of user memory in chunks, returns bytes sent or < 0.
+ * With a crc type its CRC is taken while each chunk is still in cache and
+ * goes out after the data, in the last chunk if there is room.
+ */
+static int _write_chunks(const unsigned char *buf, int size, enum crc_type crc_type)
+{
+  uint32_t crc = crc_start(crc_type);
+  int crc_size = crc_len(crc_type);
+  int offset   = 0;
+  SceUInt t    = ctx.tx_timeout;
+  int actual_length;
+
   trace("size: %d\n", size);
 
   while (offset < size)
   {
     int write_size = ctx.writebuffer_chunksize;
 
+    // with XON/XOFF emulation keep chunks small so XOFF is honoured quickly
+    if (ctx.soft_flow)
+    {
+      write_size = ctx.max_packet_size;
+      // one budget for the whole write, what went out so far is reported
+      if (softflow_wait_tx(&ctx, ctx.tx_timeout ? &t : NULL) < 0 || !plugged)
+      {
+        trace("wait for XON failed\n");
+        return offset ? offset : -1;
+      }
+    }
+
     if (offset + write_size > size)
       write_size = size - offset;
 
@@ -502,124 +1021,931 @@ int libusbserial_write_data(const unsigned char *buf, int size)
 
     ksceKernelMemcpyUserToKernel(ctx.writebuffer, buf + offset, write_size);
 
+    if (crc_size && offset + write_size == size && write_size + crc_size <= (int)sizeof(ctx.writebuffer))
+    {
+      crc = crc_update(crc_type, crc, ctx.writebuffer, write_size);
+      crc_put(crc_type, crc_final(crc_type, crc), ctx.writebuffer + write_size);
+      if (_send((unsigned char *)ctx.writebuffer, write_size + crc_size) != write_size + crc_size)
+        return -1;
+      return size;
+    }
+
     actual_length = _send((unsigned char *)ctx.writebuffer, write_size);
     if (actual_length < 0)
       return -1;
 
+    if (crc_size)
+      crc = crc_update(crc_type, crc, ctx.writebuffer, actual_length);
     offset += actual_length;
   }
 
-  EXIT_SYSCALL(state);
+  if (crc_size)
+  {
+    crc_put(crc_type, crc_final(crc_type, crc), ctx.writebuffer);
+    if (_send((unsigned char *)ctx.writebuffer, crc_size) != crc_size)
+      return -1;
+  }
 
   return offset;
 }
 
-int libusbserial_read_data_blocking(unsigned char *buf, int size, SceUInt timeout)
+/* _write_chunks() with the RS-485 transceiver switched around it */
+static int _write_from_user(const unsigned char *buf, int size, enum crc_type crc_type)
 {
-  uint32_t state;
-  unsigned char kbuf[64];
-  ENTER_SYSCALL(state);
-  int ret = -1;
-  int left = size;
-  int pos = 0;
-  while (left > 0)
-  {
-    if (left >= 64)
-      ret = ringbuf_get_wait(kbuf, 64, timeout);
-    else
-      ret = ringbuf_get_wait(kbuf, left, timeout);
-    if (ret > 0)
-      ksceKernelMemcpyKernelToUser(buf+pos, kbuf, ret);
-    else
-      break;
-
-    pos += ret;
-    left -= ret;
-  }
-  EXIT_SYSCALL(state);
+  int wire = size + crc_len(crc_type);
+  int ret;
+
+  if (_tx_busy())
+    return -1;
+  if (rs485_tx_begin(&ctx, wire) < 0)
+    return -1;
+  ret = _write_chunks(buf, size, crc_type);
+  rs485_tx_end(&ctx, wire);
   return ret;
-
 }
 
-int libusbserial_read_data(unsigned char *buf, int size)
+int libusbserial_write_data(const unsigned char *buf, int size)
 {
+  int ret;
   uint32_t state;
-  // we use small batches because we have small stack by default.
-  // TODO: do batch copy in ringbuf?
-  unsigned char kbuf[64];
   ENTER_SYSCALL(state);
-  int ret = -1;
-  int left = size;
-  int pos = 0;
-  int total = 0;
-  while (left > 0)
-  {
-    if (left >= 64)
-      ret = ringbuf_get(kbuf, 64);
-    else
-      ret = ringbuf_get(kbuf, left);
 
-    if (ret > 0)
-      ksceKernelMemcpyKernelToUser(buf+pos, kbuf, ret);
-    else
-      break;
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  ret = _write_from_user(buf, size, CRC_NONE);
+  if (ret < 0)
+    _error_return(-1, "write failed");
 
-    pos += ret;
-    left -= 64;
-    total += ret;
-  }
   EXIT_SYSCALL(state);
-  return total;
+
+  return ret;
 }
 
-int libusbserial_available_count()
+/* reader made room in the ring, let emulated flow control release the peer */
+static void _rx_consumed(int n)
 {
-    return ringbuf_available();
+  if (n > 0)
+    trace_event(TRACE_RING_GET, n, ringbuf_available());
+  if (ctx.soft_flow && ctx.rx_throttled)
+    _softflow_rx_level();
 }
 
-int libusbserial_tciflush()
+/* CRC taken by _read_to_user, leaving out the last skip bytes of each call */
+typedef struct
 {
-  uint32_t state;
-  ENTER_SYSCALL(state);
+  enum crc_type type;
+  uint32_t crc;
+  int skip;
+} crcRun;
 
-  if (!started || !plugged)
-    _error_return(-2, "USB device unavailable");
+/* Drop what the chip and the ring hold */
+static int _rx_flush(void)
+{
+  int ret = 0;
 
   if (ctx.type == TYPE_FTDI)
-  {
-    if (_ftdi_tciflush() < 0)
-      _error_return(-1, "Purge of RX buffer failed");
-  }
+    ret = _ftdi_tciflush();
   else if (ctx.type == TYPE_CH34X)
-  {
-    if (_ch34x_tciflush() < 0)
-      _error_return(-1, "Purge of RX buffer failed");
-  }
+    ret = _ch34x_tciflush(&ctx);
 
   // Invalidate data in the readbuffer
   ringbuf_reset();
-
-  EXIT_SYSCALL(state);
-  return 0;
+  return ret < 0 ? -1 : 0;
 }
 
-
-int libusbserial_tcoflush()
+/*
+ * Move up to size buffered bytes to user memory, in small batches because the
+ * kernel stack is small. The copied bytes go into rx_crc unless it is NULL.
+ */
+static int _read_to_user(unsigned char *buf, int size, crcRun *rx_crc)
 {
-  uint32_t state;
-  ENTER_SYSCALL(state);
-
-  if (!started || !plugged)
-    _error_return(-2, "USB device unavailable");
+  unsigned char kbuf[64];
+  int total = 0;
 
-  if (ctx.type == TYPE_FTDI)
+  while (total < size)
+  {
+    int ret = ringbuf_get(kbuf, (size - total < 64) ? size - total : 64);
+    _rx_consumed(ret);
+    if (ret <= 0)
+      break;
+
+    if (rx_crc)
+    {
+      int n = size - rx_crc->skip - total;
+      if (n > ret)
+        n = ret;
+      if (n > 0)
+        rx_crc->crc = crc_update(rx_crc->type, rx_crc->crc, kbuf, n);
+    }
+
+    ksceKernelMemcpyKernelToUser(buf + total, kbuf, ret);
+    total += ret;
+  }
+  return total;
+}
+
+/*
+ * termios VMIN/VTIME style read. Returns when min bytes (at least 1) have
+ * been read, when the line was idle for interbyte us after at least one
+ * byte, or at timeout us after the call. 0 disables either timer.
+ */
+static int _read_timed(unsigned char *buf, int size, int min, SceUInt timeout, SceUInt interbyte, crcRun *rx_crc)
+{
+  uint32_t start = ksceKernelGetSystemTimeLow();
+  int total      = 0;
+
+  if (min < 1)
+    min = 1;
+  if (min > size)
+    min = size;
+
+  for (;;)
+  {
+    SceUInt wait = 0;
+    uint32_t now;
+
+    total += _read_to_user(buf + total, size - total, rx_crc);
+    if (total >= min)
+      break;
+    if (!plugged)
+      return total ? total : -2;
+
+    now = ksceKernelGetSystemTimeLow();
+    if (timeout)
+    {
+      if (now - start >= timeout)
+        break;
+      wait = timeout - (now - start);
+    }
+    if (interbyte && total > 0)
+    {
+      uint32_t idle = now - ringbuf_last_put();
+      if (idle >= interbyte)
+        break;
+      if (!wait || interbyte - idle < wait)
+        wait = interbyte - idle;
+    }
+
+    // timeouts are checked above on the next pass
+    ringbuf_wait(1, size - total, wait ? &wait : NULL);
+  }
+  return total;
+}
+
+int libusbserial_read_data_blocking(unsigned char *buf, int size, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (size <= 0)
+    _error_return(-1, "Invalid size");
+
+  // timeout of 0 never waited
+  if (timeout)
+    ret = _read_timed(buf, size, size, timeout, 0, NULL);
+  else
+    ret = _read_to_user(buf, size, NULL);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_read_data_timed(unsigned char *buf, int size, int min, SceUInt timeout, SceUInt interbyte)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (size <= 0)
+    _error_return(-1, "Invalid size");
+
+  ret = _read_timed(buf, size, min, timeout, interbyte, NULL);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+/*
+ * One record ending in term, searched in the ring so only the record is
+ * copied out. Returns its length with the terminator, size or a full
+ * ring if the buffer filled up first, 0 on timeout with the partial
+ * record left buffered.
+ */
+static int _read_until(unsigned char *buf, int size, const unsigned char *term, int term_len, SceUInt timeout,
+                       crcRun *rx_crc)
+{
+  uint32_t start = ksceKernelGetSystemTimeLow();
+  uint32_t tail  = ringbuf_tail();
+  int scanned    = 0;
+
+  for (;;)
+  {
+    SceUInt wait = 0;
+    uint32_t now;
+    int avail, n;
+
+    // scanned counts from the tail, overwrites and flushes move it
+    if (ringbuf_tail() != tail)
+      scanned = 0;
+    tail = ringbuf_tail();
+
+    n = ringbuf_find(term, term_len, scanned, size);
+
+    if (n > 0)
+      return _read_to_user(buf, n, rx_crc);
+
+    avail = ringbuf_available();
+    if (avail >= size)
+      return _read_to_user(buf, size, rx_crc);
+    // waiting for one more byte would only overwrite the oldest
+    if (avail == ringbuf_size() - 1)
+      return _read_to_user(buf, avail, rx_crc);
+    if (!plugged)
+      return -2;
+
+    // a match can still end in new data
+    scanned = avail - (term_len - 1);
+    if (scanned < 0)
+      scanned = 0;
+
+    now = ksceKernelGetSystemTimeLow();
+    if (timeout)
+    {
+      if (now - start >= timeout)
+        return 0;
+      wait = timeout - (now - start);
+    }
+    ringbuf_wait(avail + 1, size, wait ? &wait : NULL);
+  }
+}
+
+int libusbserial_read_until(unsigned char *buf, int size, unsigned char delim, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (size <= 0)
+    _error_return(-1, "Invalid size");
+
+  ret = _read_until(buf, size, &delim, 1, timeout, NULL);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_read_until_seq(unsigned char *buf, int size, const unsigned char *term, int term_len, SceUInt timeout)
+{
+  unsigned char kterm[LIBUSBSERIAL_MAX_TERMINATOR];
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (size <= 0 || term_len <= 0 || term_len > LIBUSBSERIAL_MAX_TERMINATOR)
+    _error_return(-1, "Invalid size");
+
+  ksceKernelMemcpyUserToKernel(kterm, term, term_len);
+  ret = _read_until(buf, size, kterm, term_len, timeout, NULL);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_transact(const unsigned char *tx, int tx_len, unsigned char *rx, int rx_size,
+                          const unsigned char *term, int term_len, int flags, SceUInt timeout)
+{
+  unsigned char kterm[LIBUSBSERIAL_MAX_TERMINATOR];
+  unsigned char tail[LIBUSBSERIAL_MAX_TERMINATOR];
+  enum crc_type crc_type = (flags >> 8) & 0xF;
+  crcRun run;
+  crcRun *crc = NULL;
+  uint32_t start;
+  int complete;
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (tx_len < 0 || rx_size <= 0 || term_len < 0 || term_len > LIBUSBSERIAL_MAX_TERMINATOR)
+    _error_return(-1, "Invalid size");
+
+  // the reply has to come through the byte ring
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  if ((flags & (TRANSACT_APPEND_CRC | TRANSACT_CHECK_CRC)) && !crc_len(crc_type))
+    _error_return(-1, "Invalid CRC type");
+
+  if (term_len)
+    ksceKernelMemcpyUserToKernel(kterm, term, term_len);
+
+  // a stale reply to an earlier request must not satisfy this one
+  if ((flags & TRANSACT_FLUSH_RX) && _rx_flush() < 0)
+    _error_return(-1, "Purge of RX buffer failed");
+
+  start = ksceKernelGetSystemTimeLow();
+  if (tx_len && _write_from_user(tx, tx_len, (flags & TRANSACT_APPEND_CRC) ? crc_type : CRC_NONE) != tx_len)
+    _error_return(-1, "write failed");
+
+  // the reply's CRC is taken while it is copied out, the terminator isn't covered
+  run.type = crc_type;
+  run.crc  = crc_start(crc_type);
+  run.skip = term_len;
+  if (flags & TRANSACT_CHECK_CRC)
+    crc = &run;
+
+  if (term_len)
+  {
+    ret      = _read_until(rx, rx_size, kterm, term_len, timeout, crc);
+    complete = ret >= term_len;
+    if (complete)
+    {
+      ksceKernelMemcpyUserToKernel(tail, rx + ret - term_len, term_len);
+      complete = memcmp(tail, kterm, term_len) == 0;
+    }
+  }
+  else
+  {
+    ret      = _read_timed(rx, rx_size, rx_size, timeout, 0, crc);
+    complete = ret == rx_size;
+  }
+
+  // request submit to arrival of the reply's last packet, which without
+  // TRANSACT_FLUSH_RX may have been buffered before the request went out
+  if (complete && (int32_t)(ringbuf_last_put() - start) >= 0)
+    histogram_record(LATENCY_TRANSACT, ringbuf_last_put() - start);
+
+  if (complete && (flags & TRANSACT_CHECK_CRC)
+      && (ret - term_len < crc_len(crc_type) || !crc_check(crc_type, run.crc)))
+    ret = -4;
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_modbus_transact(const unsigned char *req, int len, unsigned char *reply, int size, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (len < 2 || len > LIBUSBSERIAL_MODBUS_MAX_ADU - 2 || size < 0)
+    _error_return(-1, "Invalid size");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  ret = modbus_transact(&ctx, req, len, reply, size, timeout);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_modbus_read_frame(unsigned char *buf, int size, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (size <= 0)
+    _error_return(-1, "Invalid size");
+
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  ret = modbus_read_frame(&ctx, buf, size, timeout);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_modbus_poll(struct libusbserial_modbus_request *reqs, int count, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (count <= 0)
+    _error_return(-1, "Invalid count");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  ret = modbus_poll(&ctx, reqs, count, timeout);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_crc(enum crc_type type, const unsigned char *buf, int len, uint32_t *crc)
+{
+  unsigned char kbuf[256];
+  uint32_t c = crc_start(type);
+  int pos    = 0;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!crc_len(type))
+    _error_return(-1, "Invalid CRC type");
+
+  if (len < 0)
+    _error_return(-1, "Invalid size");
+
+  while (pos < len)
+  {
+    int n = len - pos < (int)sizeof(kbuf) ? len - pos : (int)sizeof(kbuf);
+    ksceKernelMemcpyUserToKernel(kbuf, buf + pos, n);
+    c = crc_update(type, c, kbuf, n);
+    pos += n;
+  }
+
+  c = crc_final(type, c);
+  ksceKernelMemcpyKernelToUser(crc, &c, sizeof(c));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_set_frame_crc(enum crc_type type)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (type != CRC_NONE && !crc_len(type))
+    _error_return(-1, "Invalid CRC type");
+
+  framing_set_crc(type);
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_set_frame_mode(enum frame_mode mode, int max_frame)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (mode != FRAME_NONE && mode != FRAME_SLIP && mode != FRAME_COBS && mode != FRAME_MESSAGE)
+    _error_return(-1, "Invalid mode");
+
+  if (max_frame < 0 || max_frame > LIBUSBSERIAL_MAX_FRAME)
+    _error_return(-1, "Invalid frame size");
+
+  if (mode != FRAME_NONE && ctx.rx_stream_count)
+    _error_return(-1, "Streaming");
+
+  // decoder is idle while it is reset
+  ctx.frame_mode = FRAME_NONE;
+  framing_reset(max_frame);
+  msgq_reset();
+  ctx.frame_mode = mode;
+  // takes effect on the next resubmit
+  ctx.rx_default.size = _rx_default_size();
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+static int _read_record(unsigned char *buf, int size, uint32_t *ts, SceUInt timeout)
+{
+  SceUInt t = timeout;
+  int ret;
+
+  for (;;)
+  {
+    ret = msgq_get_user(buf, size, ts);
+    if (ret >= 0)
+      return ret;
+    if (!plugged)
+      return -2;
+    if (msgq_wait(timeout ? &t : NULL) < 0)
+      return 0;
+  }
+}
+
+int libusbserial_read_frame(unsigned char *buf, int size, SceUInt timeout)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (size < 0)
+    _error_return(-1, "Invalid size");
+
+  if (!ctx.frame_mode)
+    _error_return(-1, "Not in frame mode");
+
+  ret = _read_record(buf, size, NULL, timeout);
+  if (ret == -2)
+    _error_return(-2, "USB device unavailable");
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_read_message(unsigned char *buf, int size, uint32_t *timestamp, SceUInt timeout)
+{
+  uint32_t ts = 0;
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (size < 0)
+    _error_return(-1, "Invalid size");
+
+  if (ctx.frame_mode != FRAME_MESSAGE)
+    _error_return(-1, "Not in message mode");
+
+  ret = _read_record(buf, size, &ts, timeout);
+  if (ret == -2)
+    _error_return(-2, "USB device unavailable");
+
+  if (ret > 0 && timestamp)
+    ksceKernelMemcpyKernelToUser(timestamp, &ts, sizeof(ts));
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_shm_attach(void *block, int size)
+{
+  int ring_size = size - LIBUSBSERIAL_SHM_HEADER;
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (((uintptr_t)block & 0xFFF) || ring_size < 0x1000 || (ring_size & (ring_size - 1)))
+    _error_return(-1, "Invalid shared block");
+
+  if (shmring_active())
+    _error_return(-1, "Already attached");
+
+  if (ctx.rx_stream_count)
+    _error_return(-1, "Streaming");
+
+  ret = shmring_attach(block, size);
+  if (ret < 0)
+    _error_return(ret, "Can't map shared block");
+
+  // pending ring data stays readable through read_data
+  shmring_status(plugged, ctx.line_status.modem_status, ctx.modem_changes);
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_shm_detach(void)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (shmring_detach() < 0)
+    _error_return(-1, "Not attached");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_shm_wait(int need, SceUInt timeout)
+{
+  SceUInt t = timeout;
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (!shmring_active())
+    _error_return(-1, "Not attached");
+
+  if (need < 1 || need > shmring_size())
+    _error_return(-1, "Invalid size");
+
+  // the reader drained the ring on its own, this is where XON goes out
+  if (ctx.soft_flow && ctx.rx_throttled)
+    _softflow_rx_level();
+
+  for (;;)
+  {
+    ret = shmring_available();
+    if (ret >= need)
+      break;
+    if (!plugged)
+      _error_return(-2, "USB device unavailable");
+    if (!shmring_active())
+      _error_return(-1, "Not attached");
+    if (shmring_wait(need, timeout ? &t : NULL) < 0)
+    {
+      ret = 0;
+      break;
+    }
+  }
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_dmx_start(int refresh_hz, int channels, SceUInt break_us, SceUInt mab_us)
+{
+  SceUInt period;
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  if (!channels)
+    channels = LIBUSBSERIAL_DMX_SLOTS - 1;
+  if (!break_us)
+    break_us = DMX_DEFAULT_BREAK;
+  if (!mab_us)
+    mab_us = DMX_DEFAULT_MAB;
+
+  if (channels < 1 || channels > LIBUSBSERIAL_DMX_SLOTS - 1 || break_us < DMX_MIN_BREAK || mab_us < DMX_MIN_MAB)
+    _error_return(-1, "Invalid DMX timing");
+
+  // 44 us per slot at 250 kbaud 8N2, 0 runs frames back to back
+  period = break_us + mab_us + (channels + 1) * 44;
+  if (refresh_hz < 0 || (refresh_hz && 1000000 / refresh_hz < period))
+    _error_return(-1, "Refresh rate too high for the channel count");
+  if (refresh_hz)
+    period = 1000000 / refresh_hz;
+
+  ret = dmx_start(&ctx, period, channels, break_us, mab_us);
+  if (ret == -2)
+    _error_return(-1, "set of DMX line settings failed");
+  if (ret < 0)
+    _error_return(-1, "DMX output thread failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_dmx_stop(void)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  dmx_stop();
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_dmx_set(int slot, const unsigned char *data, int len)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  if (slot < 0 || len < 0 || slot + len > LIBUSBSERIAL_DMX_SLOTS)
+    _error_return(-1, "Invalid slot range");
+
+  ret = dmx_set_user(slot, data, len);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_xmodem_send(enum xmodem_protocol proto, const unsigned char *data, int size, const char *name,
+                             int name_len, SceUInt timeout)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (proto != XMODEM_1K && proto != YMODEM)
+    _error_return(-1, "Unsupported protocol");
+
+  if (size <= 0 || name_len < 0 || name_len > LIBUSBSERIAL_XMODEM_MAX_NAME || (proto == YMODEM && name_len == 0))
+    _error_return(-1, "Invalid size");
+
+  // replies are read from the byte ring
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  if (xmodem_start(&ctx, proto, data, size, name, name_len, timeout) < 0)
+    _error_return(-1, "XMODEM start failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_xmodem_status(struct libusbserial_xmodem_status *status)
+{
+  struct libusbserial_xmodem_status st;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  xmodem_status(&st);
+  ksceKernelMemcpyKernelToUser(status, &st, sizeof(st));
+
+  EXIT_SYSCALL(state);
+  return st.state;
+}
+
+int libusbserial_xmodem_cancel(void)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  xmodem_cancel();
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_loopback_start(int buffer_size)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (_tx_busy())
+    _error_return(-1, "Transmitter busy");
+
+  // the line is half duplex, and FIFO mode isn't a UART
+  if (ctx.rs485_mode != RS485_OFF || ctx.rx_stream_count)
+    _error_return(-1, "Not supported");
+
+  if (!buffer_size)
+    buffer_size = LOOPBACK_DEFAULT_SIZE;
+
+  // room for at least one whole IN transfer
+  if (buffer_size < 0x1000 || buffer_size > LOOPBACK_MAX_SIZE || (buffer_size & (buffer_size - 1)))
+    _error_return(-1, "Invalid buffer size");
+
+  if (loopback_start(&ctx, buffer_size, _rx_resume) < 0)
+    _error_return(-1, "Loopback thread failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_loopback_stop(void)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  loopback_stop();
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_set_rx_wakeup(int threshold, SceUInt coalesce)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  if (threshold < 1 || threshold >= ringbuf_size())
+    _error_return(-1, "Invalid threshold");
+
+  ringbuf_set_wakeup(threshold, coalesce);
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_set_rx_worker(int enable, int priority, int cpu_mask)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-1, "Not started");
+
+  rxworker_stop();
+
+  if (enable && rxworker_start(_rx_complete, priority ? priority : RX_WORKER_DEFAULT_PRIORITY, cpu_mask) < 0)
+    _error_return(-1, "RX worker thread failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_read_data(unsigned char *buf, int size)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  ret = _read_to_user(buf, size, NULL);
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_available_count()
+{
+    return ringbuf_available();
+}
+
+int libusbserial_tciflush()
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (_rx_flush() < 0)
+    _error_return(-1, "Purge of RX buffer failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+
+int libusbserial_tcoflush()
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type == TYPE_FTDI)
   {
     if (_ftdi_tcoflush() < 0)
       _error_return(-1, "Purge of TX buffer failed");
   }
   else if (ctx.type == TYPE_CH34X)
   {
-    if (_ch34x_tcoflush() < 0)
+    if (_ch34x_tcoflush(&ctx) < 0)
       _error_return(-1, "Purge of TX buffer failed");
   }
 
@@ -649,13 +1975,10 @@ int libusbserial_tcioflush()
   }
   else if (ctx.type == TYPE_CH34X)
   {
-    result = _ch34x_tcoflush();
+    // one chip purge covers both directions
+    result = _ch34x_tcioflush(&ctx);
     if (result < 0)
       _error_return(-1, "Purge of TX buffer failed");
-
-    result = _ch34x_tciflush();
-    if (result < 0)
-      _error_return(-2, "Purge of RX buffer failed");
   }
 
   // Invalidate data in the readbuffer
@@ -710,6 +2033,20 @@ int libusbserial_setflowctrl_xonxoff(unsigned char xon, unsigned char xoff)
   return 0;
 }
 
+int libusbserial_set_write_timeout(SceUInt timeout)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  ctx.tx_timeout = timeout;
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
 int libusbserial_setdtr_rts(int dtr, int rts)
 {
   uint32_t state;
@@ -718,6 +2055,9 @@ int libusbserial_setdtr_rts(int dtr, int rts)
   if (!started || !plugged)
     _error_return(-2, "USB device unavailable");
 
+  if (ctx.rs485_mode == RS485_RTS)
+    _error_return(-1, "RTS is driven by RS-485 mode");
+
   if (ctx.type == TYPE_FTDI)
   {
     if (_ftdi_setdtr_rts(dtr, rts) < 0)
@@ -764,6 +2104,9 @@ int libusbserial_setrts(int rtsstate)
   if (!started || !plugged)
     _error_return(-2, "USB device unavailable");
 
+  if (ctx.rs485_mode == RS485_RTS)
+    _error_return(-1, "RTS is driven by RS-485 mode");
+
   if (ctx.type == TYPE_FTDI)
   {
     if (_ftdi_setrts(rtsstate) < 0)
@@ -779,14 +2122,425 @@ int libusbserial_setrts(int rtsstate)
   return 0;
 }
 
+int libusbserial_set_rs485(enum rs485_mode mode, int flags, SceUInt delay_before, SceUInt delay_after)
+{
+  int ret;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (mode < RS485_OFF || mode > RS485_AUTO)
+    _error_return(-1, "Unsupported RS-485 mode");
+
+  if (mode == RS485_TXDEN && (ctx.type != TYPE_FTDI || !_ftdi_has_txden(&ctx)))
+    _error_return(-1, "No TXDEN pin configured");
+
+  if (mode != RS485_OFF && loopback_active())
+    _error_return(-1, "Loopback running");
+
+  ret = rs485_configure(&ctx, mode, flags, delay_before, delay_after);
+  if (ret < 0)
+    _error_return(-1, "set of rts failed");
+
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_get_modem_status()
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  // without interrupt endpoint CH34x falls back to polling
+  if (ctx.type == TYPE_CH34X && ctx.intr_pipe_id <= 0)
+  {
+    if (_ch34x_get_status(&ctx) < 0)
+      _error_return(-1, "poll modem status failed");
+    ctx.line_status.modem_status = ctx.ch34x_msr;
+  }
+
+  EXIT_SYSCALL(state);
+  return ctx.line_status.modem_status;
+}
+
+int libusbserial_wait_modem_status(int mask, SceUInt timeout)
+{
+  uint32_t changes;
+  uint8_t msr;
+  SceUInt t = timeout;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type == TYPE_CH34X && ctx.intr_pipe_id <= 0)
+    _error_return(-1, "Not supported");
+
+  msr     = ctx.line_status.modem_status;
+  changes = ctx.modem_changes;
+  // EVF_MODEM stays set from a change before the wait, so none is missed
+  while (!(ctx.modem_changes != changes && ((ctx.line_status.modem_status ^ msr) & mask)))
+  {
+    // t keeps the remaining time across wakeups for other lines
+    int ret = ksceKernelWaitEventFlag(status_ev, EVF_MODEM, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT, NULL,
+                                      timeout ? &t : NULL);
+    if (ret < 0)
+    {
+      EXIT_SYSCALL(state);
+      return ret;
+    }
+    if (!plugged)
+      _error_return(-2, "USB device unavailable");
+  }
+
+  EXIT_SYSCALL(state);
+  return ctx.line_status.modem_status;
+}
+
+int libusbserial_get_line_status(struct libusbserial_line_status *status)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  ksceKernelMemcpyKernelToUser(status, &ctx.line_status, sizeof(ctx.line_status));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_set_error_marking(int enable)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI)
+    _error_return(-1, "Not supported");
+
+  ctx.ftdi_parmrk = enable ? 1 : 0;
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_get_stats(struct libusbserial_stats *stats)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  ringbuf_stats(&ctx.stats.ring_drops, &ctx.stats.ring_high_water, &ctx.stats.rx_wakeups);
+  ksceKernelMemcpyKernelToUser(stats, &ctx.stats, sizeof(ctx.stats));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_reset_stats()
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started)
+    _error_return(-2, "Not started");
+
+  memset(&ctx.stats, 0, sizeof(ctx.stats));
+  ringbuf_reset_stats();
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_get_latency_histogram(enum latency_op op, struct libusbserial_histogram *hist)
+{
+  struct libusbserial_histogram khist;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (histogram_get(op, &khist) < 0)
+    _error_return(-1, "Unknown operation");
+
+  ksceKernelMemcpyKernelToUser(hist, &khist, sizeof(khist));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_reset_latency_histograms()
+{
+  histogram_reset();
+  return 0;
+}
+
+int libusbserial_trace_set_mask(unsigned int mask)
+{
+  // enabling starts a fresh trace
+  if (mask && !tracering_mask)
+    tracering_reset();
+  tracering_mask = mask;
+  return 0;
+}
+
+int libusbserial_trace_read(struct libusbserial_trace_record *records, int max)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+  int ret = tracering_drain(records, max);
+  EXIT_SYSCALL(state);
+  return ret;
+}
+
+int libusbserial_ftdi_set_bitmode(unsigned char bitmask, unsigned char mode)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI)
+    _error_return(-1, "Not supported");
+
+  if (ctx.rx_stream_count)
+    _error_return(-1, "Streaming active");
+
+  if (_ftdi_set_bitmode(&ctx, bitmask, mode) < 0)
+    _error_return(-1, "set bitmode failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_read_pins(unsigned char *pins)
+{
+  unsigned char kpins;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI)
+    _error_return(-1, "Not supported");
+
+  if (_ftdi_read_pins(&kpins) < 0)
+    _error_return(-1, "read pins failed");
+
+  ksceKernelMemcpyKernelToUser(pins, &kpins, sizeof(kpins));
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_set_latency_timer(unsigned char latency)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI)
+    _error_return(-1, "Not supported");
+
+  if (_ftdi_set_latency_timer(&ctx, latency) < 0)
+    _error_return(-1, "set latency timer failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_stream_start(int transfers, int transfer_size)
+{
+  unsigned char *base;
+  int i;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI || (ctx.ftdi_type != TYPE_2232H && ctx.ftdi_type != TYPE_232H))
+    _error_return(-1, "Not supported");
+
+  if (ctx.rx_stream_count)
+    _error_return(-1, "Already streaming");
+
+  if (loopback_active())
+    _error_return(-1, "Loopback running");
+
+  // captured data goes through the byte ring
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  if (transfers <= 0)
+    transfers = STREAM_DEFAULT_TRANSFERS;
+  if (transfers > RX_STREAM_MAX_TRANSFERS)
+    transfers = RX_STREAM_MAX_TRANSFERS;
+  if (transfer_size <= 0)
+    transfer_size = STREAM_DEFAULT_TRANSFER_SIZE;
+  if (transfer_size > STREAM_MAX_TRANSFER_SIZE)
+    _error_return(-1, "Transfer size too large");
+
+  // whole packets only, so status bytes stay at packet boundaries
+  transfer_size = DIV_ROUND_UP(transfer_size, ctx.max_packet_size) * ctx.max_packet_size;
+
+  ctx.rx_stream_memblock = ksceKernelAllocMemBlock("libusbserial_stream", 0x6020D006,
+                                                   (transfers * transfer_size + 0xFFF) & ~0xFFF, NULL);
+  if (ctx.rx_stream_memblock < 0)
+  {
+    ctx.rx_stream_memblock = -1;
+    _error_return(-1, "Can't allocate stream buffers");
+  }
+  ksceKernelGetMemBlockBase(ctx.rx_stream_memblock, (void **)&base);
+
+  // single packet transfer completes once more and is not resubmitted,
+  // the ring is swapped only once nothing can be putting into it
+  ctx.rx_default.retired = 1;
+  if (_rx_drain() < 0)
+  {
+    _stream_release();
+    _rx_default_resume();
+    _error_return(-1, "Receive transfers still pending");
+  }
+  _stream_orphan_release();
+
+  if (ringbuf_resize(STREAM_RINGBUF_SIZE) < 0)
+  {
+    _stream_release();
+    _rx_default_resume();
+    _error_return(-1, "Can't resize ring buffer");
+  }
+
+  if (_ftdi_set_bitmode(&ctx, 0xFF, BITMODE_RESET) < 0 || _ftdi_set_bitmode(&ctx, 0xFF, BITMODE_SYNCFF) < 0
+      || _ftdi_set_latency_timer(&ctx, 2) < 0 || _ftdi_setflowctrl(SIO_RTS_CTS_HS) < 0 || _ftdi_tciflush() < 0)
+  {
+    _stream_release();
+    ringbuf_resize(MAX_RINGBUF_SIZE);
+    _rx_default_resume();
+    _error_return(-1, "Can't switch to FIFO mode");
+  }
+
+  ringbuf_reset();
+
+  ctx.rx_stream_count = transfers;
+  for (i = 0; i < transfers; i++)
+  {
+    ctx.rx_stream[i].buffer  = base + i * transfer_size;
+    ctx.rx_stream[i].size    = transfer_size;
+    ctx.rx_stream[i].retired = 0;
+    usb_read(&ctx.rx_stream[i]);
+  }
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_stream_stop(void)
+{
+  unsigned int i;
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (!ctx.rx_stream_count)
+    _error_return(-1, "Not streaming");
+
+  for (i = 0; i < ctx.rx_stream_count; i++)
+    ctx.rx_stream[i].retired = 1;
+
+  _ftdi_set_bitmode(&ctx, 0xFF, BITMODE_RESET);
+  _ftdi_setflowctrl(SIO_DISABLE_FLOW_CTRL);
+
+  // outstanding transfers still own the buffers, chip flushes every latency period
+  if (_rx_drain() < 0)
+  {
+    // back to byte mode anyway, the late transfers keep their buffers and the
+    // big ring until stream_start or detach finds them done
+    stream_orphan          = ctx.rx_stream_memblock;
+    ctx.rx_stream_memblock = -1;
+    ctx.rx_stream_count    = 0;
+    ctx.rx_default.retired = 0;
+    usb_read(&ctx.rx_default);
+    _error_return(-3, "Stream transfers didn't complete");
+  }
+
+  _stream_release();
+  ringbuf_resize(MAX_RINGBUF_SIZE);
+
+  ctx.rx_default.retired = 0;
+  usb_read(&ctx.rx_default);
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_mpsse_spi_init(unsigned int clock_hz)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI || ctx.rx_stream_count)
+    _error_return(-1, "Not supported");
+
+  if (_ftdi_mpsse_spi_init(&ctx, clock_hz) < 0)
+    _error_return(-1, "MPSSE init failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
+int libusbserial_ftdi_mpsse_spi_batch(const struct libusbserial_spi_transfer *xfers, int count, SceUInt timeout)
+{
+  uint32_t state;
+  ENTER_SYSCALL(state);
+
+  if (!started || !plugged)
+    _error_return(-2, "USB device unavailable");
+
+  if (ctx.type != TYPE_FTDI)
+    _error_return(-1, "Not supported");
+
+  // replies are read back from the byte ring
+  if (ctx.frame_mode || shmring_active())
+    _error_return(-1, "Not in byte stream mode");
+
+  if (_ftdi_mpsse_spi_batch(&ctx, xfers, count, timeout) < 0)
+    _error_return(-1, "SPI transfer failed");
+
+  EXIT_SYSCALL(state);
+  return 0;
+}
+
 void _start() __attribute__((weak, alias("module_start")));
 
 int module_start(SceSize args, void *argp)
 {
   trace("libusbserial starting\n");
+  crc_init();
   ksceKernelRegisterSysEventHandler("zlibusbserial_sysevent", libusbserial_sysevent_handler, NULL);
   transfer_ev = ksceKernelCreateEventFlag("libusbserial_transfer", 0, 0, NULL);
   trace("ef: 0x%08x\n", transfer_ev);
+  status_ev = ksceKernelCreateEventFlag("libusbserial_status", SCE_EVENT_WAITMULTIPLE, 0, NULL);
+  trace("status ef: 0x%08x\n", status_ev);
   return SCE_KERNEL_START_SUCCESS;
 }
 
@@ -0,0 +1,365 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "modbus.h"
+#include "crc.h"
+#include "libusbserial_private.h"
+#include "ringbuf.h"
+#include "rs485.h"
+
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+/* RTU characters are always 11 bits: start, 8 data, parity or second stop, stop */
+#define MODBUS_CHAR_BITS 11
+/* above 19200 baud the spec fixes the gap instead of scaling it */
+#define MODBUS_FIXED_GAP_BAUD 19200
+#define MODBUS_FIXED_T35_US 1750
+
+#define MODBUS_EXCEPTION_LEN 5
+
+static unsigned char frame[LIBUSBSERIAL_MODBUS_MAX_ADU];
+// when the bus last went quiet, end of our request or of the last reply
+static uint32_t bus_idle = 0;
+
+static SceUInt _char_us(serialDevice *ctx)
+{
+  int baud = ctx->actual_baudrate > 0 ? ctx->actual_baudrate : 9600;
+  return DIV_ROUND_UP(MODBUS_CHAR_BITS * 1000000, baud);
+}
+
+static SceUInt _t35_us(serialDevice *ctx)
+{
+  if (ctx->actual_baudrate > MODBUS_FIXED_GAP_BAUD)
+    return MODBUS_FIXED_T35_US;
+  return _char_us(ctx) * 7 / 2;
+}
+
+static int _crc_ok(const unsigned char *buf, int len)
+{
+  uint16_t crc;
+
+  if (len < 4)
+    return 0;
+  crc = crc16_modbus(buf, len - 2);
+  return buf[len - 2] == (crc & 0xFF) && buf[len - 1] == (crc >> 8);
+}
+
+/* Reply size for a request, 0 if only the line going quiet can tell */
+static int _reply_len(const unsigned char *adu, int len)
+{
+  int count = len >= 6 ? (adu[4] << 8) | adu[5] : 0;
+
+  switch (adu[1])
+  {
+  case 1:
+  case 2:
+    return 5 + DIV_ROUND_UP(count, 8);
+  case 3:
+  case 4:
+    return 5 + 2 * count;
+  case 5:
+  case 6:
+  case 15:
+  case 16:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/* Keep 3.5 characters of silence between frames */
+static void _wait_gap(serialDevice *ctx)
+{
+  uint32_t quiet = bus_idle;
+  uint32_t last  = ringbuf_last_put();
+  uint32_t idle;
+  SceUInt t35 = _t35_us(ctx);
+
+  if ((int32_t)(last - quiet) > 0)
+    quiet = last;
+  idle = ksceKernelGetSystemTimeLow() - quiet;
+  if (idle < t35)
+    ksceKernelDelayThread(t35 - idle);
+}
+
+/*
+ * Collect one frame into frame[]. It is complete at expect bytes (0 =
+ * unknown), or when no packet came for 3.5 characters plus the time the
+ * chip may hold bytes back. Returns its length, 0 if nothing arrived
+ * within timeout us (0 = forever), -2 if the device went away.
+ */
+static int _receive(serialDevice *ctx, int expect, SceUInt timeout)
+{
+  uint32_t start = ksceKernelGetSystemTimeLow();
+  SceUInt gap    = _t35_us(ctx) + ctx->rx_latency_us;
+  int got        = 0;
+
+  for (;;)
+  {
+    SceUInt wait = 0;
+    uint32_t now;
+
+    got += ringbuf_get(frame + got, sizeof(frame) - got);
+
+    // exception replies are shorter than the regular one
+    if (expect && got >= 2 && (frame[1] & 0x80))
+      expect = MODBUS_EXCEPTION_LEN;
+    if ((expect && got >= expect) || got == sizeof(frame))
+      break;
+    if (ctx->in_pipe_id <= 0)
+      return -2;
+
+    now = ksceKernelGetSystemTimeLow();
+    if (got)
+    {
+      uint32_t idle = now - ringbuf_last_put();
+      if (idle >= gap)
+        break;
+      wait = gap - idle;
+    }
+    else if (timeout)
+    {
+      if (now - start >= timeout)
+        return 0;
+      wait = timeout - (now - start);
+    }
+
+    ringbuf_wait(expect ? expect - got : 1, sizeof(frame) - got, wait ? &wait : NULL);
+  }
+
+  bus_idle = ringbuf_last_put();
+  return got;
+}
+
+/*
+ * Send the len byte request in ctx->writebuffer with its CRC and take the
+ * reply. Returns the reply length without CRC, 0 for broadcasts or
+ * enum modbus_error. rtt is request submit to the reply's last packet.
+ */
+static int _exchange(serialDevice *ctx, int len, SceUInt timeout, uint32_t *rtt)
+{
+  unsigned char *adu = ctx->writebuffer;
+  int expect         = _reply_len(adu, len);
+  uint16_t crc       = crc16_modbus(adu, len);
+  uint32_t start, wire_end;
+  int got;
+
+  adu[len++] = crc & 0xFF;
+  adu[len++] = crc >> 8;
+
+  _wait_gap(ctx);
+  // whatever came before the request can't be its reply
+  ringbuf_reset();
+
+  if (rs485_tx_begin(ctx, len) < 0)
+    return -1;
+  start = ksceKernelGetSystemTimeLow();
+  if (_send(adu, len) != len)
+  {
+    rs485_tx_end(ctx, 0);
+    return -1;
+  }
+  rs485_tx_end(ctx, len);
+
+  // the chip is still shifting bytes out after the OUT transfer completed
+  wire_end = start + len * _char_us(ctx);
+  bus_idle = ksceKernelGetSystemTimeLow();
+  if ((int32_t)(wire_end - bus_idle) > 0)
+    bus_idle = wire_end;
+
+  if (adu[0] == 0)
+    return 0;
+
+  got = _receive(ctx, expect, timeout);
+  if (got < 0)
+    return got;
+  if (got == 0)
+    return MODBUS_ERR_TIMEOUT;
+  if (rtt)
+    *rtt = bus_idle - start;
+
+  if (!_crc_ok(frame, got))
+    return MODBUS_ERR_CRC;
+  if (frame[0] != adu[0] || (frame[1] & 0x7F) != adu[1])
+    return MODBUS_ERR_FRAME;
+  if (frame[1] & 0x80 ? got != MODBUS_EXCEPTION_LEN : expect && got != expect)
+    return MODBUS_ERR_FRAME;
+
+  return got - 2;
+}
+
+int modbus_transact(serialDevice *ctx, const unsigned char *req, int len, unsigned char *reply, int size, SceUInt timeout)
+{
+  int ret;
+
+  ksceKernelMemcpyUserToKernel(ctx->writebuffer, req, len);
+
+  ret = _exchange(ctx, len, timeout, NULL);
+  if (ret > 0)
+    ksceKernelMemcpyKernelToUser(reply, frame, ret < size ? ret : size);
+  return ret;
+}
+
+int modbus_read_frame(serialDevice *ctx, unsigned char *buf, int size, SceUInt timeout)
+{
+  int got = _receive(ctx, 0, timeout);
+
+  if (got <= 0)
+    return got;
+  if (!_crc_ok(frame, got))
+    return MODBUS_ERR_CRC;
+
+  got -= 2;
+  ksceKernelMemcpyKernelToUser(buf, frame, got < size ? got : size);
+  return got;
+}
+
+/* Request PDU for a table entry into ctx->writebuffer, returns its length or -1 */
+static int _build(serialDevice *ctx, const struct libusbserial_modbus_request *r)
+{
+  unsigned char *adu = ctx->writebuffer;
+  uint16_t value     = 0;
+  int bytes, i;
+
+  adu[0] = r->slave;
+  adu[1] = r->function;
+  adu[2] = r->address >> 8;
+  adu[3] = r->address & 0xFF;
+  adu[4] = r->count >> 8;
+  adu[5] = r->count & 0xFF;
+
+  // nobody answers a broadcast
+  if (r->slave == 0 && r->function <= 4)
+    return -1;
+
+  switch (r->function)
+  {
+  case 1:
+  case 2:
+    return (r->count >= 1 && r->count <= 2000) ? 6 : -1;
+  case 3:
+  case 4:
+    return (r->count >= 1 && r->count <= 125) ? 6 : -1;
+  case 5:
+    ksceKernelMemcpyUserToKernel(&adu[6], r->data, 1);
+    value = (adu[6] & 1) ? 0xFF00 : 0x0000;
+    break;
+  case 6:
+    ksceKernelMemcpyUserToKernel(&value, r->data, sizeof(value));
+    break;
+  case 15:
+    if (r->count < 1 || r->count > 1968)
+      return -1;
+    bytes  = DIV_ROUND_UP(r->count, 8);
+    adu[6] = bytes;
+    ksceKernelMemcpyUserToKernel(&adu[7], r->data, bytes);
+    return 7 + bytes;
+  case 16:
+    if (r->count < 1 || r->count > 123)
+      return -1;
+    bytes  = 2 * r->count;
+    adu[6] = bytes;
+    ksceKernelMemcpyUserToKernel(&adu[7], r->data, bytes);
+    for (i = 7; i < 7 + bytes; i += 2)
+    {
+      unsigned char c = adu[i];
+      adu[i]          = adu[i + 1];
+      adu[i + 1]      = c;
+    }
+    return 7 + bytes;
+  default:
+    return -1;
+  }
+
+  // single writes carry the value where the count would be
+  adu[4] = value >> 8;
+  adu[5] = value & 0xFF;
+  return 6;
+}
+
+/* Hand a good reply of len bytes back to the table entry, returns its result */
+static int _unpack(const struct libusbserial_modbus_request *r, int len)
+{
+  int i;
+
+  if (frame[1] & 0x80)
+    return MODBUS_ERR_EXCEPTION - frame[2];
+
+  switch (r->function)
+  {
+  case 1:
+  case 2:
+    ksceKernelMemcpyKernelToUser(r->data, &frame[3], len - 3);
+    return r->count;
+  case 3:
+  case 4:
+    for (i = 3; i < len; i += 2)
+    {
+      unsigned char c = frame[i];
+      frame[i]        = frame[i + 1];
+      frame[i + 1]    = c;
+    }
+    ksceKernelMemcpyKernelToUser(r->data, &frame[3], len - 3);
+    return r->count;
+  case 5:
+  case 6:
+    return 1;
+  default:
+    return r->count;
+  }
+}
+
+/*
+ * Requests go out back to back: the next one leaves as soon as the 3.5
+ * character gap after the previous reply's last packet has passed, without
+ * a round trip through user space.
+ */
+int modbus_poll(serialDevice *ctx, struct libusbserial_modbus_request *reqs, int count, SceUInt timeout)
+{
+  struct libusbserial_modbus_request r;
+  int ok = 0;
+  int i, len;
+
+  for (i = 0; i < count; i++)
+  {
+    ksceKernelMemcpyUserToKernel(&r, &reqs[i], sizeof(r));
+    r.rtt_us = 0;
+
+    len = _build(ctx, &r);
+    if (len < 0)
+      r.result = -1;
+    else
+    {
+      r.result = _exchange(ctx, len, timeout, &r.rtt_us);
+      if (r.result == -2)
+        return -2;
+      if (r.result > 0)
+        r.result = _unpack(&r, r.result);
+      else if (r.result == 0 && r.slave == 0)
+        r.result = r.function == 5 || r.function == 6 ? 1 : r.count;
+    }
+
+    if (r.result >= 0)
+      ok++;
+    ksceKernelMemcpyKernelToUser(&reqs[i].result, &r.result, sizeof(r.result) + sizeof(r.rtt_us));
+  }
+
+  return ok;
+}
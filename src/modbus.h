@@ -0,0 +1,30 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MODBUS_H__
+#define __MODBUS_H__
+
+#include "serialdevice.h"
+
+/* Modbus RTU master and bus monitor on top of the byte ring */
+
+int modbus_transact(serialDevice *ctx, const unsigned char *req, int len, unsigned char *reply, int size, SceUInt timeout);
+int modbus_read_frame(serialDevice *ctx, unsigned char *buf, int size, SceUInt timeout);
+int modbus_poll(serialDevice *ctx, struct libusbserial_modbus_request *reqs, int count, SceUInt timeout);
+
+#endif // __MODBUS_H__
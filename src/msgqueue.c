@@ -0,0 +1,235 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "msgqueue.h"
+
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+#define MSGQ_EVF_NON_EMPTY 0x00000001
+#define MSGQ_EVF_ABORT     0x00000002
+
+/*
+ * Records are stored back to back in a byte ring as a header followed by
+ * the payload, both may wrap. A record that doesn't fit is dropped whole.
+ * Offsets run free, so the size has to be a power of two.
+ */
+typedef struct
+{
+  uint32_t len;
+  uint32_t ts;
+} msgHeader;
+
+static SceUID evf_uid      = -1;
+static SceUID mtx_uid      = -1;
+static SceUID memblock_uid = -1;
+
+static unsigned char *base = NULL;
+static unsigned int size_  = 0;
+static unsigned int head   = 0; // free-running write offset
+static unsigned int tail   = 0; // free-running read offset
+static int count           = 0;
+
+static void copy_in(unsigned int pos, const void *src, unsigned int len)
+{
+  unsigned int off   = pos % size_;
+  unsigned int first = size_ - off;
+
+  if (first > len)
+    first = len;
+  memcpy(base + off, src, first);
+  memcpy(base, (const unsigned char *)src + first, len - first);
+}
+
+static void copy_out(void *dst, unsigned int pos, unsigned int len)
+{
+  unsigned int off   = pos % size_;
+  unsigned int first = size_ - off;
+
+  if (first > len)
+    first = len;
+  memcpy(dst, base + off, first);
+  memcpy((unsigned char *)dst + first, base, len - first);
+}
+
+static void copy_out_user(void *dst, unsigned int pos, unsigned int len)
+{
+  unsigned int off   = pos % size_;
+  unsigned int first = size_ - off;
+
+  if (first > len)
+    first = len;
+  ksceKernelMemcpyKernelToUser(dst, base + off, first);
+  if (len > first)
+    ksceKernelMemcpyKernelToUser((unsigned char *)dst + first, base, len - first);
+}
+
+int msgq_init(int size)
+{
+  int ret = 0;
+
+  if (memblock_uid != -1)
+  {
+    // already inited
+    return 0;
+  }
+
+  evf_uid = ksceKernelCreateEventFlag("MsgQueueEventFlag", SCE_EVENT_WAITMULTIPLE, 0, NULL);
+  if (evf_uid < 0)
+  {
+    ret = evf_uid;
+    goto fail_evf;
+  }
+
+  mtx_uid = ksceKernelCreateMutex("MsgQueueMutex", 0, 0, NULL);
+  if (mtx_uid < 0)
+  {
+    ret = mtx_uid;
+    goto fail_mtx;
+  }
+
+  memblock_uid = ksceKernelAllocMemBlock("MsgQueueMemBlock", 0x6020D006, size, NULL);
+  if (memblock_uid < 0)
+  {
+    ret = memblock_uid;
+    goto fail_memblock;
+  }
+  ksceKernelGetMemBlockBase(memblock_uid, (void **)&base);
+
+  size_ = size;
+  head = tail = 0;
+  count       = 0;
+  return 0;
+
+fail_memblock:
+  ksceKernelDeleteMutex(mtx_uid);
+fail_mtx:
+  ksceKernelDeleteEventFlag(evf_uid);
+fail_evf:
+  evf_uid = mtx_uid = memblock_uid = -1;
+  return ret;
+}
+
+int msgq_term(void)
+{
+  if (memblock_uid == -1)
+    return 0;
+
+  ksceKernelDeleteEventFlag(evf_uid);
+  ksceKernelDeleteMutex(mtx_uid);
+  ksceKernelFreeMemBlock(memblock_uid);
+  evf_uid = mtx_uid = memblock_uid = -1;
+  base                             = NULL;
+  size_                            = 0;
+  return 0;
+}
+
+void msgq_reset(void)
+{
+  if (memblock_uid == -1)
+    return;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  head = tail = 0;
+  count       = 0;
+  ksceKernelClearEventFlag(evf_uid, ~MSGQ_EVF_NON_EMPTY);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+}
+
+int msgq_count(void)
+{
+  return count;
+}
+
+/* Returns 0, or -1 if the record doesn't fit and was dropped */
+int msgq_put(const unsigned char *data, int len, uint32_t ts)
+{
+  msgHeader h = {len, ts};
+  int ret     = -1;
+
+  if (memblock_uid == -1)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (sizeof(h) + len <= size_ - (head - tail))
+  {
+    copy_in(head, &h, sizeof(h));
+    copy_in(head + sizeof(h), data, len);
+    head += sizeof(h) + len;
+    count++;
+    ksceKernelSetEventFlag(evf_uid, MSGQ_EVF_NON_EMPTY);
+    ret = 0;
+  }
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return ret;
+}
+
+/*
+ * Pop one record into user memory. Returns its full length, of which at
+ * most size bytes were copied, or -1 if the queue is empty.
+ */
+int msgq_get_user(unsigned char *buf, int size, uint32_t *ts)
+{
+  msgHeader h;
+  unsigned int n = size > 0 ? (unsigned int)size : 0;
+
+  if (memblock_uid == -1)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (!count)
+  {
+    ksceKernelUnlockMutex(mtx_uid, 1);
+    return -1;
+  }
+
+  copy_out(&h, tail, sizeof(h));
+  if (n > h.len)
+    n = h.len;
+  copy_out_user(buf, tail + sizeof(h), n);
+  tail += sizeof(h) + h.len;
+  if (--count == 0)
+    ksceKernelClearEventFlag(evf_uid, ~MSGQ_EVF_NON_EMPTY);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+
+  if (ts)
+    *ts = h.ts;
+  return h.len;
+}
+
+/* Wait for a record or msgq_abort(1), NULL timeout waits forever */
+int msgq_wait(SceUInt *timeout)
+{
+  if (memblock_uid == -1)
+    return -1;
+
+  return ksceKernelWaitEventFlag(evf_uid, MSGQ_EVF_NON_EMPTY | MSGQ_EVF_ABORT, SCE_EVENT_WAITOR, NULL, timeout);
+}
+
+void msgq_abort(int abort)
+{
+  if (memblock_uid == -1)
+    return;
+
+  if (abort)
+    ksceKernelSetEventFlag(evf_uid, MSGQ_EVF_ABORT);
+  else
+    ksceKernelClearEventFlag(evf_uid, ~MSGQ_EVF_ABORT);
+}
@@ -0,0 +1,37 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MSGQUEUE_H__
+#define __MSGQUEUE_H__
+
+#include <psp2kern/types.h>
+#include <stdint.h>
+
+/* Queue of (length, timestamp, payload) records for frame and message reads */
+
+int msgq_init(int size);
+int msgq_term(void);
+void msgq_reset(void);
+int msgq_count(void);
+
+int msgq_put(const unsigned char *data, int len, uint32_t ts);
+int msgq_get_user(unsigned char *buf, int size, uint32_t *ts);
+int msgq_wait(SceUInt *timeout);
+void msgq_abort(int abort);
+
+#endif // __MSGQUEUE_H__
@@ -18,12 +18,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "ringbuf.h"
+#include "histogram.h"
 
 #include <psp2kern/kernel/sysmem.h>
 #include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
 
 #define SCE_KERNEL_ATTR_THREAD_FIFO (0x00000000U)
 #define RINGBUF_EVF_NON_EMPTY 0x00000001
+#define RINGBUF_EVF_ABORT     0x00000002
 
 static SceUID evf_uid      = -1;
 static SceUID mtx_uid      = -1;
@@ -34,9 +37,79 @@ static unsigned char *base_ptr = NULL;
 static unsigned char *get_ptr  = NULL;
 static unsigned char *put_ptr  = NULL;
 
+static unsigned int dropped    = 0;
+static unsigned int high_water = 0;
+static uint32_t last_put       = 0;
+
+/*
+ * Reader wakeups: the producer only signals once wake_level bytes are
+ * buffered, a waiter with data below that sleeps at most until coalesce us
+ * after the oldest unread byte arrived.
+ */
+static int wake_threshold     = 1;
+static SceUInt coalesce       = 0;
+static int wake_level         = 1;
+static uint32_t first_unread  = 0;
+static unsigned int wakeups   = 0;
+
+/*
+ * Arrival marks for RX delivery latency: stream offset of the first byte of
+ * each put and its arrival time. Offsets are free-running byte counters.
+ */
+#define RINGBUF_MARKS 64
+
+typedef struct
+{
+  uint32_t pos;
+  uint32_t ts;
+} arrivalMark;
+
+static arrivalMark marks[RINGBUF_MARKS];
+static unsigned int mark_head = 0;
+static unsigned int mark_tail = 0;
+static uint32_t put_total     = 0;
+static uint32_t get_total     = 0;
+
+static void mark_arrival(int size)
+{
+  last_put = ksceKernelGetSystemTimeLow();
+  if (put_total == get_total)
+    first_unread = last_put;
+
+  // full: skip this packet, latency of the older ones still counts
+  if (mark_head - mark_tail < RINGBUF_MARKS)
+  {
+    arrivalMark *m = &marks[mark_head % RINGBUF_MARKS];
+    m->pos         = put_total;
+    m->ts          = last_put;
+    mark_head++;
+  }
+  put_total += size;
+}
+
+static void mark_delivered(int record)
+{
+  uint32_t now = 0;
+
+  while (mark_head != mark_tail)
+  {
+    arrivalMark *m = &marks[mark_tail % RINGBUF_MARKS];
+    if ((int32_t)(get_total - m->pos) <= 0)
+      break;
+
+    if (record)
+    {
+      if (!now)
+        now = ksceKernelGetSystemTimeLow();
+      histogram_record(LATENCY_RX_DELIVER, now - m->ts);
+    }
+    mark_tail++;
+  }
+}
+
 static int idx(unsigned char *ptr)
 {
-  return (unsigned int)ptr % buf_len;
+  return (unsigned int)(ptr - base_ptr) % buf_len;
 }
 
 static void inc(unsigned char **ptr)
@@ -70,6 +143,8 @@ static int put_clobber(unsigned char c)
   if (full())
   {
     inc(&get_ptr);
+    dropped++;
+    get_total++;
   }
   *put_ptr = c;
   inc(&put_ptr);
@@ -84,6 +159,7 @@ static int get(unsigned char *c)
   }
   *c = *get_ptr;
   inc(&get_ptr);
+  get_total++;
   return 0;
 }
 
@@ -146,6 +222,47 @@ int ringbuf_term(void)
 void ringbuf_reset()
 {
   get_ptr = put_ptr = base_ptr;
+  get_total = put_total;
+  mark_tail = mark_head;
+}
+
+/* Drops the contents, callers make sure no IN completion is running meanwhile */
+int ringbuf_resize(int size)
+{
+  SceUID new_uid, old_uid;
+  unsigned char *new_base = NULL;
+
+  if (memblock_uid == -1)
+  {
+    return -1;
+  }
+
+  if (size == buf_len)
+  {
+    return 0;
+  }
+
+  new_uid = ksceKernelAllocMemBlock("RingBufferMemBlock", 0x6020D006, size, NULL);
+  if (new_uid < 0)
+  {
+    return new_uid;
+  }
+  ksceKernelGetMemBlockBase(new_uid, (void **)&new_base);
+
+  // contents are dropped, producer is blocked on mutex meanwhile
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  old_uid      = memblock_uid;
+  memblock_uid = new_uid;
+  base_ptr     = new_base;
+  buf_len      = size;
+  get_ptr = put_ptr = base_ptr;
+  get_total = put_total;
+  mark_tail = mark_head;
+  ksceKernelClearEventFlag(evf_uid, ~RINGBUF_EVF_NON_EMPTY);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+
+  ksceKernelFreeMemBlock(old_uid);
+  return 0;
 }
 
 int ringbuf_put(unsigned char *c, int size)
@@ -167,7 +284,12 @@ int ringbuf_put(unsigned char *c, int size)
 
   if (n_put > 0)
   {
-    ksceKernelSetEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY);
+    unsigned int level = ringbuf_available();
+    mark_arrival(n_put);
+    if (level > high_water)
+      high_water = level;
+    if ((int)level >= wake_level)
+      ksceKernelSetEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY);
   }
 
   ksceKernelUnlockMutex(mtx_uid, 1);
@@ -177,7 +299,9 @@ int ringbuf_put(unsigned char *c, int size)
 int ringbuf_put_clobber(unsigned char *c, int size)
 {
   int n_put = 0;
+  unsigned int n_dropped;
   ksceKernelLockMutex(mtx_uid, 1, NULL);
+  n_dropped = dropped;
 
   while (size-- > 0)
   {
@@ -187,7 +311,15 @@ int ringbuf_put_clobber(unsigned char *c, int size)
 
   if (n_put > 0)
   {
-    ksceKernelSetEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY);
+    unsigned int level = ringbuf_available();
+    mark_arrival(n_put);
+    // packets overwritten before anyone read them don't count as delivered
+    if (dropped != n_dropped)
+      mark_delivered(0);
+    if (level > high_water)
+      high_water = level;
+    if ((int)level >= wake_level)
+      ksceKernelSetEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY);
   }
 
   ksceKernelUnlockMutex(mtx_uid, 1);
@@ -211,6 +343,11 @@ int ringbuf_get(unsigned char *c, int size)
     }
   }
 
+  if (n_get > 0)
+  {
+    mark_delivered(1);
+  }
+
   if (empty())
   {
     ksceKernelClearEventFlag(evf_uid, ~RINGBUF_EVF_NON_EMPTY);
@@ -220,40 +357,193 @@ int ringbuf_get(unsigned char *c, int size)
   return n_get;
 }
 
-int ringbuf_get_wait(unsigned char *c, int size, SceUInt timeout)
+/*
+ * Wait until the wake threshold (capped by room, at least need) is buffered,
+ * the coalescing time of buffered data ran out, or ringbuf_abort(1). NULL
+ * timeout waits forever, otherwise it is updated like for
+ * ksceKernelWaitEventFlag.
+ *
+ * With coalescing and less than need buffered, the first byte that makes
+ * need wakes us once to start the timer, after that only the threshold or
+ * the timer does.
+ */
+int ringbuf_wait(int need, int room, SceUInt *timeout)
 {
-  int n_get = 0;
-  SceUInt t = timeout;
-  int ret   = ksceKernelWaitEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY, SCE_EVENT_WAITAND, NULL, &t);
-  if (ret < 0)
+  // the caller has looked at what was there before need
+  uint32_t since = ksceKernelGetSystemTimeLow();
+
+  for (;;)
   {
-    goto done;
+    SceUInt t, *tp = timeout;
+    unsigned int bits = 0;
+    int by_coalesce   = 0;
+    int avail, ret;
+
+    ksceKernelLockMutex(mtx_uid, 1, NULL);
+    wake_level = (room > 0 && room < wake_threshold) ? room : wake_threshold;
+    if (wake_level < need)
+      wake_level = need;
+    avail = ringbuf_available();
+    if (avail >= wake_level)
+    {
+      ksceKernelUnlockMutex(mtx_uid, 1);
+      return 0;
+    }
+    if (coalesce && avail < need)
+    {
+      wake_level = need;
+    }
+    else if (coalesce)
+    {
+      uint32_t age = ksceKernelGetSystemTimeLow() - (need > 1 ? since : first_unread);
+      if (age >= coalesce)
+      {
+        ksceKernelUnlockMutex(mtx_uid, 1);
+        return 0;
+      }
+      t = coalesce - age;
+      if (!timeout || t < *timeout)
+      {
+        tp          = &t;
+        by_coalesce = 1;
+      }
+    }
+    // an earlier put may have signalled for a lower level
+    ksceKernelClearEventFlag(evf_uid, ~RINGBUF_EVF_NON_EMPTY);
+    ksceKernelUnlockMutex(mtx_uid, 1);
+
+    if (by_coalesce && timeout)
+    {
+      // keep the caller's budget running while we wait on our own timer
+      SceUInt before = t;
+      ret            = ksceKernelWaitEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY | RINGBUF_EVF_ABORT, SCE_EVENT_WAITOR, &bits, tp);
+      *timeout -= before - t;
+    }
+    else
+      ret = ksceKernelWaitEventFlag(evf_uid, RINGBUF_EVF_NON_EMPTY | RINGBUF_EVF_ABORT, SCE_EVENT_WAITOR, &bits, tp);
+    // timeouts and aborts aren't wakeups
+    if (ret >= 0 && (bits & RINGBUF_EVF_NON_EMPTY))
+      wakeups++;
+
+    if (ret < 0)
+      return by_coalesce ? 0 : ret;
+    if ((bits & RINGBUF_EVF_ABORT) || !coalesce || avail >= need)
+      return 0;
+    // first byte of a batch, go on waiting for the rest
   }
+}
+
+int ringbuf_get_wait(unsigned char *c, int size, SceUInt timeout)
+{
+  SceUInt t = timeout;
+  if (ringbuf_wait(1, size, &t) < 0)
+    return 0;
+  return ringbuf_get(c, size);
+}
+
+void ringbuf_set_wakeup(int threshold, SceUInt coalesce_us)
+{
   ksceKernelLockMutex(mtx_uid, 1, NULL);
+  wake_threshold = threshold;
+  coalesce       = coalesce_us;
+  ksceKernelUnlockMutex(mtx_uid, 1);
+}
 
-  while (size-- > 0)
+/*
+ * Find pattern in the buffered data, looking at bytes [from, limit) from the
+ * read position. Returns the length up to and including the match, or -1.
+ * Runs are contiguous between wraps, so the first byte is searched with
+ * memchr and only candidates are compared byte by byte across the wrap.
+ */
+int ringbuf_find(const unsigned char *pat, int len, int from, int limit)
+{
+  int avail, pos, found = -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  avail = ringbuf_available();
+  if (limit > avail)
+    limit = avail;
+
+  pos = from;
+  while (pos + len <= limit)
   {
-    if (get(c++) == 0)
+    int start = idx(get_ptr + pos);
+    int run   = buf_len - start;
+    unsigned char *hit;
+    int k;
+
+    if (run > limit - len + 1 - pos)
+      run = limit - len + 1 - pos;
+
+    hit = memchr(base_ptr + start, pat[0], run);
+    if (!hit)
     {
-      n_get++;
+      pos += run;
+      continue;
     }
-    else
+    pos += hit - (base_ptr + start);
+
+    for (k = 1; k < len; k++)
+    {
+      if (base_ptr[idx(get_ptr + pos + k)] != pat[k])
+        break;
+    }
+    if (k == len)
     {
+      found = pos + len;
       break;
     }
-  }
-
-  if (empty())
-  {
-    ksceKernelClearEventFlag(evf_uid, ~RINGBUF_EVF_NON_EMPTY);
+    pos++;
   }
 
   ksceKernelUnlockMutex(mtx_uid, 1);
-done:
-  return n_get;
+  return found;
+}
+
+/* Release waiters for good (device gone) or re-arm */
+void ringbuf_abort(int abort)
+{
+  if (abort)
+    ksceKernelSetEventFlag(evf_uid, RINGBUF_EVF_ABORT);
+  else
+    ksceKernelClearEventFlag(evf_uid, ~RINGBUF_EVF_ABORT);
+}
+
+/* ksceKernelGetSystemTimeLow() of the latest put */
+uint32_t ringbuf_last_put(void)
+{
+  return last_put;
+}
+
+/* Bytes that ever left the ring, read, overwritten or flushed */
+uint32_t ringbuf_tail(void)
+{
+  return get_total;
 }
 
 int ringbuf_available()
 {
-    return idx(put_ptr) - idx(get_ptr);
+    int n = idx(put_ptr) - idx(get_ptr);
+    if (n < 0)
+      n += buf_len;
+    return n;
+}
+
+int ringbuf_size()
+{
+    return buf_len;
+}
+
+void ringbuf_stats(uint32_t *n_dropped, uint32_t *n_high_water, uint32_t *n_wakeups)
+{
+    *n_dropped    = dropped;
+    *n_high_water = high_water;
+    *n_wakeups    = wakeups;
+}
+
+void ringbuf_reset_stats()
+{
+    dropped    = 0;
+    high_water = 0;
+    wakeups    = 0;
 }
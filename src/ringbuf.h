@@ -21,15 +21,26 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define RINGBUF_H
 
 #include <psp2kern/types.h>
+#include <stdint.h>
 
 int ringbuf_init(int size);
 int ringbuf_term(void);
 void ringbuf_reset(void);
+int ringbuf_resize(int size);
 int ringbuf_available(void);
+int ringbuf_size(void);
+void ringbuf_stats(uint32_t *dropped, uint32_t *high_water, uint32_t *wakeups);
+void ringbuf_reset_stats(void);
 
 int ringbuf_put(unsigned char *c, int size);
 int ringbuf_put_clobber(unsigned char *c, int size);
 int ringbuf_get(unsigned char *c, int size);
 int ringbuf_get_wait(unsigned char *c, int size, SceUInt timeout);
+int ringbuf_wait(int need, int room, SceUInt *timeout);
+void ringbuf_set_wakeup(int threshold, SceUInt coalesce_us);
+void ringbuf_abort(int abort);
+int ringbuf_find(const unsigned char *pat, int len, int from, int limit);
+uint32_t ringbuf_last_put(void);
+uint32_t ringbuf_tail(void);
 
 #endif
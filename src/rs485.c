@@ -0,0 +1,155 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rs485.h"
+#include "devicelist.h"
+#include "libusbserial_private.h"
+#include "devices/ftdi.h"
+#include "devices/ch34x.h"
+
+#include <psp2kern/kernel/threadmgr.h>
+
+/* echo is late by the chip latency timer at most, plus a USB frame */
+#define RS485_ECHO_SLACK_US 1000
+
+static int _set_rts(serialDevice *ctx, int tx)
+{
+  int level = (ctx->rs485_flags & RS485_RTS_ACTIVE_LOW) ? !tx : tx;
+
+  if (ctx->type == TYPE_FTDI)
+    return _ftdi_setrts(level);
+  else if (ctx->type == TYPE_CH34X)
+    return _ch34x_setrts(ctx, level);
+  return -1;
+}
+
+static SceUInt _char_us(serialDevice *ctx)
+{
+  int baud = ctx->actual_baudrate > 0 ? ctx->actual_baudrate : 9600;
+  return DIV_ROUND_UP(ctx->char_bits * 1000000, baud);
+}
+
+/* Returns the mode in effect or < 0, RTS is left at the receive level */
+int rs485_configure(serialDevice *ctx, int mode, int flags, SceUInt delay_before, SceUInt delay_after)
+{
+  if (mode == RS485_AUTO)
+    mode = (ctx->type == TYPE_FTDI && _ftdi_has_txden(ctx)) ? RS485_TXDEN : RS485_RTS;
+
+  ctx->rs485_mode = RS485_OFF;
+  ctx->rs485_echo = 0;
+
+  if (mode == RS485_OFF)
+    return RS485_OFF;
+
+  ctx->rs485_flags        = flags;
+  ctx->rs485_delay_before = delay_before;
+  ctx->rs485_delay_after  = delay_after;
+
+  if (mode == RS485_RTS)
+  {
+    if (_set_rts(ctx, 0) < 0)
+      return -1;
+    ctx->rs485_tx_on = 0;
+  }
+
+  ctx->rs485_mode = mode;
+  return mode;
+}
+
+/*
+ * Before len bytes go out: switch the transceiver to transmit and expect
+ * them back. The deadline is provisional until rs485_tx_end().
+ */
+int rs485_tx_begin(serialDevice *ctx, int len)
+{
+  if (ctx->rs485_mode == RS485_OFF)
+    return 0;
+
+  if (ctx->rs485_flags & RS485_ECHO)
+  {
+    ctx->rs485_echo_deadline = ksceKernelGetSystemTimeLow() + (len + 1) * _char_us(ctx) + ctx->rx_latency_us
+                               + RS485_ECHO_SLACK_US;
+    __atomic_add_fetch(&ctx->rs485_echo, len, __ATOMIC_RELAXED);
+  }
+
+  if (ctx->rs485_mode == RS485_RTS && !ctx->rs485_tx_on)
+  {
+    if (_set_rts(ctx, 1) < 0)
+      return -1;
+    ctx->rs485_tx_on = 1;
+    if (ctx->rs485_delay_before)
+      ksceKernelDelayThread(ctx->rs485_delay_before);
+  }
+  return 0;
+}
+
+/*
+ * After the last OUT transfer of len bytes completed. The chip may still
+ * hold its whole transmit buffer plus the byte in the shift register, so
+ * RTS drops once those had time to leave, not when USB says done.
+ */
+void rs485_tx_end(serialDevice *ctx, int len)
+{
+  unsigned int queued = (unsigned int)len < ctx->tx_fifo_size + 1 ? (unsigned int)len : ctx->tx_fifo_size + 1;
+  uint32_t wire_end   = ctx->tx_done_ts + queued * _char_us(ctx);
+
+  uint32_t now;
+
+  if (ctx->rs485_mode == RS485_OFF)
+    return;
+
+  if (ctx->rs485_mode == RS485_RTS && ctx->rs485_tx_on)
+  {
+    int32_t wait = (int32_t)(wire_end + ctx->rs485_delay_after - ksceKernelGetSystemTimeLow());
+
+    if (wait > 0)
+      ksceKernelDelayThread(wait);
+    _set_rts(ctx, 0);
+    ctx->rs485_tx_on = 0;
+  }
+
+  // we may have been scheduled late, the echo can't be older than that
+  now = ksceKernelGetSystemTimeLow();
+  if ((int32_t)(now - wire_end) > 0)
+    wire_end = now;
+  if (ctx->rs485_flags & RS485_ECHO)
+    ctx->rs485_echo_deadline = wire_end + ctx->rx_latency_us + RS485_ECHO_SLACK_US;
+}
+
+/*
+ * Skip our own bytes at the start of received data, runs in the receive
+ * callback. Returns the bytes left at *buf.
+ */
+int rs485_filter_echo(serialDevice *ctx, unsigned char **buf, int len)
+{
+  int echo = ctx->rs485_echo;
+
+  if ((int32_t)(ksceKernelGetSystemTimeLow() - ctx->rs485_echo_deadline) > 0)
+  {
+    // lost on the bus, don't eat the reply
+    __atomic_sub_fetch(&ctx->rs485_echo, echo, __ATOMIC_RELAXED);
+    return len;
+  }
+
+  if (echo > len)
+    echo = len;
+  __atomic_sub_fetch(&ctx->rs485_echo, echo, __ATOMIC_RELAXED);
+  ctx->stats.echo_drops += echo;
+  *buf += echo;
+  return len - echo;
+}
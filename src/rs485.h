@@ -0,0 +1,33 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RS485_H__
+#define __RS485_H__
+
+#include "serialdevice.h"
+
+#include <psp2/types.h>
+
+/* Half-duplex transceiver direction and local echo around writes */
+
+int rs485_configure(serialDevice *ctx, int mode, int flags, SceUInt delay_before, SceUInt delay_after);
+int rs485_tx_begin(serialDevice *ctx, int len);
+void rs485_tx_end(serialDevice *ctx, int len);
+int rs485_filter_echo(serialDevice *ctx, unsigned char **buf, int len);
+
+#endif // __RS485_H__
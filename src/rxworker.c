@@ -0,0 +1,188 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rxworker.h"
+#include "histogram.h"
+
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/kernel/threadmgr/event_flags.h>
+
+#define RXWORKER_EVF_WORK 0x00000001
+#define RXWORKER_EVF_STOP 0x00000002
+
+#define RXWORKER_THREAD_STACK 0x1000
+
+/*
+ * Every IN transfer has at most one completion outstanding, so a queue
+ * longer than the transfer count can't overflow. One producer (the USB
+ * callback), one consumer (the worker), offsets run free.
+ */
+#define RXWORKER_QUEUE 32
+
+/*
+ * Handover back to the callback. Bit 0 closes the queue, bits 1-7 count
+ * callbacks inside rxworker_push() and bits 8+ count pushes, so the
+ * worker can only close it while it is empty and nobody is pushing, and
+ * older completions are never overtaken by inline ones.
+ */
+#define GATE_CLOSED 0x01
+#define GATE_PUSHER 0x02
+#define GATE_ACTIVE 0xFE
+#define GATE_PUSH   0x100
+
+typedef struct
+{
+  rxTransfer *xfer;
+  int32_t result;
+  int32_t count;
+  uint32_t ts;
+} rxCompletion;
+
+static rxCompletion queue[RXWORKER_QUEUE];
+static volatile unsigned int head = 0;
+static volatile unsigned int tail = 0;
+
+static SceUID evf_uid    = -1;
+static SceUID thread_uid = -1;
+static rxworker_handler handle = NULL;
+
+static unsigned int gate = GATE_CLOSED;
+static volatile int stopping = 0;
+
+static void _drain(void)
+{
+  while (tail != __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+  {
+    rxCompletion *c = &queue[tail % RXWORKER_QUEUE];
+
+    histogram_record(LATENCY_RX_WORKER, ksceKernelGetSystemTimeLow() - c->ts);
+    handle(c->xfer, c->result, c->count, c->ts);
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+  }
+}
+
+static int _rxworker_thread(SceSize args, void *argp)
+{
+  for (;;)
+  {
+    unsigned int bits = 0;
+
+    ksceKernelWaitEventFlag(evf_uid, RXWORKER_EVF_WORK | RXWORKER_EVF_STOP, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR,
+                            &bits, NULL);
+    _drain();
+
+    if (stopping)
+    {
+      unsigned int g = __atomic_load_n(&gate, __ATOMIC_ACQUIRE);
+
+      if (!(g & GATE_ACTIVE) && tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE) &&
+          __atomic_compare_exchange_n(&gate, &g, g | GATE_CLOSED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        break;
+
+      // a push slipped in, go around
+      ksceKernelSetEventFlag(evf_uid, RXWORKER_EVF_WORK);
+    }
+  }
+  return 0;
+}
+
+int rxworker_start(rxworker_handler handler, int priority, int cpu_mask)
+{
+  if (thread_uid != -1)
+    return -1;
+
+  evf_uid = ksceKernelCreateEventFlag("RxWorkerEventFlag", SCE_EVENT_WAITMULTIPLE, 0, NULL);
+  if (evf_uid < 0)
+  {
+    int ret = evf_uid;
+    evf_uid = -1;
+    return ret;
+  }
+
+  thread_uid = ksceKernelCreateThread("RxWorkerThread", _rxworker_thread, priority, RXWORKER_THREAD_STACK, 0, cpu_mask,
+                                      NULL);
+  if (thread_uid < 0)
+    goto fail;
+
+  handle   = handler;
+  head     = tail = 0;
+  stopping = 0;
+  if (ksceKernelStartThread(thread_uid, 0, NULL) < 0)
+  {
+    ksceKernelDeleteThread(thread_uid);
+    goto fail;
+  }
+
+  __atomic_and_fetch(&gate, ~GATE_CLOSED, __ATOMIC_RELEASE);
+  return 0;
+
+fail:
+  thread_uid = -1;
+  ksceKernelDeleteEventFlag(evf_uid);
+  evf_uid = -1;
+  return -1;
+}
+
+/*
+ * The worker keeps taking completions until it finds the queue empty,
+ * then closes it and exits, so no transfer is left without its resubmit.
+ */
+int rxworker_stop(void)
+{
+  if (thread_uid == -1)
+    return 0;
+
+  stopping = 1;
+  ksceKernelSetEventFlag(evf_uid, RXWORKER_EVF_STOP);
+  ksceKernelWaitThreadEnd(thread_uid, NULL, NULL);
+  ksceKernelDeleteThread(thread_uid);
+  ksceKernelDeleteEventFlag(evf_uid);
+  thread_uid = evf_uid = -1;
+  return 0;
+}
+
+/*
+ * From the USB callback, ts is when the transfer completed. Returns 0 if the
+ * worker took it, -1 to handle it inline.
+ */
+int rxworker_push(rxTransfer *xfer, int32_t result, int32_t count, uint32_t ts)
+{
+  unsigned int g = __atomic_load_n(&gate, __ATOMIC_ACQUIRE);
+  int ret        = -1;
+
+  do
+  {
+    if (g & GATE_CLOSED)
+      return -1;
+  } while (!__atomic_compare_exchange_n(&gate, &g, g + GATE_PUSHER + GATE_PUSH, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  if (head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) < RXWORKER_QUEUE)
+  {
+    rxCompletion *c = &queue[head % RXWORKER_QUEUE];
+
+    c->xfer   = xfer;
+    c->result = result;
+    c->count  = count;
+    c->ts     = ts;
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+    ksceKernelSetEventFlag(evf_uid, RXWORKER_EVF_WORK);
+    ret = 0;
+  }
+  __atomic_sub_fetch(&gate, GATE_PUSHER, __ATOMIC_ACQ_REL);
+  return ret;
+}
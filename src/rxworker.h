@@ -0,0 +1,34 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RXWORKER_H__
+#define __RXWORKER_H__
+
+#include "serialdevice.h"
+
+#include <psp2kern/types.h>
+
+/* Optional thread that runs IN completions instead of the USB callback */
+
+typedef void (*rxworker_handler)(rxTransfer *xfer, int32_t result, int32_t count, uint32_t ts);
+
+int rxworker_start(rxworker_handler handler, int priority, int cpu_mask);
+int rxworker_stop(void);
+int rxworker_push(rxTransfer *xfer, int32_t result, int32_t count, uint32_t ts);
+
+#endif // __RXWORKER_H__
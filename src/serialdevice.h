@@ -20,10 +20,27 @@
 #define __SERIALDEVICE_H__
 
 #include "devices/ftdi_chips.h"
+#include "libusbserial.h"
 
 #include <psp2/types.h>
 #include <stdint.h>
 
+/** rates with divisors precomputed per chip family, X(baudrate) */
+#define COMMON_BAUDRATES(X)                                                                                            \
+  X(300) X(600) X(1200) X(2400) X(4800) X(9600) X(14400) X(19200) X(28800) X(38400) X(57600) X(76800) X(115200)        \
+  X(128000) X(153600) X(230400) X(250000) X(256000) X(460800) X(500000) X(576000) X(921600) X(1000000) X(1500000)      \
+  X(2000000) X(3000000)
+
+/** maximum number of IN transfers kept in flight in streaming mode */
+#define RX_STREAM_MAX_TRANSFERS 16
+
+typedef struct
+{
+  unsigned char *buffer;
+  unsigned int size;
+  /** don't resubmit on completion */
+  uint8_t retired;
+} rxTransfer;
 
 typedef struct
 {
@@ -37,9 +54,31 @@ typedef struct
   SceUID in_pipe_id;
   SceUID out_pipe_id;
   SceUID control_pipe_id;
+  /** interrupt IN, modem status on CH34x */
+  SceUID intr_pipe_id;
 
   /** FTDI chip type */
   enum ftdi_chip_type ftdi_type;
+  /** FTDI bitbang/MPSSE/FIFO mode, BITMODE_RESET for uart */
+  uint8_t ftdi_bitmode;
+  /** modem status from the latest packet header */
+  uint8_t ftdi_msr;
+  /** insert error markers into RX stream */
+  uint8_t ftdi_parmrk;
+  /** worst case for a full message mode transfer */
+  unsigned char mark_buffer[3 * LIBUSBSERIAL_MAX_FRAME] __attribute__((aligned(64)));
+
+  /** line status, counters are FTDI only */
+  struct libusbserial_line_status line_status;
+
+  /** driver counters, ring counters are kept by ringbuf */
+  struct libusbserial_stats stats;
+
+  /** submit timestamps for latency histograms */
+  uint32_t ctrl_submit_ts;
+  uint32_t tx_submit_ts;
+  /** when the last OUT transfer completed */
+  uint32_t tx_done_ts;
 
   /** ch34x fields */
   uint32_t ch34x_quirks;
@@ -47,12 +86,68 @@ typedef struct
   uint8_t ch34x_msr;
   uint8_t ch34x_lcr;
   uint8_t ch34x_version;
+  unsigned char ch34x_status_buffer[64] __attribute__((aligned(64)));
+  unsigned int ch34x_status_size;
 
-  /** baudrate */
+  /** modem status change counter, bumped on every status change */
+  volatile uint32_t modem_changes;
+
+  /** enum frame_mode, RX goes through framing into msgqueue */
+  uint8_t frame_mode;
+
+  /** baudrate, as requested */
   int baudrate;
+  /** baudrate the divisor actually gives */
+  int actual_baudrate;
+  /** longest time the chip holds received bytes before sending a packet */
+  unsigned int rx_latency_us;
+  /** start + data + parity + stop bits, 1.5 stop bits count as 2 */
+  uint8_t char_bits;
+  /** last libusbserial_set_line_property(), enum bits_type, stopbits_type, parity_type */
+  uint8_t line_bits;
+  uint8_t line_stop;
+  uint8_t line_parity;
+  /** chip transmit buffer, bytes still to go out after an OUT transfer completed */
+  unsigned int tx_fifo_size;
+
+  /** enum rs485_mode, never RS485_AUTO */
+  uint8_t rs485_mode;
+  /** enum rs485_flags */
+  uint8_t rs485_flags;
+  SceUInt rs485_delay_before;
+  SceUInt rs485_delay_after;
+  /** RTS currently at the transmit level */
+  uint8_t rs485_tx_on;
+  /** bytes of our own transmission still expected back */
+  volatile int rs485_echo;
+  /** echo not seen by then isn't coming */
+  volatile uint32_t rs485_echo_deadline;
+
+  /** flow control, enum flow_control */
+  int flowctrl;
+
+  /** driver-side XON/XOFF for chips without it */
+  uint8_t soft_flow;
+  uint8_t xon_char;
+  uint8_t xoff_char;
+  /** peer sent XOFF */
+  volatile uint8_t tx_stopped;
+  /** we sent XOFF */
+  volatile uint8_t rx_throttled;
+  /** longest a write waits for XON, us, 0 = forever */
+  SceUInt tx_timeout;
+  unsigned char soft_flow_buffer[64] __attribute__((aligned(64)));
 
   unsigned char read_buffer[4096] __attribute__((aligned(64)));
 
+  /** IN transfers */
+  rxTransfer rx_default;
+  rxTransfer rx_stream[RX_STREAM_MAX_TRANSFERS];
+  unsigned int rx_stream_count;
+  SceUID rx_stream_memblock;
+  /** number of IN transfers currently submitted */
+  volatile int rx_inflight;
+
   unsigned char writebuffer[4096] __attribute__((aligned(64)));
   /** write buffer chunk size */
   unsigned int writebuffer_chunksize;
@@ -0,0 +1,263 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "shmring.h"
+#include "libusbserial.h"
+
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+#define SHMRING_EVF_LEVEL 0x00000001
+#define SHMRING_EVF_ABORT 0x00000002
+
+// ksceKernelUserMap permission
+#define SHMRING_MAP_RW 3
+
+/*
+ * The user process can scribble over the whole block, so the driver keeps
+ * its own size and head and never trusts more than tail from it. A bogus
+ * tail only makes the ring look full or short.
+ */
+static SceUID evf_uid = -1;
+static SceUID mtx_uid = -1;
+static SceUID map_uid = -1;
+
+static struct libusbserial_shm *shm = NULL;
+static unsigned char *ring          = NULL;
+static uint32_t ring_size           = 0;
+static uint32_t head                = 0;
+static int wake_level               = 0; // bytes a blocked reader waits for, 0 = none
+
+static uint32_t _available(void)
+{
+  uint32_t n = head - __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+  return n > ring_size ? ring_size : n;
+}
+
+int shmring_init(void)
+{
+  if (evf_uid != -1)
+  {
+    // already inited
+    return 0;
+  }
+
+  evf_uid = ksceKernelCreateEventFlag("ShmRingEventFlag", SCE_EVENT_WAITMULTIPLE, 0, NULL);
+  if (evf_uid < 0)
+  {
+    int ret = evf_uid;
+    evf_uid = -1;
+    return ret;
+  }
+
+  mtx_uid = ksceKernelCreateMutex("ShmRingMutex", 0, 0, NULL);
+  if (mtx_uid < 0)
+  {
+    int ret = mtx_uid;
+    ksceKernelDeleteEventFlag(evf_uid);
+    evf_uid = mtx_uid = -1;
+    return ret;
+  }
+  return 0;
+}
+
+int shmring_term(void)
+{
+  if (evf_uid == -1)
+    return 0;
+
+  shmring_detach();
+  ksceKernelDeleteEventFlag(evf_uid);
+  ksceKernelDeleteMutex(mtx_uid);
+  evf_uid = mtx_uid = -1;
+  return 0;
+}
+
+/* size is LIBUSBSERIAL_SHM_HEADER plus a power of two, checked by the caller */
+int shmring_attach(void *user_block, int size)
+{
+  void *page;
+  SceUInt32 offset;
+  SceUID uid;
+
+  if (evf_uid == -1)
+    return -1;
+
+  uid = ksceKernelUserMap("ShmRingMap", SHMRING_MAP_RW, user_block, size, &page, NULL, &offset);
+  if (uid < 0)
+    return uid;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (shm)
+  {
+    ksceKernelUnlockMutex(mtx_uid, 1);
+    ksceKernelMemBlockRelease(uid);
+    return -1;
+  }
+
+  map_uid   = uid;
+  shm       = (struct libusbserial_shm *)((unsigned char *)page + offset);
+  ring      = (unsigned char *)shm + LIBUSBSERIAL_SHM_HEADER;
+  ring_size = size - LIBUSBSERIAL_SHM_HEADER;
+  head      = 0;
+
+  memset(shm, 0, sizeof(*shm));
+  shm->size = ring_size;
+  ksceKernelClearEventFlag(evf_uid, ~SHMRING_EVF_LEVEL);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return 0;
+}
+
+int shmring_detach(void)
+{
+  SceUID uid;
+
+  if (evf_uid == -1)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  uid     = map_uid;
+  map_uid = -1;
+  shm     = NULL;
+  ring    = NULL;
+  ksceKernelUnlockMutex(mtx_uid, 1);
+
+  if (uid < 0)
+    return -1;
+
+  // let a waiter notice it is gone
+  ksceKernelSetEventFlag(evf_uid, SHMRING_EVF_LEVEL);
+  ksceKernelMemBlockRelease(uid);
+  return 0;
+}
+
+int shmring_active(void)
+{
+  return shm != NULL;
+}
+
+int shmring_available(void)
+{
+  int n = 0;
+
+  if (evf_uid == -1)
+    return 0;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (shm)
+    n = _available();
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return n;
+}
+
+int shmring_size(void)
+{
+  return ring_size;
+}
+
+/* Returns how many bytes fit, the rest is counted as dropped */
+int shmring_put(const unsigned char *data, int len)
+{
+  uint32_t n, off, first;
+
+  if (evf_uid == -1)
+    return 0;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (!shm)
+  {
+    ksceKernelUnlockMutex(mtx_uid, 1);
+    return 0;
+  }
+
+  n = ring_size - _available();
+  if (n > (uint32_t)len)
+    n = len;
+  off   = head & (ring_size - 1);
+  first = ring_size - off;
+  if (first > n)
+    first = n;
+  memcpy(ring + off, data, first);
+  memcpy(ring, data + first, n - first);
+
+  head += n;
+  __atomic_store_n(&shm->head, head, __ATOMIC_RELEASE);
+  if (n < (uint32_t)len)
+    shm->dropped += len - n;
+
+  if (wake_level && _available() >= (uint32_t)wake_level)
+    ksceKernelSetEventFlag(evf_uid, SHMRING_EVF_LEVEL);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return n;
+}
+
+void shmring_status(int plugged, int modem_status, uint32_t modem_changes)
+{
+  if (evf_uid == -1)
+    return;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (shm)
+  {
+    shm->plugged       = plugged;
+    shm->modem_status  = modem_status;
+    shm->modem_changes = modem_changes;
+  }
+  ksceKernelUnlockMutex(mtx_uid, 1);
+}
+
+/*
+ * Sleep until need bytes are in the ring, the ring is detached or
+ * shmring_abort(1). Returns < 0 on timeout, NULL timeout waits forever.
+ */
+int shmring_wait(int need, SceUInt *timeout)
+{
+  int ret;
+
+  if (evf_uid == -1)
+    return -1;
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  if (!shm || _available() >= (uint32_t)need)
+  {
+    ksceKernelUnlockMutex(mtx_uid, 1);
+    return 0;
+  }
+  wake_level = need;
+  ksceKernelClearEventFlag(evf_uid, ~SHMRING_EVF_LEVEL);
+  ksceKernelUnlockMutex(mtx_uid, 1);
+
+  ret = ksceKernelWaitEventFlag(evf_uid, SHMRING_EVF_LEVEL | SHMRING_EVF_ABORT, SCE_EVENT_WAITOR, NULL, timeout);
+
+  ksceKernelLockMutex(mtx_uid, 1, NULL);
+  wake_level = 0;
+  ksceKernelUnlockMutex(mtx_uid, 1);
+  return ret < 0 ? ret : 0;
+}
+
+void shmring_abort(int abort)
+{
+  if (evf_uid == -1)
+    return;
+
+  if (abort)
+    ksceKernelSetEventFlag(evf_uid, SHMRING_EVF_ABORT);
+  else
+    ksceKernelClearEventFlag(evf_uid, ~SHMRING_EVF_ABORT);
+}
@@ -0,0 +1,41 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <psp2kern/types.h>
+#include <stdint.h>
+
+/* Receive ring living in a block shared with the user process */
+
+int shmring_init(void);
+int shmring_term(void);
+
+int shmring_attach(void *user_block, int size);
+int shmring_detach(void);
+int shmring_active(void);
+int shmring_available(void);
+int shmring_size(void);
+
+int shmring_put(const unsigned char *data, int len);
+void shmring_status(int plugged, int modem_status, uint32_t modem_changes);
+int shmring_wait(int need, SceUInt *timeout);
+void shmring_abort(int abort);
+
+#endif // __SHMRING_H__
@@ -0,0 +1,119 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "softflow.h"
+#include "libusbserial_private.h"
+#include "tracering.h"
+
+#include <psp2kern/kernel/threadmgr.h>
+#include <psp2kern/kernel/threadmgr/event_flags.h>
+#include <psp2kern/usbd.h>
+
+/* throttle peer at 3/4 of the ring, release at 1/4 */
+#define SOFTFLOW_HIGH(size) ((size) - (size) / 4)
+#define SOFTFLOW_LOW(size) ((size) / 4)
+
+static void _callback_flow(int32_t result, int32_t count, void *arg)
+{
+  trace_event(TRACE_TX_DONE, count, result);
+}
+
+static void _send_flow_char(serialDevice *ctx, unsigned char c)
+{
+  // XON and XOFF get separate bytes, both may be in flight at once
+  unsigned char *b = ctx->soft_flow_buffer + (c == ctx->xon_char ? 32 : 0);
+
+  // async, can be issued from the receive callback and while a write waits on EVF_SEND
+  *b = c;
+  ksceUsbdBulkTransfer(ctx->out_pipe_id, b, 1, _callback_flow, NULL);
+}
+
+/*
+ * Strip XON/XOFF from received data and update TX state.
+ * Returns the number of data bytes left in buf.
+ */
+int softflow_filter_rx(serialDevice *ctx, unsigned char *buf, int len)
+{
+  unsigned char *src = buf;
+  unsigned char *dst = buf;
+  unsigned char *end = buf + len;
+
+  while (src < end)
+  {
+    unsigned char c = *src++;
+    if (c == ctx->xoff_char)
+    {
+      ctx->tx_stopped = 1;
+    }
+    else if (c == ctx->xon_char)
+    {
+      ctx->tx_stopped = 0;
+      ksceKernelSetEventFlag(status_ev, EVF_XON);
+    }
+    else
+    {
+      *dst++ = c;
+    }
+  }
+
+  return dst - buf;
+}
+
+/* Called after ring level changed, sends XOFF/XON on watermark crossings */
+void softflow_check_rx(serialDevice *ctx, int available, int size)
+{
+  if (!ctx->rx_throttled && available >= SOFTFLOW_HIGH(size))
+  {
+    ctx->rx_throttled = 1;
+    _send_flow_char(ctx, ctx->xoff_char);
+  }
+  else if (ctx->rx_throttled && available <= SOFTFLOW_LOW(size))
+  {
+    ctx->rx_throttled = 0;
+    _send_flow_char(ctx, ctx->xon_char);
+  }
+}
+
+/* Lift our XOFF, the peer would stay stopped if it was just forgotten */
+void softflow_release_rx(serialDevice *ctx)
+{
+  if (ctx->rx_throttled)
+  {
+    ctx->rx_throttled = 0;
+    _send_flow_char(ctx, ctx->xon_char);
+  }
+}
+
+/* Forget the peer's XOFF and wake a writer waiting for XON */
+void softflow_release_tx(serialDevice *ctx)
+{
+  ctx->tx_stopped = 0;
+  ksceKernelSetEventFlag(status_ev, EVF_XON);
+}
+
+/* Block writer while peer has us stopped, timeout keeps the time left, NULL waits forever */
+int softflow_wait_tx(serialDevice *ctx, SceUInt *timeout)
+{
+  while (ctx->soft_flow && ctx->tx_stopped)
+  {
+    int ret = ksceKernelWaitEventFlag(status_ev, EVF_XON, SCE_EVENT_WAITCLEAR_PAT | SCE_EVENT_WAITAND, NULL, timeout);
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SOFTFLOW_H__
+#define __SOFTFLOW_H__
+
+#include "serialdevice.h"
+
+#include <psp2/types.h>
+
+/* Driver-side XON/XOFF for chips that can't do it in hardware */
+
+int softflow_filter_rx(serialDevice *ctx, unsigned char *buf, int len);
+void softflow_check_rx(serialDevice *ctx, int available, int size);
+int softflow_wait_tx(serialDevice *ctx, SceUInt *timeout);
+void softflow_release_rx(serialDevice *ctx);
+void softflow_release_tx(serialDevice *ctx);
+
+#endif // __SOFTFLOW_H__
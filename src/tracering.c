@@ -0,0 +1,116 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tracering.h"
+
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+
+#define TRACERING_SIZE 2048 // records, power of two
+#define TRACERING_MASK (TRACERING_SIZE - 1)
+
+volatile uint32_t tracering_mask = 0;
+
+static struct libusbserial_trace_record records[TRACERING_SIZE];
+
+/* next slot to claim, producers only */
+static uint32_t head = 0;
+/* next slot to drain, drain syscall only */
+static uint32_t tail = 0;
+
+/*
+ * Writers claim a slot with one atomic add, invalidate it, and publish it by
+ * storing the slot sequence number last. The drain side only trusts records
+ * whose sequence matches the slot it expects before and after the copy,
+ * anything else is either still being written or already overwritten.
+ */
+void tracering_log(int event, uint32_t arg0, int32_t arg1)
+{
+  uint32_t slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  struct libusbserial_trace_record *r = &records[slot & TRACERING_MASK];
+
+  // a drain copying the lapped record must not see the old seq on new fields
+  __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  r->timestamp = ksceKernelGetSystemTimeLow();
+  r->event     = event;
+  r->arg0      = arg0;
+  r->arg1      = arg1;
+  __atomic_store_n(&r->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+int tracering_drain(struct libusbserial_trace_record *out, int max)
+{
+  struct libusbserial_trace_record kbuf[16];
+  uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  int n      = 0;
+  int count  = 0;
+
+  if (max <= 0)
+    return 0;
+
+  // writers lapped us, report the gap as one record
+  if (h - tail > TRACERING_SIZE)
+  {
+    kbuf[n].seq       = 0;
+    kbuf[n].timestamp = ksceKernelGetSystemTimeLow();
+    kbuf[n].event     = TRACE_LOST;
+    kbuf[n].arg0      = 0;
+    kbuf[n].arg1      = h - tail - TRACERING_SIZE;
+    n++;
+    tail = h - TRACERING_SIZE;
+  }
+
+  while (tail != h && count + n < max)
+  {
+    struct libusbserial_trace_record *r = &records[tail & TRACERING_MASK];
+
+    if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != tail + 1)
+      break;
+
+    kbuf[n] = *r;
+    // overwritten while copying
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != tail + 1)
+      break;
+
+    n++;
+    tail++;
+
+    if (n == sizeof(kbuf) / sizeof(kbuf[0]))
+    {
+      ksceKernelMemcpyKernelToUser(out + count, kbuf, n * sizeof(kbuf[0]));
+      count += n;
+      n = 0;
+    }
+  }
+
+  if (n > 0)
+  {
+    ksceKernelMemcpyKernelToUser(out + count, kbuf, n * sizeof(kbuf[0]));
+    count += n;
+  }
+
+  return count;
+}
+
+void tracering_reset(void)
+{
+  tail = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,40 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TRACERING_H__
+#define __TRACERING_H__
+
+#include "libusbserial.h"
+
+#include <stdint.h>
+
+extern volatile uint32_t tracering_mask;
+
+void tracering_log(int event, uint32_t arg0, int32_t arg1);
+int tracering_drain(struct libusbserial_trace_record *records, int max);
+void tracering_reset(void);
+
+/* cheap enough for completion callbacks: one load and test while disabled */
+#define trace_event(event, arg0, arg1)                                                                                 \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if (tracering_mask & (1U << (event)))                                                                              \
+      tracering_log((event), (arg0), (arg1));                                                                          \
+  } while (0)
+
+#endif // __TRACERING_H__
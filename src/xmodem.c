@@ -0,0 +1,416 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "xmodem.h"
+#include "crc.h"
+#include "libusbserial_private.h"
+#include "ringbuf.h"
+#include "rs485.h"
+
+#include <psp2kern/kernel/sysmem.h>
+#include <psp2kern/kernel/sysmem/data_transfers.h>
+#include <psp2kern/kernel/threadmgr.h>
+#include <string.h>
+
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define CRC_START 'C'
+#define CPMEOF 0x1A
+
+#define XMODEM_RETRIES 10
+/* the receiver gets this many reply timeouts to send its first 'C' or NAK */
+#define XMODEM_START_TRIES 6
+#define XMODEM_DEFAULT_TIMEOUT 10000000 // us
+/* how often a wait looks at the cancel flag */
+#define XMODEM_POLL_US 100000
+
+#define XMODEM_THREAD_PRIORITY 64
+#define XMODEM_THREAD_STACK 0x1000
+
+/* header, up to 1024 data bytes, CRC */
+#define BLOCK_MAX (3 + 1024 + 2)
+
+static SceUID thread_uid   = -1;
+static SceUID memblock_uid = -1;
+
+static serialDevice *dev = NULL;
+static volatile int running   = 0;
+static volatile int cancelled = 0;
+
+static int protocol;
+static const unsigned char *file;
+static int file_size;
+static char file_name[LIBUSBSERIAL_XMODEM_MAX_NAME + 1];
+static SceUInt reply_timeout;
+static int use_crc;
+
+static struct libusbserial_xmodem_status status;
+
+/* one block goes out while the next is put together */
+static unsigned char block[2][BLOCK_MAX] __attribute__((aligned(64)));
+
+/*
+ * Build block seq from len bytes of data, padded to 128 or 1024 bytes.
+ * Returns its size on the wire.
+ */
+static int _build(unsigned char *b, uint8_t seq, const unsigned char *data, int len, int size, unsigned char pad)
+{
+  unsigned char *payload = b + 3;
+
+  b[0] = size == 1024 ? STX : SOH;
+  b[1] = seq;
+  b[2] = ~seq;
+  memcpy(payload, data, len);
+  memset(payload + len, pad, size - len);
+
+  if (use_crc)
+  {
+    uint16_t crc = crc_final(CRC16_XMODEM, crc_update(CRC16_XMODEM, crc_start(CRC16_XMODEM), payload, size));
+    crc_put(CRC16_XMODEM, crc, payload + size);
+    return 3 + size + 2;
+  }
+  else
+  {
+    unsigned char sum = 0;
+    int i;
+
+    for (i = 0; i < size; i++)
+      sum += payload[i];
+    payload[size] = sum;
+    return 3 + size + 1;
+  }
+}
+
+/* 1024 byte blocks unless what's left fits a short one, classic checksum mode is 128 only */
+static int _block_size(int left)
+{
+  return (use_crc && left > 128) ? 1024 : 128;
+}
+
+static int _send_block(serialDevice *ctx, unsigned char *b, int len)
+{
+  int ret;
+
+  if (rs485_tx_begin(ctx, len) < 0)
+    return -1;
+  ret = _send(b, len);
+  rs485_tx_end(ctx, len);
+  return ret == len ? 0 : -1;
+}
+
+/*
+ * Next control character from the receiver, waiting up to timeout us.
+ * 'C' only counts while waiting for a start, later ones are stale
+ * repeats. Returns it, or enum xmodem_error for timeout, cancel and unplug.
+ */
+static int _reply(serialDevice *ctx, SceUInt timeout, int want_start)
+{
+  uint32_t start = ksceKernelGetSystemTimeLow();
+  int can        = 0;
+
+  for (;;)
+  {
+    unsigned char c;
+    uint32_t waited = ksceKernelGetSystemTimeLow() - start;
+    SceUInt slice;
+
+    if (cancelled)
+      return XMODEM_ERR_CANCEL;
+    if (ctx->in_pipe_id <= 0)
+      return XMODEM_ERR_DEVICE;
+    if (waited >= timeout)
+      return XMODEM_ERR_TIMEOUT;
+
+    slice = timeout - waited < XMODEM_POLL_US ? timeout - waited : XMODEM_POLL_US;
+    if (ringbuf_get_wait(&c, 1, slice) != 1)
+      continue;
+
+    // a lone CAN may be line noise, two in a row end the transfer
+    if (c == CAN)
+    {
+      if (++can == 2)
+        return XMODEM_ERR_CANCEL;
+      continue;
+    }
+    can = 0;
+
+    if (c == ACK || c == NAK || (want_start && c == CRC_START))
+      return c;
+  }
+}
+
+/* Wait for the receiver to ask for the first block, picks CRC or checksum */
+static int _wait_start(serialDevice *ctx)
+{
+  int tries;
+
+  for (tries = 0; tries < XMODEM_START_TRIES; tries++)
+  {
+    int c = _reply(ctx, reply_timeout, 1);
+
+    if (c == CRC_START || c == NAK)
+    {
+      use_crc = c == CRC_START;
+      return 0;
+    }
+    if (c != XMODEM_ERR_TIMEOUT && c != ACK)
+      return c;
+  }
+  return XMODEM_ERR_TIMEOUT;
+}
+
+/* Send b until it's ACKed */
+static int _exchange(serialDevice *ctx, unsigned char *b, int len)
+{
+  int tries;
+
+  for (tries = 0; tries < XMODEM_RETRIES; tries++)
+  {
+    int c;
+
+    if (_send_block(ctx, b, len) < 0)
+      return XMODEM_ERR_DEVICE;
+    c = _reply(ctx, reply_timeout, 0);
+    if (c == ACK)
+      return 0;
+    if (c == XMODEM_ERR_CANCEL || c == XMODEM_ERR_DEVICE)
+      return c;
+    status.retries++;
+  }
+  return XMODEM_ERR_RETRIES;
+}
+
+/* YMODEM block 0: name, NUL, decimal size, NUL. An empty name ends the batch */
+static int _header(unsigned char *b, const char *name, int size)
+{
+  unsigned char info[128];
+  int n = 0;
+
+  memset(info, 0, sizeof(info));
+  if (name[0])
+  {
+    char digits[12];
+    int d = 0;
+
+    n = strlen(name) + 1;
+    memcpy(info, name, n);
+    do
+    {
+      digits[d++] = '0' + size % 10;
+      size /= 10;
+    } while (size);
+    while (d)
+      info[n++] = digits[--d];
+  }
+  return _build(b, 0, info, sizeof(info), 128, 0);
+}
+
+static int _data(serialDevice *ctx)
+{
+  int pos = 0;
+  int cur = 0;
+  uint8_t seq = 1;
+  int next_len = 0;
+  int len, size;
+
+  size = _block_size(file_size);
+  len  = _build(block[cur], seq, file, file_size < size ? file_size : size, size, CPMEOF);
+
+  while (pos < file_size)
+  {
+    int chunk = file_size - pos < size ? file_size - pos : size;
+    int tries;
+
+    for (tries = 0;; tries++)
+    {
+      int c;
+
+      if (tries == XMODEM_RETRIES)
+        return XMODEM_ERR_RETRIES;
+      if (_send_block(ctx, block[cur], len) < 0)
+        return XMODEM_ERR_DEVICE;
+
+      // while this one is on the wire and being checked
+      if (tries == 0 && pos + chunk < file_size)
+      {
+        int left = file_size - pos - chunk;
+        int next = _block_size(left);
+
+        next_len = _build(block[!cur], seq + 1, file + pos + chunk, left < next ? left : next, next, CPMEOF);
+        size     = next;
+      }
+
+      c = _reply(ctx, reply_timeout, 0);
+      if (c == ACK)
+        break;
+      if (c == XMODEM_ERR_CANCEL || c == XMODEM_ERR_DEVICE)
+        return c;
+      status.retries++;
+    }
+
+    pos += chunk;
+    seq++;
+    cur = !cur;
+    len = next_len;
+    status.position = pos;
+    status.blocks++;
+  }
+  return 0;
+}
+
+static int _xmodem_thread(SceSize args, void *argp)
+{
+  serialDevice *ctx = dev;
+  unsigned char can[3] = {CAN, CAN, CAN};
+  int ret;
+
+  status.state = XMODEM_WAIT_START;
+  ret          = _wait_start(ctx);
+  if (ret == 0 && protocol == YMODEM)
+  {
+    ret = _exchange(ctx, block[0], _header(block[0], file_name, file_size));
+    // the receiver opens the file and asks again
+    if (ret == 0)
+      ret = _wait_start(ctx);
+  }
+
+  if (ret == 0)
+  {
+    status.state = XMODEM_SENDING;
+    ret          = _data(ctx);
+  }
+
+  if (ret == 0)
+  {
+    status.state = XMODEM_FINISHING;
+    // receivers often NAK the first EOT to make sure it wasn't noise
+    block[0][0] = EOT;
+    ret         = _exchange(ctx, block[0], 1);
+  }
+
+  if (ret == 0 && protocol == YMODEM)
+  {
+    ret = _wait_start(ctx);
+    if (ret == 0)
+      ret = _exchange(ctx, block[0], _header(block[0], "", 0));
+  }
+
+  if (ret == XMODEM_ERR_CANCEL && cancelled)
+  {
+    memcpy(block[0], can, sizeof(can));
+    _send_block(ctx, block[0], sizeof(can));
+  }
+
+  status.result = ret;
+  status.state  = ret == 0 ? XMODEM_DONE : XMODEM_FAILED;
+
+  ksceKernelFreeMemBlock(memblock_uid);
+  memblock_uid = -1;
+  running      = 0;
+  return 0;
+}
+
+/* Copies the file in and starts the thread, the caller checked the arguments */
+int xmodem_start(serialDevice *ctx, int proto, const unsigned char *user_data, int size, const char *name,
+                 int name_len, SceUInt timeout)
+{
+  void *base;
+
+  if (running)
+    return -1;
+  // reap the previous transfer
+  if (thread_uid != -1)
+  {
+    ksceKernelWaitThreadEnd(thread_uid, NULL, NULL);
+    ksceKernelDeleteThread(thread_uid);
+    thread_uid = -1;
+  }
+
+  memblock_uid = ksceKernelAllocMemBlock("XmodemMemBlock", 0x6020D006, (size + 0xFFF) & ~0xFFF, NULL);
+  if (memblock_uid < 0)
+  {
+    int ret      = memblock_uid;
+    memblock_uid = -1;
+    return ret;
+  }
+  ksceKernelGetMemBlockBase(memblock_uid, &base);
+  ksceKernelMemcpyUserToKernel(base, user_data, size);
+
+  memset(file_name, 0, sizeof(file_name));
+  if (name_len)
+    ksceKernelMemcpyUserToKernel(file_name, name, name_len);
+
+  dev           = ctx;
+  protocol      = proto;
+  file          = base;
+  file_size     = size;
+  reply_timeout = timeout ? timeout : XMODEM_DEFAULT_TIMEOUT;
+  cancelled     = 0;
+
+  memset(&status, 0, sizeof(status));
+  status.state = XMODEM_WAIT_START;
+  status.size  = size;
+
+  thread_uid = ksceKernelCreateThread("XmodemThread", _xmodem_thread, XMODEM_THREAD_PRIORITY, XMODEM_THREAD_STACK, 0,
+                                      0, NULL);
+  if (thread_uid < 0)
+    goto fail;
+
+  running = 1;
+  if (ksceKernelStartThread(thread_uid, 0, NULL) < 0)
+  {
+    running = 0;
+    ksceKernelDeleteThread(thread_uid);
+    goto fail;
+  }
+  return 0;
+
+fail:
+  thread_uid = -1;
+  ksceKernelFreeMemBlock(memblock_uid);
+  memblock_uid = -1;
+  status.state = XMODEM_IDLE;
+  return -1;
+}
+
+/* Stop a running transfer, the receiver gets CANs. Returns once it ended */
+int xmodem_cancel(void)
+{
+  if (thread_uid == -1)
+    return 0;
+
+  cancelled = 1;
+  ksceKernelWaitThreadEnd(thread_uid, NULL, NULL);
+  ksceKernelDeleteThread(thread_uid);
+  thread_uid = -1;
+  return 0;
+}
+
+int xmodem_active(void)
+{
+  return running;
+}
+
+void xmodem_status(struct libusbserial_xmodem_status *st)
+{
+  *st = status;
+}
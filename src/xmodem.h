@@ -0,0 +1,34 @@
+/*
+        libusbserial
+        Copyright (C) 2025 Cat (Ivan Epifanov)
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __XMODEM_H__
+#define __XMODEM_H__
+
+#include "serialdevice.h"
+
+#include <psp2kern/types.h>
+
+/* XMODEM(-1K) / YMODEM sender running in its own thread */
+
+int xmodem_start(serialDevice *ctx, int proto, const unsigned char *user_data, int size, const char *name,
+                 int name_len, SceUInt timeout);
+int xmodem_cancel(void);
+int xmodem_active(void);
+void xmodem_status(struct libusbserial_xmodem_status *status);
+
+#endif // __XMODEM_H__